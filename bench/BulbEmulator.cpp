@@ -0,0 +1,216 @@
+#include "BulbEmulator.h"
+
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QTimer>
+#include <QtNetwork/QUdpSocket>
+#include <algorithm>
+#include <functional>
+
+#include "LatencyStats.h"
+
+namespace {
+
+// Commands a rate-limited bulb takes back to back before ignoring any
+const double kBurst = 2;
+
+QByteArray errorReply(const QJsonObject &request, int code, const char *message) {
+    QJsonObject reply;
+    if (request.contains("method")) {
+        reply.insert("method", request.value("method"));
+    }
+    if (request.contains("id")) {
+        reply.insert("id", request.value("id"));
+    }
+    reply.insert("env", "pro");
+    reply.insert("error", QJsonObject{ { "code", code }, { "message", message } });
+    return QJsonDocument(reply).toJson(QJsonDocument::Compact);
+}
+
+} // namespace
+
+BulbEmulator::BulbEmulator(const EmulatorSettings &settings, QObject *parent)
+    : QObject(parent), m_settings(settings), m_timer(new QTimer(this)), m_random(std::random_device()()) {
+    m_received = 0;
+    m_answered = 0;
+    m_dropped = 0;
+    m_overloaded = 0;
+    m_invalid = 0;
+
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &BulbEmulator::sendDue);
+}
+
+BulbEmulator::~BulbEmulator() = default;
+
+bool BulbEmulator::start(QString *error) {
+    const qint64 now = monotonicNs();
+    for (int i = 0; i < m_settings.bulbs; ++i) {
+        QUdpSocket *socket = new QUdpSocket(this);
+        const quint16 port = m_settings.port != 0 ? quint16(m_settings.port + i) : 0;
+        if (!socket->bind(m_settings.address, port)) {
+            if (error) {
+                *error = QString("Can't bind bulb %1 to %2:%3: %4").arg(i)
+                         .arg(m_settings.address.toString()).arg(port).arg(socket->errorString());
+            }
+            return false;
+        }
+
+        const int index = int(m_bulbs.size());
+        connect(socket, &QUdpSocket::readyRead, this, [this, index]() { readPending(index); });
+        m_bulbs.push_back(Bulb{ socket, QColor(255, 255, 255), 100, true, kBurst, now });
+    }
+    return true;
+}
+
+QVector<quint16> BulbEmulator::ports() const {
+    QVector<quint16> ports;
+    for (const Bulb &bulb : m_bulbs) {
+        ports.append(bulb.socket->localPort());
+    }
+    return ports;
+}
+
+EmulatorStats BulbEmulator::stats() const {
+    EmulatorStats stats;
+    stats.received = m_received;
+    stats.answered = m_answered;
+    stats.dropped = m_dropped;
+    stats.overloaded = m_overloaded;
+    stats.invalid = m_invalid;
+    return stats;
+}
+
+QColor BulbEmulator::colour(int bulb) const {
+    return m_bulbs[size_t(bulb)].colour;
+}
+
+void BulbEmulator::readPending(int index) {
+    Bulb &bulb = m_bulbs[size_t(index)];
+    std::uniform_real_distribution<double> chance(0, 1);
+    std::uniform_int_distribution<int> jitter(0, m_settings.jitterMs);
+
+    while (bulb.socket->hasPendingDatagrams()) {
+        QByteArray request(int(bulb.socket->pendingDatagramSize()), Qt::Uninitialized);
+        QHostAddress address;
+        quint16 port = 0;
+        if (bulb.socket->readDatagram(request.data(), request.size(), &address, &port) < 0) {
+            break;
+        }
+
+        ++m_received;
+        const qint64 now = monotonicNs();
+        if (!admit(bulb, now)) {
+            ++m_overloaded;
+            continue;
+        }
+        if (m_settings.dropRate > 0 && chance(m_random) < m_settings.dropRate) {
+            ++m_dropped;
+            continue;
+        }
+
+        const qint64 delayNs = (m_settings.delayMs + jitter(m_random)) * qint64(1000000);
+        bool error = false;
+        const QByteArray payload = handle(bulb, request, &error);
+        m_replies.push_back(Reply{ now + delayNs, index, address, port, payload, error });
+        std::push_heap(m_replies.begin(), m_replies.end(), std::greater<Reply>());
+    }
+
+    schedule();
+}
+
+// Applies a command to the bulb and returns its reply, as the firmware
+// would send it
+QByteArray BulbEmulator::handle(Bulb &bulb, const QByteArray &request, bool *error) {
+    *error = true;
+
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(request, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+        return errorReply(QJsonObject(), -32700, "Parse error");
+    }
+
+    const QJsonObject command = document.object();
+    const QString method = command.value("method").toString();
+    const QJsonObject params = command.value("params").toObject();
+
+    QJsonObject result;
+    if (method == "setPilot" || method == "setState") {
+        if (params.contains("r") || params.contains("g") || params.contains("b")) {
+            bulb.colour = QColor(qBound(0, params.value("r").toInt(), 255),
+                                 qBound(0, params.value("g").toInt(), 255),
+                                 qBound(0, params.value("b").toInt(), 255));
+        }
+        if (params.contains("dimming")) {
+            const int dimming = params.value("dimming").toInt(-1);
+            if (dimming < 0 || dimming > 100) {
+                return errorReply(command, -32602, "Invalid params");
+            }
+            bulb.dimming = dimming;
+        }
+        if (params.contains("state")) {
+            bulb.state = params.value("state").toBool();
+        }
+        result.insert("success", true);
+    } else if (method == "getPilot") {
+        result.insert("state", bulb.state);
+        result.insert("sceneId", 0);
+        result.insert("r", bulb.colour.red());
+        result.insert("g", bulb.colour.green());
+        result.insert("b", bulb.colour.blue());
+        result.insert("dimming", bulb.dimming);
+    } else {
+        return errorReply(command, -32601, "Method not found");
+    }
+
+    *error = false;
+    QJsonObject reply;
+    reply.insert("method", method);
+    reply.insert("id", command.value("id"));
+    reply.insert("env", "pro");
+    reply.insert("result", result);
+    return QJsonDocument(reply).toJson(QJsonDocument::Compact);
+}
+
+// Token bucket: a bulb handles rateLimit commands a second, plus a short burst
+bool BulbEmulator::admit(Bulb &bulb, qint64 now) {
+    if (m_settings.rateLimit <= 0) {
+        return true;
+    }
+    bulb.tokens = qMin(kBurst, bulb.tokens + (now - bulb.refilledNs) * m_settings.rateLimit / 1e9);
+    bulb.refilledNs = now;
+    if (bulb.tokens < 1) {
+        return false;
+    }
+    bulb.tokens -= 1;
+    return true;
+}
+
+void BulbEmulator::schedule() {
+    if (m_replies.empty()) {
+        return;
+    }
+    const qint64 waitNs = m_replies.front().dueNs - monotonicNs();
+    if (waitNs <= 0) {
+        sendDue();
+        return;
+    }
+    m_timer->start(int((waitNs + 999999) / 1000000));
+}
+
+void BulbEmulator::sendDue() {
+    const qint64 now = monotonicNs();
+    while (!m_replies.empty() && m_replies.front().dueNs <= now) {
+        std::pop_heap(m_replies.begin(), m_replies.end(), std::greater<Reply>());
+        const Reply &reply = m_replies.back();
+        m_bulbs[size_t(reply.bulb)].socket->writeDatagram(reply.payload, reply.address, reply.port);
+        if (reply.error) {
+            ++m_invalid;
+        } else {
+            ++m_answered;
+        }
+        m_replies.pop_back();
+    }
+    schedule();
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <QtNetwork/QHostAddress>
+#include <atomic>
+#include <random>
+#include <vector>
+
+class QTimer;
+class QUdpSocket;
+
+// How the emulated bulbs behave
+struct EmulatorSettings {
+    int bulbs = 1;
+    QHostAddress address = QHostAddress(QHostAddress::LocalHost);
+    quint16 port = 0;       // First bulb's port, the rest follow it; 0 for any free ports
+    int delayMs = 0;        // Processing time before a bulb answers
+    int jitterMs = 0;       // Random extra delay, up to this much
+    double dropRate = 0;    // Share of commands ignored, at random
+    int rateLimit = 0;      // Commands a bulb handles per second, 0 for no limit
+};
+
+// Totals across all emulated bulbs. Every received datagram ends up in
+// exactly one of answered, dropped, overloaded or invalid (once its reply
+// is due).
+struct EmulatorStats {
+    quint64 received = 0;
+    quint64 answered = 0;
+    quint64 dropped = 0;    // Ignored at random
+    quint64 overloaded = 0; // Ignored for going over the rate limit
+    quint64 invalid = 0;    // Not a command, answered with an error
+};
+
+// Stand-ins for WiZ bulbs, each on its own UDP port. They take the same
+// JSON commands as real bulbs (setPilot, getPilot, setState) and answer the
+// way the hardware does, echoing the request id, so the sender can be
+// measured without a network or any bulbs. Like real bulbs, commands that
+// arrive faster than the rate limit are silently ignored.
+//
+// Runs on the event loop of the thread it lives in; stats() can be read
+// from any thread.
+class BulbEmulator : public QObject {
+    Q_OBJECT
+public:
+    explicit BulbEmulator(const EmulatorSettings &settings, QObject *parent = nullptr);
+    ~BulbEmulator() override;
+
+    // Binds a socket per bulb. Returns false with error set if one can't be.
+    bool start(QString *error);
+
+    // Port of each bulb, in order, once started
+    QVector<quint16> ports() const;
+
+    EmulatorStats stats() const;
+
+    // Colour a bulb was last set to; only call from the emulator's thread
+    QColor colour(int bulb) const;
+
+private:
+    struct Bulb {
+        QUdpSocket *socket;
+        QColor colour;
+        int dimming;
+        bool state;
+        double tokens;
+        qint64 refilledNs;
+    };
+
+    // A reply waiting out the processing delay
+    struct Reply {
+        qint64 dueNs;
+        int bulb;
+        QHostAddress address;
+        quint16 port;
+        QByteArray payload;
+        bool error;
+
+        bool operator>(const Reply &other) const { return dueNs > other.dueNs; }
+    };
+
+    void readPending(int index);
+    QByteArray handle(Bulb &bulb, const QByteArray &request, bool *error);
+    bool admit(Bulb &bulb, qint64 now);
+    void schedule();
+    void sendDue();
+
+    EmulatorSettings m_settings;
+    std::vector<Bulb> m_bulbs;
+    std::vector<Reply> m_replies;   // Min-heap on dueNs
+    QTimer *m_timer;
+    std::mt19937 m_random;
+
+    std::atomic<quint64> m_received;
+    std::atomic<quint64> m_answered;
+    std::atomic<quint64> m_dropped;
+    std::atomic<quint64> m_overloaded;
+    std::atomic<quint64> m_invalid;
+};
@@ -0,0 +1,83 @@
+// Emulates WiZ bulbs on local UDP ports, for sending to without hardware:
+//   ./WizBulbEmulator --bulbs 4 --port 38900 --delay 5 --drop 0.01
+//   ./WizLedDaemon --source synthetic --bulbs "127.0.0.1:38900, 127.0.0.1:38901"
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+#include <QtCore/QTimer>
+
+#include "BulbEmulator.h"
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("WizBulbEmulator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Emulates WiZ bulbs on local UDP ports, answering setPilot like the hardware.");
+    parser.addHelpOption();
+    QCommandLineOption bulbsOption("bulbs", "Number of bulbs.", "count", "1");
+    QCommandLineOption addressOption("address", "Address to listen on.", "ip", "127.0.0.1");
+    QCommandLineOption portOption("port", "First bulb's port, the rest follow; 0 for any free ports.",
+                                  "port", "38899");
+    QCommandLineOption delayOption("delay", "Processing time before a bulb answers.", "ms", "0");
+    QCommandLineOption jitterOption("jitter", "Random extra delay, up to this much.", "ms", "0");
+    QCommandLineOption dropOption("drop", "Share of commands ignored at random, 0-1.", "fraction", "0");
+    QCommandLineOption rateOption("rate", "Commands a bulb handles per second, or 0 for no limit.",
+                                  "rate", "0");
+    QCommandLineOption durationOption("duration", "Exit after this long, or 0 to run until killed.",
+                                      "seconds", "0");
+    QCommandLineOption quietOption("quiet", "Don't print stats every second.");
+    parser.addOptions({ bulbsOption, addressOption, portOption, delayOption, jitterOption, dropOption,
+                        rateOption, durationOption, quietOption });
+    parser.process(app);
+
+    EmulatorSettings settings;
+    settings.bulbs = qMax(1, parser.value(bulbsOption).toInt());
+    settings.address = QHostAddress(parser.value(addressOption));
+    settings.port = quint16(qBound(0, parser.value(portOption).toInt(), 65535));
+    settings.delayMs = qMax(0, parser.value(delayOption).toInt());
+    settings.jitterMs = qMax(0, parser.value(jitterOption).toInt());
+    settings.dropRate = qBound(0.0, parser.value(dropOption).toDouble(), 1.0);
+    settings.rateLimit = qMax(0, parser.value(rateOption).toInt());
+
+    BulbEmulator emulator(settings);
+    QString error;
+    if (!emulator.start(&error)) {
+        qCritical("%s", qPrintable(error));
+        return 1;
+    }
+
+    QStringList ports;
+    for (quint16 port : emulator.ports()) {
+        ports.append(QString::number(port));
+    }
+    QTextStream out(stdout);
+    out << "Emulating " << settings.bulbs << " bulb(s) on " << settings.address.toString()
+        << " ports " << ports.join(", ") << "\n";
+    out.flush();
+
+    // A line a second of what arrived and how it was handled
+    EmulatorStats last;
+    QTimer statsTimer;
+    QObject::connect(&statsTimer, &QTimer::timeout, [&emulator, &last, &out]() {
+        const EmulatorStats stats = emulator.stats();
+        out << "received " << stats.received - last.received
+            << "/s, answered " << stats.answered - last.answered
+            << ", dropped " << stats.dropped - last.dropped
+            << ", overloaded " << stats.overloaded - last.overloaded
+            << ", invalid " << stats.invalid - last.invalid << "\n";
+        out.flush();
+        last = stats;
+    });
+    if (!parser.isSet(quietOption)) {
+        statsTimer.start(1000);
+    }
+
+    const int duration = parser.value(durationOption).toInt();
+    if (duration > 0) {
+        QTimer::singleShot(duration * 1000, &app, &QCoreApplication::quit);
+    }
+    return app.exec();
+}
@@ -0,0 +1,215 @@
+// Load test of the send side: pushes frames through SenderThread to emulated
+// bulbs at rising rates and reports what got through at each. Runs on
+// loopback only, so results are comparable between machines without a
+// network. Sender changes should come with before/after numbers from it.
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
+
+#include "BulbEmulator.h"
+#include "FrameScheduler.h"
+#include "LatencyStats.h"
+#include "PipelineSettings.h"
+#include "SenderThread.h"
+
+namespace {
+
+struct StepResult {
+    int rate = 0;               // Frames offered per second
+    double seconds = 0;
+    quint64 frames = 0;         // Frames sent
+    BulbLinkStats links;        // Summed over bulbs
+    quint64 skipped = 0;        // Superseded before they were sent
+    quint64 overloaded = 0;     // Ignored by the emulated bulbs' rate limit
+    qint64 rttP50 = 0;
+    qint64 rttP99 = 0;
+    qint64 rttMax = 0;
+};
+
+// Frame n's colours: every zone different, and every frame different from
+// the one before, so nothing is skipped for being unchanged
+void fillColours(QVector<QColor> &colours, quint64 frame) {
+    for (int i = 0; i < colours.size(); ++i) {
+        colours[i] = QColor::fromHsv(int((frame * 7 + quint64(i) * 40) % 360), 255, 255);
+    }
+}
+
+StepResult runStep(const QVector<BulbTarget> &targets, int rate, int bulbRate, int seconds,
+                   int drainMs, BulbEmulator &emulator) {
+    PipelineSettings settings;
+    for (int i = 0; i < targets.size(); ++i) {
+        settings.zones.append(CaptureZone{ QString::number(i), QRect(i, 0, 1, 1), FilterSettings() });
+    }
+    settings.targets = targets;
+    settings.fps = rate;
+    settings.bulbRateLimit = bulbRate;
+
+    SettingsStore store;
+    store.publish(settings);
+    LatencyStats latency;
+    SenderThread sender(&store);
+    sender.setLatencyStats(&latency);
+    sender.startSending();
+
+    const EmulatorStats before = emulator.stats();
+    QVector<QColor> colours(targets.size());
+    FrameScheduler scheduler;
+    scheduler.setRate(rate);
+
+    const qint64 start = monotonicNs();
+    const qint64 end = start + qint64(seconds) * 1000000000;
+    quint64 frame = 0;
+    while (monotonicNs() < end) {
+        scheduler.waitForNextFrame();
+        fillColours(colours, frame++);
+
+        FrameStamps stamps;
+        stamps.grabStart = monotonicNs();
+        stamps.grabEnd = stamps.grabStart;
+        stamps.reduced = stamps.grabStart;
+        stamps.enqueued = stamps.grabStart;
+        sender.push(colours, stamps);
+    }
+    const qint64 elapsed = monotonicNs() - start;
+
+    // Give replies still in flight time to arrive before counting
+    QThread::msleep(drainMs);
+    sender.stopSending();
+
+    StepResult result;
+    result.rate = rate;
+    result.seconds = elapsed / 1e9;
+    result.frames = sender.sentFrames();
+    result.skipped = sender.skippedFrames() + sender.droppedFrames();
+    for (const BulbLinkStats &link : sender.linkStats()) {
+        result.links.sent += link.sent;
+        result.links.acknowledged += link.acknowledged;
+        result.links.retransmits += link.retransmits;
+    }
+    result.overloaded = emulator.stats().overloaded - before.overloaded;
+
+    const LatencyHistogram &replies = latency.histogram(LatencyStats::Reply);
+    result.rttP50 = replies.percentile(0.5);
+    result.rttP99 = replies.percentile(0.99);
+    result.rttMax = replies.max();
+    return result;
+}
+
+QString milliseconds(qint64 ns) {
+    return QString::number(ns / 1e6, 'f', 2);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("WizLoadTest");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Pushes frames through the sender to emulated bulbs at rising rates and reports "
+        "packets/s, reply latency and loss at each.");
+    parser.addHelpOption();
+    QCommandLineOption bulbsOption("bulbs", "Number of emulated bulbs.", "count", "4");
+    QCommandLineOption startOption("start", "First rate, in frames per second.", "fps", "50");
+    QCommandLineOption maxOption("max", "Last rate; each step doubles the one before.", "fps", "6400");
+    QCommandLineOption stepOption("step", "Length of each step.", "seconds", "2");
+    QCommandLineOption delayOption("delay", "Bulb processing time before answering.", "ms", "2");
+    QCommandLineOption jitterOption("jitter", "Random extra bulb delay, up to this much.", "ms", "0");
+    QCommandLineOption dropOption("drop", "Share of commands bulbs ignore at random, 0-1.", "fraction", "0");
+    QCommandLineOption capOption("bulb-cap", "Commands a bulb handles per second, or 0 for no limit.",
+                                 "rate", "0");
+    QCommandLineOption bulbRateOption("bulb-rate",
+        "Sender's own limit on updates per second per bulb, or 0 for none.", "rate", "0");
+    QCommandLineOption csvOption("csv", "Print CSV for comparing runs.");
+    parser.addOptions({ bulbsOption, startOption, maxOption, stepOption, delayOption, jitterOption,
+                        dropOption, capOption, bulbRateOption, csvOption });
+    parser.process(app);
+
+    EmulatorSettings emulatorSettings;
+    emulatorSettings.bulbs = qMax(1, parser.value(bulbsOption).toInt());
+    emulatorSettings.delayMs = qMax(0, parser.value(delayOption).toInt());
+    emulatorSettings.jitterMs = qMax(0, parser.value(jitterOption).toInt());
+    emulatorSettings.dropRate = qBound(0.0, parser.value(dropOption).toDouble(), 1.0);
+    emulatorSettings.rateLimit = qMax(0, parser.value(capOption).toInt());
+
+    // The bulbs answer from their own thread, as real ones would in parallel
+    BulbEmulator *emulator = new BulbEmulator(emulatorSettings);
+    QString error;
+    if (!emulator->start(&error)) {
+        qCritical("%s", qPrintable(error));
+        delete emulator;
+        return 1;
+    }
+    const QVector<quint16> ports = emulator->ports();
+
+    QThread emulatorThread;
+    emulator->moveToThread(&emulatorThread);
+    QObject::connect(&emulatorThread, &QThread::finished, emulator, &QObject::deleteLater);
+    emulatorThread.start(QThread::HighPriority);
+
+    QVector<BulbTarget> targets;
+    for (int i = 0; i < ports.size(); ++i) {
+        BulbTarget target;
+        target.ip = "127.0.0.1";
+        target.port = ports[i];
+        target.zone = i;
+        targets.append(target);
+    }
+
+    const int seconds = qMax(1, parser.value(stepOption).toInt());
+    const int bulbRate = qMax(0, parser.value(bulbRateOption).toInt());
+    const int drainMs = 100 + emulatorSettings.delayMs + emulatorSettings.jitterMs;
+    const bool csv = parser.isSet(csvOption);
+
+    QTextStream out(stdout);
+    if (csv) {
+        out << "offered_fps,sent_fps,packets_per_s,acked_per_s,loss_percent,retransmits,"
+               "skipped,overloaded,rtt_p50_ms,rtt_p99_ms,rtt_max_ms\n";
+    } else {
+        out << emulatorSettings.bulbs << " bulbs, " << emulatorSettings.delayMs << " ms delay";
+        if (emulatorSettings.jitterMs > 0) {
+            out << " + up to " << emulatorSettings.jitterMs << " ms";
+        }
+        if (emulatorSettings.dropRate > 0) {
+            out << ", " << QString::number(emulatorSettings.dropRate * 100, 'f', 1) << "% dropped";
+        }
+        if (emulatorSettings.rateLimit > 0) {
+            out << ", " << emulatorSettings.rateLimit << " commands/s per bulb";
+        }
+        out << "\n";
+        out << QString("%1 %2 %3 %4 %5 %6  %7\n").arg("offered", 8).arg("sent", 8).arg("pkt/s", 9)
+               .arg("acked/s", 9).arg("loss", 7).arg("skipped", 8).arg("reply p50 / p99 / max ms");
+    }
+    out.flush();
+
+    for (int rate = qMax(1, parser.value(startOption).toInt()); rate <= parser.value(maxOption).toInt();
+         rate *= 2) {
+        const StepResult step = runStep(targets, rate, bulbRate, seconds, drainMs, *emulator);
+        const BulbLinkStats &links = step.links;
+        const double loss = links.sent > 0 ? 100.0 * (links.sent - links.acknowledged) / links.sent : 0;
+
+        if (csv) {
+            out << step.rate << "," << step.frames / step.seconds << "," << links.sent / step.seconds << ","
+                << links.acknowledged / step.seconds << "," << loss << "," << links.retransmits << ","
+                << step.skipped << "," << step.overloaded << "," << milliseconds(step.rttP50) << ","
+                << milliseconds(step.rttP99) << "," << milliseconds(step.rttMax) << "\n";
+        } else {
+            out << QString("%1 %2 %3 %4 %5% %6  %7 / %8 / %9\n")
+                   .arg(step.rate, 8)
+                   .arg(step.frames / step.seconds, 8, 'f', 0)
+                   .arg(links.sent / step.seconds, 9, 'f', 0)
+                   .arg(links.acknowledged / step.seconds, 9, 'f', 0)
+                   .arg(loss, 6, 'f', 1)
+                   .arg(step.skipped, 8)
+                   .arg(milliseconds(step.rttP50), milliseconds(step.rttP99), milliseconds(step.rttMax));
+        }
+        out.flush();
+    }
+
+    emulatorThread.quit();
+    emulatorThread.wait();
+    return 0;
+}
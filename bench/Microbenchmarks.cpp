@@ -0,0 +1,471 @@
+// Microbenchmarks of the per-frame hot paths. Each case is calibrated to run
+// for a fixed time per sample and reports the median of several samples, so
+// numbers are comparable between runs on the same machine. Everything runs
+// offline; the UDP case only talks to a socket on the loopback interface.
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QTextStream>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+#include <QtNetwork/QUdpSocket>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "ColourCorrection.h"
+#include "ColourDifference.h"
+#include "ColourRecording.h"
+#include "EdgeLayout.h"
+#include "LatencyStats.h"
+#include "PilotEncoder.h"
+#include "PipelineSettings.h"
+#include "RegionAverage.h"
+#include "SampleData.h"
+#include "ScreenCaptureThread.h"
+#include "UdpSender.h"
+
+namespace {
+
+// Results are folded into this so the compiler can't drop the work
+volatile quint64 g_sink;
+
+struct Options {
+    QString filter;
+    int samples = 9;
+    qint64 sampleNs = 50000000;
+    bool csv = false;
+};
+
+class Runner {
+public:
+    explicit Runner(const Options &options) : m_options(options), m_out(stdout) {
+        if (m_options.csv) {
+            m_out << "name,ns_per_op,spread_percent,items_per_op\n";
+        } else {
+            m_out << QString("%1 %2 %3  %4\n").arg("benchmark", -36).arg("ns/op", 12)
+                     .arg("spread", 8).arg("throughput");
+        }
+        m_out.flush();
+    }
+
+    // Times body(iterations), which must do iterations operations of
+    // itemsPerOp items each (pixels, colours, datagrams...)
+    void run(const QString &name, double itemsPerOp, const QString &itemName,
+             const std::function<void(int)> &body) {
+        if (!m_options.filter.isEmpty() && !name.contains(m_options.filter)) {
+            return;
+        }
+
+        // Grow the batch until it fills a sample, which also warms caches
+        // and lets the CPU clock settle
+        int iterations = 1;
+        for (;;) {
+            const qint64 start = monotonicNs();
+            body(iterations);
+            const qint64 elapsed = monotonicNs() - start;
+            if (elapsed >= m_options.sampleNs / 4 || iterations >= (1 << 30)) {
+                const double scale = double(m_options.sampleNs) / qMax<qint64>(1, elapsed);
+                iterations = int(qBound(1.0, iterations * scale, double(1 << 30)));
+                break;
+            }
+            iterations *= 2;
+        }
+
+        std::vector<double> perOp;
+        for (int sample = 0; sample < m_options.samples; ++sample) {
+            const qint64 start = monotonicNs();
+            body(iterations);
+            perOp.push_back(double(monotonicNs() - start) / iterations);
+        }
+        std::sort(perOp.begin(), perOp.end());
+
+        // Spread between the fastest and slowest sample, relative to the
+        // median; a large one means the numbers are not worth comparing
+        const double median = perOp[perOp.size() / 2];
+        const double spread = median > 0 ? (perOp.back() - perOp.front()) * 100 / median : 0;
+
+        if (m_options.csv) {
+            m_out << name << "," << QString::number(median, 'f', 2) << ","
+                  << QString::number(spread, 'f', 1) << "," << itemsPerOp << "\n";
+        } else {
+            const double perSecond = itemsPerOp * 1e9 / median;
+            m_out << QString("%1 %2 %3%  %4 %5/s\n").arg(name, -36)
+                     .arg(median, 12, 'f', 2).arg(spread, 7, 'f', 1)
+                     .arg(humanRate(perSecond)).arg(itemName);
+        }
+        m_out.flush();
+    }
+
+private:
+    static QString humanRate(double perSecond) {
+        if (perSecond >= 1e9) {
+            return QString::number(perSecond / 1e9, 'f', 2) + " G";
+        }
+        if (perSecond >= 1e6) {
+            return QString::number(perSecond / 1e6, 'f', 2) + " M";
+        }
+        if (perSecond >= 1e3) {
+            return QString::number(perSecond / 1e3, 'f', 2) + " k";
+        }
+        return QString::number(perSecond, 'f', 2) + " ";
+    }
+
+    Options m_options;
+    QTextStream m_out;
+};
+
+void benchmarkAverages(Runner &runner, const QImage &image) {
+    const int sizes[] = { 8, 50, 200, 1000 };
+    for (AverageKernel kernel : { AverageKernel::Scalar, AverageKernel::Sse2, AverageKernel::Avx2 }) {
+        if (!averageKernelSupported(kernel)) {
+            continue;
+        }
+        for (int size : sizes) {
+            const QRect rect(image.width() / 2 - size / 2, image.height() / 2 - size / 2, size, size);
+            runner.run(QString("average/%1/%2x%2").arg(averageKernelName(kernel)).arg(size),
+                       double(size) * size, "px", [&image, rect, kernel](int iterations) {
+                quint64 total = 0;
+                for (int i = 0; i < iterations; ++i) {
+                    total += sumImage(image, rect, kernel).red;
+                }
+                g_sink = total;
+            });
+        }
+    }
+}
+
+// Budgets the sampling reducer is timed at
+const int kSampleBudgets[] = { 1024, 4096, 16384 };
+
+void benchmarkSampling(Runner &runner, const QImage &image) {
+    const int size = 1000;
+    const QRect rect(image.width() / 2 - size / 2, image.height() / 2 - size / 2, size, size);
+    for (int budget : kSampleBudgets) {
+        runner.run(QString("sample/%1/%2x%2").arg(budget).arg(size), budget, "px",
+                   [&image, rect, budget](int iterations) {
+            quint64 total = 0;
+            for (int i = 0; i < iterations; ++i) {
+                total += sampleImage(image, rect, budget).red;
+            }
+            g_sink = total;
+        });
+    }
+}
+
+// The whole reduce step as the capture thread runs it, so the histogram
+// reducers can be compared with the mean
+void benchmarkReducers(Runner &runner, const QImage &image) {
+    struct Case {
+        int size;
+        int budget;
+    };
+    const Case cases[] = { { 50, 0 }, { 200, 0 }, { 1000, 0 }, { 1000, 4096 } };
+
+    for (ColourReducer reducer : { ColourReducer::Mean, ColourReducer::Dominant, ColourReducer::Vivid }) {
+        for (const Case &test : cases) {
+            const QRect rect(image.width() / 2 - test.size / 2, image.height() / 2 - test.size / 2,
+                             test.size, test.size);
+            const QString name = QString("reduce/%1/%2x%2").arg(colourReducerName(reducer)).arg(test.size) +
+                                 (test.budget > 0 ? QString("/sample-%1").arg(test.budget) : QString());
+            const double pixels = test.budget > 0 ? test.budget : double(test.size) * test.size;
+
+            runner.run(name, pixels, "px", [&image, rect, reducer, test](int iterations) {
+                ColourHistogram histogram;
+                quint64 total = 0;
+                for (int i = 0; i < iterations; ++i) {
+                    total += quint64(reduceColour(image, rect, reducer, test.budget, histogram).rgb());
+                }
+                g_sink = total;
+            });
+        }
+    }
+}
+
+// Cell sizes the summed-area table is timed at
+const int kTableScales[] = { 1, 8, 16 };
+
+// Every segment of a 16x9 edge layout over the whole image, reduced zone by
+// zone and through the summed-area table at several cell sizes
+void benchmarkEdges(Runner &runner, const QImage &image) {
+    EdgeLayout layout;
+    layout.top = layout.bottom = 16;
+    layout.left = layout.right = 9;
+    const QVector<CaptureZone> zones = edgeZones(layout, image.rect(), FilterSettings());
+    const double pixels = double(image.width()) * image.height();
+
+    runner.run("edges/16x9/per-zone", pixels, "px", [&image, &zones](int iterations) {
+        quint64 total = 0;
+        for (int i = 0; i < iterations; ++i) {
+            for (const CaptureZone &zone : zones) {
+                total += quint64(averageColour(image, zone.rect).rgb());
+            }
+        }
+        g_sink = total;
+    });
+
+    for (int scale : kTableScales) {
+        runner.run(QString("edges/16x9/summed-area-%1").arg(scale), pixels, "px",
+                   [&image, &zones, scale](int iterations) {
+            SummedAreaTable table;
+            quint64 total = 0;
+            for (int i = 0; i < iterations; ++i) {
+                table.build(image, scale);
+                for (const CaptureZone &zone : zones) {
+                    total += quint64(table.meanColour(zone.rect).rgb());
+                }
+            }
+            g_sink = total;
+        });
+    }
+}
+
+void benchmarkCorrection(Runner &runner, std::mt19937 &random) {
+    // A power of two so indexing wraps cheaply
+    const QVector<QColor> colours = randomColours(1024, random);
+    const ColourCorrection correction;
+
+    runner.run("correct/reference", 1, "colours", [&colours, &correction](int iterations) {
+        quint64 total = 0;
+        for (int i = 0; i < iterations; ++i) {
+            total += quint64(correctColour(colours[i & 1023], correction).rgb());
+        }
+        g_sink = total;
+    });
+
+    ColourCorrector corrector;
+    corrector.setCorrection(correction);
+    runner.run("correct/table", 1, "colours", [&colours, &corrector](int iterations) {
+        quint64 total = 0;
+        for (int i = 0; i < iterations; ++i) {
+            total += quint64(corrector.correct(colours[i & 1023]).rgb());
+        }
+        g_sink = total;
+    });
+
+    std::vector<quint8> red, green, blue;
+    for (const QColor &colour : colours) {
+        red.push_back(quint8(colour.red()));
+        green.push_back(quint8(colour.green()));
+        blue.push_back(quint8(colour.blue()));
+    }
+    std::vector<quint8> outRed(red.size()), outGreen(red.size()), outBlue(red.size());
+    runner.run("correct/table-1024", colours.size(), "colours", [&](int iterations) {
+        quint64 total = 0;
+        for (int i = 0; i < iterations; ++i) {
+            corrector.correct(red.data(), green.data(), blue.data(),
+                              outRed.data(), outGreen.data(), outBlue.data(), int(red.size()));
+            total += outRed[size_t(i) & 1023];
+        }
+        g_sink = total;
+    });
+}
+
+void benchmarkFormatting(Runner &runner, std::mt19937 &random) {
+    const QVector<QColor> colours = randomColours(1024, random);
+    runner.run("format/setPilot", 1, "payloads", [&colours](int iterations) {
+        char payload[128];
+        quint64 total = 0;
+        for (int i = 0; i < iterations; ++i) {
+            total += quint64(UdpSender::formatPilot(payload, int(sizeof(payload)), quint32(i),
+                                                    colours[i & 1023], 1 + (i & 63)));
+        }
+        g_sink = total;
+    });
+
+    runner.run("encode/setPilot", 1, "payloads", [&colours](int iterations) {
+        PilotEncoder encoders[64];
+        for (int i = 0; i < 64; ++i) {
+            encoders[i].setBrightness(1 + i);
+        }
+        char payload[PilotEncoder::kMaxLength];
+        quint64 total = 0;
+        for (int i = 0; i < iterations; ++i) {
+            const QColor &colour = colours[i & 1023];
+            total += quint64(encoders[i & 63].colour(payload, quint32(i), colour.red(), colour.green(),
+                                                     colour.blue()));
+        }
+        g_sink = total;
+    });
+
+    runner.run("encode/temp", 1, "payloads", [](int iterations) {
+        const PilotEncoder encoder(60);
+        char payload[PilotEncoder::kMaxLength];
+        quint64 total = 0;
+        for (int i = 0; i < iterations; ++i) {
+            total += quint64(encoder.temperature(payload, quint32(i), 2200 + (i & 4095)));
+        }
+        g_sink = total;
+    });
+
+    const char reply[] = "{\"method\":\"setPilot\",\"id\":123456,\"env\":\"pro\",\"result\":{\"success\":true}}";
+    runner.run("format/parseReply", 1, "replies", [&reply](int iterations) {
+        quint64 total = 0;
+        for (int i = 0; i < iterations; ++i) {
+            quint32 id = 0;
+            bool error = false;
+            UdpSender::parseReply(reply, int(sizeof(reply)) - 1, &id, &error);
+            total += id;
+        }
+        g_sink = total;
+    });
+}
+
+void benchmarkThreshold(Runner &runner, std::mt19937 &random) {
+    for (int zones : { 1, 16 }) {
+        // Every zone moves by less than the threshold, so the whole frame is
+        // compared: the common case while the screen holds still
+        const QVector<QColor> last = randomColours(zones, random);
+        QVector<LabColour> lastLab;
+        toLab(last, lastLab);
+        QVector<QColor> current = last;
+        for (QColor &colour : current) {
+            colour.setRed(colour.red() ^ 1);
+        }
+
+        runner.run(QString("threshold/%1-zones").arg(zones), zones, "zones",
+                   [&last, &current](int iterations) {
+            quint64 total = 0;
+            for (int i = 0; i < iterations; ++i) {
+                total += ScreenCaptureThread::coloursChanged(last, current, 3 + (i & 1)) ? 1 : 0;
+            }
+            g_sink = total;
+        });
+
+        for (ChangeMetric metric : { ChangeMetric::Cie76, ChangeMetric::Ciede2000 }) {
+            runner.run(QString("threshold/%1/%2-zones").arg(changeMetricName(metric)).arg(zones), zones, "zones",
+                       [&lastLab, &current, metric](int iterations) {
+                quint64 total = 0;
+                for (int i = 0; i < iterations; ++i) {
+                    total += coloursDiffer(lastLab, current, metric, 2.3f + (i & 1)) ? 1 : 0;
+                }
+                g_sink = total;
+            });
+        }
+    }
+}
+
+void benchmarkRecording(Runner &runner, std::mt19937 &random) {
+    QTemporaryFile file;
+    if (!file.open()) {
+        QTextStream(stderr) << "Skipping record/replay: " << file.errorString() << "\n";
+        return;
+    }
+    file.close();
+
+    const QVector<RecordedFrame> stream = colourStream(4096, 16, random);
+
+    // Each batch starts a new file, so the recording doesn't grow without end
+    runner.run("record/16-zones", 1, "frames", [&file, &stream](int iterations) {
+        ColourRecorder recorder;
+        recorder.open(file.fileName(), nullptr);
+        qint64 timestamp = 0;
+        for (int i = 0; i < iterations; ++i) {
+            const RecordedFrame &frame = stream[i % stream.size()];
+            timestamp += 16000000;
+            recorder.append(frame.colours, timestamp);
+        }
+        g_sink = g_sink + recorder.bytes();
+    });
+
+    ColourRecorder recorder;
+    recorder.open(file.fileName(), nullptr);
+    for (const RecordedFrame &frame : stream) {
+        recorder.append(frame.colours, frame.timestampNs);
+    }
+    recorder.close();
+
+    ColourRecording recording;
+    if (!recording.open(file.fileName(), nullptr)) {
+        return;
+    }
+    runner.run("replay/16-zones", 1, "frames", [&recording](int iterations) {
+        QVector<QColor> colours;
+        qint64 offset = 0;
+        for (int i = 0; i < iterations; ++i) {
+            if (!recording.next(colours, &offset)) {
+                recording.rewind();
+                recording.next(colours, &offset);
+            }
+        }
+        g_sink = g_sink + quint64(offset) + colours[0].red();
+    });
+}
+
+void benchmarkLoopback(Runner &runner, std::mt19937 &random) {
+    // The receiver is bound but never read: once its buffer fills the kernel
+    // drops the datagrams on arrival, which keeps the cost per send steady
+    // and avoids the ICMP replies an unbound port would trigger
+    QUdpSocket receiver;
+    if (!receiver.bind(QHostAddress::LocalHost, 0)) {
+        QTextStream(stderr) << "Skipping udp/loopback: " << receiver.errorString() << "\n";
+        return;
+    }
+
+    for (int bulbs : { 1, 16 }) {
+        QVector<BulbTarget> targets;
+        for (int i = 0; i < bulbs; ++i) {
+            BulbTarget target;
+            target.ip = "127.0.0.1";
+            target.port = receiver.localPort();
+            target.zone = i;
+            targets.append(target);
+        }
+
+        UdpSender sender;
+        sender.setTargets(targets);
+        const QVector<QColor> colours = randomColours(bulbs, random);
+
+        runner.run(QString("udp/loopback/%1-bulbs").arg(bulbs), bulbs, "datagrams",
+                   [&sender, &colours](int iterations) {
+            for (int i = 0; i < iterations; ++i) {
+                sender.sendColours(colours);
+            }
+        });
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("WizLedBenchmarks");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Microbenchmarks of the capture and send hot paths");
+    parser.addHelpOption();
+    QCommandLineOption filterOption("filter", "Only run benchmarks whose name contains text.", "text");
+    QCommandLineOption samplesOption("samples", "Timed samples per benchmark (default 9).", "count", "9");
+    QCommandLineOption sampleTimeOption("sample-ms", "Length of each sample (default 50).", "ms", "50");
+    QCommandLineOption csvOption("csv", "Print CSV for comparing runs.");
+    parser.addOption(filterOption);
+    parser.addOption(samplesOption);
+    parser.addOption(sampleTimeOption);
+    parser.addOption(csvOption);
+    parser.process(app);
+
+    Options options;
+    options.filter = parser.value(filterOption);
+    options.samples = qMax(1, parser.value(samplesOption).toInt());
+    options.sampleNs = qMax(1, parser.value(sampleTimeOption).toInt()) * qint64(1000000);
+    options.csv = parser.isSet(csvOption);
+
+    // Fixed seed, so every run works on the same data
+    std::mt19937 random(1);
+    const QImage image = noiseImage(QSize(1920, 1080), random);
+
+    Runner runner(options);
+    benchmarkAverages(runner, image);
+    benchmarkSampling(runner, image);
+    benchmarkReducers(runner, image);
+    benchmarkEdges(runner, image);
+    benchmarkCorrection(runner, random);
+    benchmarkFormatting(runner, random);
+    benchmarkThreshold(runner, random);
+    benchmarkRecording(runner, random);
+    benchmarkLoopback(runner, random);
+    return 0;
+}
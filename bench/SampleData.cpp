@@ -0,0 +1,48 @@
+#include "SampleData.h"
+
+QImage noiseImage(const QSize &size, std::mt19937 &random) {
+    QImage image(size, QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            line[x] = random() | 0xff000000;
+        }
+    }
+    return image;
+}
+
+QImage gradientImage(const QSize &size) {
+    QImage image(size, QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            line[x] = qRgb(x * 255 / image.width(), y * 255 / image.height(), (x + y) & 255);
+        }
+    }
+    return image;
+}
+
+QVector<QColor> randomColours(int count, std::mt19937 &random) {
+    QVector<QColor> colours;
+    for (int i = 0; i < count; ++i) {
+        const quint32 value = random();
+        colours.append(QColor(qRed(value), qGreen(value), qBlue(value)));
+    }
+    return colours;
+}
+
+QVector<RecordedFrame> colourStream(int frames, int zones, std::mt19937 &random) {
+    QVector<RecordedFrame> stream;
+    QVector<QColor> colours = randomColours(zones, random);
+    qint64 timestamp = 1000000000;
+    for (int i = 0; i < frames; ++i) {
+        for (int changed = int(random() % 4); changed > 0; --changed) {
+            QColor &colour = colours[int(random() % zones)];
+            colour.setRgb((colour.red() + int(random() % 9) + 252) & 255,
+                          (colour.green() + int(random() % 9) + 252) & 255, colour.blue() ^ int(random() % 2));
+        }
+        timestamp += 16000000 + qint64(random() % 1000000);
+        stream.append(RecordedFrame{ colours, timestamp });
+    }
+    return stream;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// Inputs shared by the microbenchmarks and the tests, generated from a
+// seeded random so every run works on the same data
+
+#include <QtCore/QSize>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+#include <random>
+
+// Every pixel an independent random colour, the worst case for sampling
+QImage noiseImage(const QSize &size, std::mt19937 &random);
+
+// Red ramps across and green down, with blue repeating every 256 pixels
+QImage gradientImage(const QSize &size);
+
+QVector<QColor> randomColours(int count, std::mt19937 &random);
+
+struct RecordedFrame {
+    QVector<QColor> colours;
+    qint64 timestampNs;
+};
+
+// Capture-like colour stream: a few zones drift each frame and the rest
+// hold still, about 60 frames a second
+QVector<RecordedFrame> colourStream(int frames, int zones, std::mt19937 &random);
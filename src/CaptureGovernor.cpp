@@ -0,0 +1,72 @@
+#include "CaptureGovernor.h"
+
+CaptureGovernor::CaptureGovernor()
+    : m_fps(0), m_idleFps(0), m_stillSinceNs(0), m_lastStepNs(0), m_lastFrameNs(0) {
+    m_rate = 0;
+    m_rampDowns = 0;
+    m_wakeUps = 0;
+    m_idleUs = 0;
+}
+
+void CaptureGovernor::setRates(int fps, int idleFps) {
+    fps = qMax(0, fps);
+    idleFps = qMax(0, idleFps);
+    if (fps == 0 || idleFps >= fps) {
+        idleFps = 0;
+    }
+    if (fps == m_fps && idleFps == m_idleFps) {
+        return;
+    }
+
+    m_fps = fps;
+    m_idleFps = idleFps;
+    m_stillSinceNs = 0;
+    m_lastStepNs = 0;
+    m_lastFrameNs = 0;
+    m_rate.store(fps, std::memory_order_relaxed);
+}
+
+int CaptureGovernor::frame(qint64 now, bool changed) {
+    if (m_idleFps == 0) {
+        return m_fps;
+    }
+
+    // Only this thread writes, so plain load/store pairs are enough
+    int rate = m_rate.load(std::memory_order_relaxed);
+    if (m_lastFrameNs != 0 && rate < m_fps) {
+        m_idleUs.store(m_idleUs.load(std::memory_order_relaxed) + quint64(now - m_lastFrameNs) / 1000,
+                       std::memory_order_relaxed);
+    }
+    m_lastFrameNs = now;
+
+    if (changed) {
+        if (rate != m_fps) {
+            rate = m_fps;
+            m_wakeUps.store(m_wakeUps.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        m_stillSinceNs = 0;
+    } else if (m_stillSinceNs == 0) {
+        m_stillSinceNs = now;
+        m_lastStepNs = now;
+    } else if (rate > m_idleFps) {
+        const bool due = rate == m_fps ? now - m_stillSinceNs >= qint64(kHoldMs) * 1000000
+                                       : now - m_lastStepNs >= qint64(kStepMs) * 1000000;
+        if (due) {
+            rate = qMax(m_idleFps, rate / 2);
+            m_lastStepNs = now;
+            m_rampDowns.store(m_rampDowns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    m_rate.store(rate, std::memory_order_relaxed);
+    return rate;
+}
+
+GovernorStats CaptureGovernor::stats() const {
+    GovernorStats stats;
+    stats.fps = m_rate.load(std::memory_order_relaxed);
+    stats.rampDowns = m_rampDowns.load(std::memory_order_relaxed);
+    stats.wakeUps = m_wakeUps.load(std::memory_order_relaxed);
+    stats.idleUs = m_idleUs.load(std::memory_order_relaxed);
+    return stats;
+}
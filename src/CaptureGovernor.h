@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QtGlobal>
+#include <atomic>
+
+// Running totals from a CaptureGovernor, like FrameTiming
+struct GovernorStats {
+    int fps = 0;                // Rate capture runs at now
+    quint64 rampDowns = 0;      // Steps down toward the idle rate
+    quint64 wakeUps = 0;        // Jumps back to the full rate on a change
+    quint64 idleUs = 0;         // Time spent below the full rate
+};
+
+// Lowers the capture rate while nothing changes and restores it the moment
+// something does. Once frames have held still for kHoldMs, the rate halves
+// every kStepMs until it reaches the idle rate; the first frame that changes
+// puts it straight back to the full rate, and the hold starts over. The
+// rate only falls after a whole hold, so content that changes every second
+// or so keeps the full rate instead of flapping between the two.
+//
+// Only the capture thread may call setRates() and frame(); stats() can be
+// read from any thread.
+class CaptureGovernor {
+public:
+    static const int kHoldMs = 1000;
+    static const int kStepMs = 500;
+
+    CaptureGovernor();
+
+    // Full and idle rates. An idle rate of 0 or at least the full rate, or a
+    // full rate of 0 (unthrottled), turns the governor off. Starts again at
+    // the full rate if either changed.
+    void setRates(int fps, int idleFps);
+
+    // Records a frame captured at now, in monotonicNs() time, and whether it
+    // differs from the frame before by more than the change threshold.
+    // Returns the rate to capture the next at.
+    int frame(qint64 now, bool changed);
+
+    int rate() const { return m_rate.load(std::memory_order_relaxed); }
+
+    GovernorStats stats() const;
+
+private:
+    int m_fps;
+    int m_idleFps;
+    qint64 m_stillSinceNs;      // First unchanged frame, 0 after a change
+    qint64 m_lastStepNs;
+    qint64 m_lastFrameNs;
+
+    std::atomic<int> m_rate;
+    std::atomic<quint64> m_rampDowns;
+    std::atomic<quint64> m_wakeUps;
+    std::atomic<quint64> m_idleUs;
+};
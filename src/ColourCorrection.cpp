@@ -0,0 +1,124 @@
+#include "ColourCorrection.h"
+
+#include <cmath>
+
+namespace {
+
+// Full scale of the fixed-point channel levels: 8-bit values with 4 bits of
+// fraction, enough that rounding errors stay below one 8-bit step
+const int kFullScale = 255 << 4;
+
+// Dark and bright colours pass through uncorrected
+inline bool isPassThrough(int r, int g, int b) {
+    return (r < 5 && g < 5 && b < 5) || (r > 250 && g > 250 && b > 250);
+}
+
+} // namespace
+
+QColor correctColour(const QColor &original, const ColourCorrection &correction) {
+    if (!original.isValid()) {
+        return QColor(0, 0, 0);
+    }
+
+    if (isPassThrough(original.red(), original.green(), original.blue())) {
+        return original;
+    }
+
+    float gamma = correction.gamma;
+    float r = pow(original.redF(), 1.0f / gamma) * correction.redFactor;
+    float g = pow(original.greenF(), 1.0f / gamma) * correction.greenFactor;
+    float b = pow(original.blueF(), 1.0f / gamma) * correction.blueFactor;
+
+    r = qBound<float>(0.0f, r, 1.0f);
+    g = qBound<float>(0.0f, g, 1.0f);
+    b = qBound<float>(0.0f, b, 1.0f);
+
+    QColor hsl = QColor::fromRgbF(r, g, b).toHsl();
+
+    float s = qBound<float>(0.0f, hsl.hslSaturationF() * correction.saturation, 1.0f);
+    hsl.setHslF(hsl.hslHueF(), s, hsl.lightnessF());
+
+    return hsl.toRgb();
+}
+
+ColourCorrector::ColourCorrector() {
+    rebuildTables();
+}
+
+bool ColourCorrector::setCorrection(const ColourCorrection &correction) {
+    if (correction == m_correction) {
+        return false;
+    }
+
+    m_correction = correction;
+    rebuildTables();
+    return true;
+}
+
+void ColourCorrector::rebuildTables() {
+    const double exponent = 1.0 / m_correction.gamma;
+    for (int i = 0; i < 256; ++i) {
+        const double level = std::pow(i / 255.0, exponent);
+        m_red[i] = quint16(qRound(qBound(0.0, level * m_correction.redFactor, 1.0) * kFullScale));
+        m_green[i] = quint16(qRound(qBound(0.0, level * m_correction.greenFactor, 1.0) * kFullScale));
+        m_blue[i] = quint16(qRound(qBound(0.0, level * m_correction.blueFactor, 1.0) * kFullScale));
+    }
+
+    m_saturation = qRound(m_correction.saturation * 256.0);
+}
+
+inline void ColourCorrector::correctPixel(int r, int g, int b,
+                                          quint8 &outR, quint8 &outG, quint8 &outB) const {
+    if (isPassThrough(r, g, b)) {
+        outR = quint8(r);
+        outG = quint8(g);
+        outB = quint8(b);
+        return;
+    }
+
+    r = m_red[r];
+    g = m_green[g];
+    b = m_blue[b];
+
+    // Scaling HSL saturation at constant hue and lightness moves every channel
+    // away from the lightness L by the same ratio as the chroma, and the chroma
+    // is capped by what that lightness allows. In terms of 2L = max + min:
+    //   c' = L + (c - L) * chroma' / chroma
+    const int maxLevel = qMax(r, qMax(g, b));
+    const int minLevel = qMin(r, qMin(g, b));
+    const int chroma = maxLevel - minLevel;
+    const int twiceLightness = maxLevel + minLevel;
+
+    if (chroma > 0) {
+        const int chromaLimit = kFullScale - qAbs(twiceLightness - kFullScale);
+        const int targetChroma = qMin((chroma * m_saturation) >> 8, chromaLimit);
+
+        // ratio is at most saturation * 2^16 / 256 (< 2^18) and the channel
+        // offsets are below 2^13, so the products fit comfortably in an int
+        const int ratio = (targetChroma << 16) / chroma;
+        r = (twiceLightness + (((2 * r - twiceLightness) * ratio) >> 16)) >> 1;
+        g = (twiceLightness + (((2 * g - twiceLightness) * ratio) >> 16)) >> 1;
+        b = (twiceLightness + (((2 * b - twiceLightness) * ratio) >> 16)) >> 1;
+    }
+
+    outR = quint8((qBound(0, r, kFullScale) + 8) >> 4);
+    outG = quint8((qBound(0, g, kFullScale) + 8) >> 4);
+    outB = quint8((qBound(0, b, kFullScale) + 8) >> 4);
+}
+
+QColor ColourCorrector::correct(const QColor &colour) const {
+    if (!colour.isValid()) {
+        return QColor(0, 0, 0);
+    }
+
+    quint8 r, g, b;
+    correctPixel(colour.red(), colour.green(), colour.blue(), r, g, b);
+    return QColor(r, g, b);
+}
+
+void ColourCorrector::correct(const quint8 *red, const quint8 *green, const quint8 *blue,
+                              quint8 *outRed, quint8 *outGreen, quint8 *outBlue, int count) const {
+    for (int i = 0; i < count; ++i) {
+        correctPixel(red[i], green[i], blue[i], outRed[i], outGreen[i], outBlue[i]);
+    }
+}
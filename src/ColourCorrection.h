@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QtGui/QColor>
+
+// Parameters of the "Colour Correction" settings group
+struct ColourCorrection {
+    float gamma = 0.6f;
+    float saturation = 1.8f;
+    float redFactor = 1.2f;
+    float greenFactor = 1.0f;
+    float blueFactor = 1.2f;
+
+    bool operator==(const ColourCorrection &other) const {
+        return gamma == other.gamma && saturation == other.saturation &&
+               redFactor == other.redFactor && greenFactor == other.greenFactor &&
+               blueFactor == other.blueFactor;
+    }
+    bool operator!=(const ColourCorrection &other) const { return !(*this == other); }
+};
+
+// Applies colour corrections including gamma, saturation and RGB balance.
+// Floating point reference implementation of ColourCorrector.
+QColor correctColour(const QColor &original, const ColourCorrection &correction);
+
+// Table-driven equivalent of correctColour. Gamma and white balance are baked
+// into one 256-entry table per channel and saturation is scaled in
+// fixed-point RGB, so correcting a colour costs a few table loads and integer
+// ops. Results match correctColour to within one step per channel.
+class ColourCorrector {
+public:
+    ColourCorrector();
+
+    // Rebuilds the tables if the parameters differ from the current ones;
+    // returns whether they did
+    bool setCorrection(const ColourCorrection &correction);
+    const ColourCorrection &correction() const { return m_correction; }
+
+    QColor correct(const QColor &colour) const;
+
+    // Corrects count colours stored as separate channel arrays. The output
+    // arrays may alias the inputs.
+    void correct(const quint8 *red, const quint8 *green, const quint8 *blue,
+                 quint8 *outRed, quint8 *outGreen, quint8 *outBlue, int count) const;
+
+private:
+    void rebuildTables();
+    void correctPixel(int r, int g, int b, quint8 &outR, quint8 &outG, quint8 &outB) const;
+
+    ColourCorrection m_correction;
+    // Channel levels after gamma and white balance, scaled so 4080 (255 << 4) is full
+    quint16 m_red[256];
+    quint16 m_green[256];
+    quint16 m_blue[256];
+    // Saturation factor in 8.8 fixed point
+    int m_saturation;
+};
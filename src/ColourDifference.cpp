@@ -0,0 +1,224 @@
+#include "ColourDifference.h"
+
+#include <cmath>
+
+namespace {
+
+const float kPi = 3.14159265f;
+
+// Intervals of the cube-root table, spaced evenly in sqrt(t) over [0, 1]
+const int kCurveSteps = 1024;
+
+// D65 reference white
+const float kWhiteX = 0.95047f;
+const float kWhiteZ = 1.08883f;
+
+struct LabTables {
+    float linear[256];
+    float curve[kCurveSteps + 2];
+
+    LabTables() {
+        for (int level = 0; level < 256; ++level) {
+            const double value = level / 255.0;
+            linear[level] = float(value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4));
+        }
+
+        // f(t) from the Lab definition: linear near black, cube root above.
+        // Sampling it by sqrt(t) puts more entries in the dark end, where the
+        // cube root bends sharply and a and b magnify any error 500 times.
+        const double epsilon = 216.0 / 24389.0;
+        const double kappa = 24389.0 / 27.0;
+        for (int i = 0; i <= kCurveSteps + 1; ++i) {
+            const double t = double(i) * i / (double(kCurveSteps) * kCurveSteps);
+            curve[i] = float(t > epsilon ? std::cbrt(t) : (kappa * t + 16) / 116);
+        }
+    }
+};
+
+const LabTables &labTables() {
+    static const LabTables tables;
+    return tables;
+}
+
+float curveAt(const LabTables &tables, float t) {
+    const float position = std::sqrt(qBound(0.0f, t, 1.0f)) * kCurveSteps;
+    const int index = int(position);
+    const float fraction = position - index;
+    return tables.curve[index] + (tables.curve[index + 1] - tables.curve[index]) * fraction;
+}
+
+float degrees(float radians) {
+    return radians * (180.0f / kPi);
+}
+
+float radians(float degrees) {
+    return degrees * (kPi / 180.0f);
+}
+
+// Hue angle in degrees, 0-360
+float hueAngle(float b, float a) {
+    if (a == 0 && b == 0) {
+        return 0;
+    }
+    const float hue = degrees(std::atan2(b, a));
+    return hue < 0 ? hue + 360 : hue;
+}
+
+} // namespace
+
+const char *changeMetricName(ChangeMetric metric) {
+    switch (metric) {
+    case ChangeMetric::Rgb: return "rgb";
+    case ChangeMetric::Cie76: return "cie76";
+    case ChangeMetric::Ciede2000: return "ciede2000";
+    }
+    return "unknown";
+}
+
+ChangeMetric parseChangeMetric(const QString &name, bool *ok) {
+    const QString key = name.trimmed().toLower();
+    for (ChangeMetric metric : { ChangeMetric::Rgb, ChangeMetric::Cie76, ChangeMetric::Ciede2000 }) {
+        if (key == changeMetricName(metric)) {
+            if (ok) {
+                *ok = true;
+            }
+            return metric;
+        }
+    }
+    if (ok) {
+        *ok = false;
+    }
+    return ChangeMetric::Rgb;
+}
+
+LabColour toLab(const QColor &colour) {
+    const LabTables &tables = labTables();
+    const float r = tables.linear[colour.red()];
+    const float g = tables.linear[colour.green()];
+    const float b = tables.linear[colour.blue()];
+
+    // Linear sRGB to XYZ, relative to the white point
+    const float x = (0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / kWhiteX;
+    const float y = 0.2126729f * r + 0.7151522f * g + 0.0721750f * b;
+    const float z = (0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / kWhiteZ;
+
+    const float fx = curveAt(tables, x);
+    const float fy = curveAt(tables, y);
+    const float fz = curveAt(tables, z);
+
+    return LabColour{ 116 * fy - 16, 500 * (fx - fy), 200 * (fy - fz) };
+}
+
+float deltaE76(const LabColour &first, const LabColour &second) {
+    const float dl = first.l - second.l;
+    const float da = first.a - second.a;
+    const float db = first.b - second.b;
+    return std::sqrt(dl * dl + da * da + db * db);
+}
+
+// Sharma, Wu and Dalal's formulation, with kL = kC = kH = 1
+float deltaE2000(const LabColour &first, const LabColour &second) {
+    const float c1 = std::sqrt(first.a * first.a + first.b * first.b);
+    const float c2 = std::sqrt(second.a * second.a + second.b * second.b);
+    const float meanC = (c1 + c2) / 2;
+    const float meanC7 = std::pow(meanC, 7.0f);
+    const float g = 0.5f * (1 - std::sqrt(meanC7 / (meanC7 + 6103515625.0f)));     // 25^7
+
+    const float a1 = (1 + g) * first.a;
+    const float a2 = (1 + g) * second.a;
+    const float cp1 = std::sqrt(a1 * a1 + first.b * first.b);
+    const float cp2 = std::sqrt(a2 * a2 + second.b * second.b);
+    const float hp1 = hueAngle(first.b, a1);
+    const float hp2 = hueAngle(second.b, a2);
+
+    const float dl = second.l - first.l;
+    const float dc = cp2 - cp1;
+    float dhp = 0;
+    if (cp1 * cp2 != 0) {
+        dhp = hp2 - hp1;
+        if (dhp > 180) {
+            dhp -= 360;
+        } else if (dhp < -180) {
+            dhp += 360;
+        }
+    }
+    const float dh = 2 * std::sqrt(cp1 * cp2) * std::sin(radians(dhp / 2));
+
+    const float meanL = (first.l + second.l) / 2;
+    const float meanCp = (cp1 + cp2) / 2;
+    float meanHp = hp1 + hp2;
+    if (cp1 * cp2 != 0) {
+        if (std::fabs(hp1 - hp2) <= 180) {
+            meanHp /= 2;
+        } else {
+            meanHp = meanHp < 360 ? (meanHp + 360) / 2 : (meanHp - 360) / 2;
+        }
+    }
+
+    const float t = 1 - 0.17f * std::cos(radians(meanHp - 30)) + 0.24f * std::cos(radians(2 * meanHp)) +
+                    0.32f * std::cos(radians(3 * meanHp + 6)) - 0.20f * std::cos(radians(4 * meanHp - 63));
+    const float dTheta = 30 * std::exp(-((meanHp - 275) / 25) * ((meanHp - 275) / 25));
+    const float meanCp7 = std::pow(meanCp, 7.0f);
+    const float rc = 2 * std::sqrt(meanCp7 / (meanCp7 + 6103515625.0f));
+    const float lOffset = (meanL - 50) * (meanL - 50);
+    const float sl = 1 + 0.015f * lOffset / std::sqrt(20 + lOffset);
+    const float sc = 1 + 0.045f * meanCp;
+    const float sh = 1 + 0.015f * meanCp * t;
+    const float rt = -std::sin(radians(2 * dTheta)) * rc;
+
+    const float l = dl / sl;
+    const float c = dc / sc;
+    const float h = dh / sh;
+    return std::sqrt(l * l + c * c + h * h + rt * c * h);
+}
+
+float colourDifference(const QColor &first, const QColor &second, ChangeMetric metric) {
+    switch (metric) {
+    case ChangeMetric::Rgb:
+        break;
+    case ChangeMetric::Cie76:
+        return deltaE76(toLab(first), toLab(second));
+    case ChangeMetric::Ciede2000:
+        return deltaE2000(toLab(first), toLab(second));
+    }
+    return float(qAbs(first.red() - second.red()) + qAbs(first.green() - second.green()) +
+                 qAbs(first.blue() - second.blue()));
+}
+
+void toLab(const QVector<QColor> &colours, QVector<LabColour> &lab) {
+    lab.resize(colours.size());
+    for (int i = 0; i < colours.size(); ++i) {
+        lab[i] = toLab(colours[i]);
+    }
+}
+
+bool coloursDiffer(const QVector<LabColour> &last, const QVector<QColor> &current,
+                   ChangeMetric metric, float threshold) {
+    if (last.size() != current.size()) {
+        return true;
+    }
+    for (int i = 0; i < current.size(); ++i) {
+        const LabColour lab = toLab(current[i]);
+        const float difference = metric == ChangeMetric::Ciede2000 ? deltaE2000(last[i], lab)
+                                                                   : deltaE76(last[i], lab);
+        if (difference > threshold) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool coloursDiffer(const QVector<LabColour> &last, const QVector<LabColour> &current,
+                   ChangeMetric metric, float threshold) {
+    if (last.size() != current.size()) {
+        return true;
+    }
+    for (int i = 0; i < current.size(); ++i) {
+        const float difference = metric == ChangeMetric::Ciede2000 ? deltaE2000(last[i], current[i])
+                                                                   : deltaE76(last[i], current[i]);
+        if (difference > threshold) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+
+// How the capture thread decides that a zone's colour changed enough to send
+enum class ChangeMetric {
+    Rgb,        // Sum of absolute RGB differences
+    Cie76,      // Euclidean distance in CIELAB
+    Ciede2000   // CIEDE2000, closest to perceived difference
+};
+
+const char *changeMetricName(ChangeMetric metric);
+
+// Parses "rgb", "cie76" or "ciede2000"
+ChangeMetric parseChangeMetric(const QString &name, bool *ok = nullptr);
+
+// CIELAB coordinates under D65
+struct LabColour {
+    float l;
+    float a;
+    float b;
+};
+
+// sRGB to CIELAB through precomputed tables: one decoding the sRGB transfer
+// curve for each 8-bit level, and one sampling the Lab cube-root curve
+// finely enough that interpolating it is off by at most 0.0013 ΔE over the
+// whole RGB cube. A conversion is then a 3x3 matrix and three table lookups.
+LabColour toLab(const QColor &colour);
+
+float deltaE76(const LabColour &first, const LabColour &second);
+float deltaE2000(const LabColour &first, const LabColour &second);
+
+// Perceived difference between two colours under metric: the RGB sum, or
+// ΔE, where about 2.3 is the smallest difference most people notice
+float colourDifference(const QColor &first, const QColor &second, ChangeMetric metric);
+
+// Lab coordinates of each of colours, into lab's existing buffer
+void toLab(const QVector<QColor> &colours, QVector<LabColour> &lab);
+
+// Whether any zone moved more than threshold ΔE under metric, Cie76 or
+// Ciede2000, or the number of zones changed. last holds the Lab coordinates
+// of the colours last sent, converted once when they were, so each frame
+// only converts the current colours.
+bool coloursDiffer(const QVector<LabColour> &last, const QVector<QColor> &current,
+                   ChangeMetric metric, float threshold);
+
+// As above, with the current colours already in Lab
+bool coloursDiffer(const QVector<LabColour> &last, const QVector<LabColour> &current,
+                   ChangeMetric metric, float threshold);
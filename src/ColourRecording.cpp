@@ -0,0 +1,269 @@
+#include "ColourRecording.h"
+
+#include <cstring>
+
+namespace {
+
+// Zones past this in a keyframe mean the file is corrupt
+const quint64 kMaxZones = 1 << 16;
+
+void writeVarint(QByteArray &out, quint64 value) {
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+bool readVarint(const uchar *data, qint64 size, qint64 *position, quint64 *value) {
+    quint64 result = 0;
+    for (int shift = 0; shift < 64 && *position < size; shift += 7) {
+        const uchar byte = data[(*position)++];
+        result |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+ColourRecorder::ColourRecorder() : m_lastUs(0), m_frames(0), m_bytes(0) {
+}
+
+ColourRecorder::~ColourRecorder() {
+    close();
+}
+
+bool ColourRecorder::open(const QString &path, QString *error) {
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (error) {
+            *error = m_file.errorString();
+        }
+        return false;
+    }
+
+    char header[ColourRecordingFormat::kHeaderSize] = {};
+    memcpy(header, ColourRecordingFormat::kMagic, 4);
+    header[4] = char(ColourRecordingFormat::kVersion);
+    m_file.write(header, sizeof(header));
+
+    m_last.clear();
+    m_lastUs = 0;
+    m_frames = 0;
+    m_bytes = sizeof(header);
+    return true;
+}
+
+void ColourRecorder::close() {
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+bool ColourRecorder::append(const QVector<QColor> &colours, qint64 timestampNs) {
+    if (!m_file.isOpen()) {
+        return false;
+    }
+
+    const qint64 us = timestampNs / 1000;
+    const quint64 delta = m_frames > 0 ? quint64(qMax<qint64>(0, us - m_lastUs)) : 0;
+    if (m_frames == 0 || us > m_lastUs) {
+        m_lastUs = us;
+    }
+
+    const int zones = colours.size();
+    const bool keyframe = m_frames == 0 || size_t(zones) * 3 != m_last.size();
+
+    m_record.clear();
+    writeVarint(m_record, delta << 1 | (keyframe ? 1 : 0));
+
+    if (keyframe) {
+        m_last.resize(size_t(zones) * 3);
+        writeVarint(m_record, quint64(zones));
+        for (int i = 0; i < zones; ++i) {
+            const QColor &colour = colours[i];
+            m_last[i * 3] = uchar(colour.red());
+            m_last[i * 3 + 1] = uchar(colour.green());
+            m_last[i * 3 + 2] = uchar(colour.blue());
+        }
+        m_record.append(reinterpret_cast<const char *>(m_last.data()), int(m_last.size()));
+    } else {
+        // Bitmap first, filled in as the changed zones' deltas follow it
+        const int bitmapSize = (zones + 7) / 8;
+        const int bitmapStart = m_record.size();
+        m_record.resize(bitmapStart + bitmapSize);
+        memset(m_record.data() + bitmapStart, 0, size_t(bitmapSize));
+        for (int i = 0; i < zones; ++i) {
+            const QColor &colour = colours[i];
+            const uchar rgb[3] = { uchar(colour.red()), uchar(colour.green()), uchar(colour.blue()) };
+            uchar *last = &m_last[i * 3];
+            if (rgb[0] == last[0] && rgb[1] == last[1] && rgb[2] == last[2]) {
+                continue;
+            }
+            m_record[bitmapStart + i / 8] = char(uchar(m_record[bitmapStart + i / 8]) | (1 << (i % 8)));
+            for (int c = 0; c < 3; ++c) {
+                m_record.append(char(uchar(rgb[c] - last[c])));
+                last[c] = rgb[c];
+            }
+        }
+    }
+
+    if (m_file.write(m_record) != m_record.size()) {
+        return false;
+    }
+    ++m_frames;
+    m_bytes += quint64(m_record.size());
+    return true;
+}
+
+ColourRecording::ColourRecording()
+    : m_data(nullptr), m_end(0), m_position(0), m_frameCount(0), m_maxZones(0),
+      m_durationUs(0), m_timeUs(0) {
+}
+
+ColourRecording::~ColourRecording() {
+    close();
+}
+
+bool ColourRecording::open(const QString &path, QString *error) {
+    close();
+
+    auto fail = [this, error](const QString &message) {
+        if (error) {
+            *error = message;
+        }
+        close();
+        return false;
+    };
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return fail(m_file.errorString());
+    }
+    const qint64 size = m_file.size();
+    if (size < ColourRecordingFormat::kHeaderSize) {
+        return fail(QString("%1 is not a colour recording").arg(path));
+    }
+
+    m_data = m_file.map(0, size);
+    if (!m_data) {
+        return fail(m_file.errorString());
+    }
+    if (memcmp(m_data, ColourRecordingFormat::kMagic, 4) != 0) {
+        return fail(QString("%1 is not a colour recording").arg(path));
+    }
+    if (m_data[4] != ColourRecordingFormat::kVersion) {
+        return fail(QString("%1 is a version %2 recording").arg(path).arg(m_data[4]));
+    }
+
+    // One pass to count the frames and find where the last whole one ends
+    m_end = size;
+    qint64 position = ColourRecordingFormat::kHeaderSize;
+    qint64 lastWhole = position;
+    m_rgb.clear();
+    m_timeUs = 0;
+    while (position < size && decode(&position)) {
+        lastWhole = position;
+        ++m_frameCount;
+        m_maxZones = qMax(m_maxZones, int(m_rgb.size() / 3));
+    }
+    m_end = lastWhole;
+    m_durationUs = m_timeUs;
+
+    if (m_frameCount == 0) {
+        return fail(QString("%1 has no frames").arg(path));
+    }
+    rewind();
+    return true;
+}
+
+void ColourRecording::close() {
+    if (m_data) {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    m_file.close();
+    m_end = 0;
+    m_position = 0;
+    m_frameCount = 0;
+    m_maxZones = 0;
+    m_durationUs = 0;
+}
+
+void ColourRecording::rewind() {
+    m_position = ColourRecordingFormat::kHeaderSize;
+    m_rgb.clear();
+    m_timeUs = 0;
+}
+
+bool ColourRecording::next(QVector<QColor> &colours, qint64 *offsetNs) {
+    if (!m_data || m_position >= m_end || !decode(&m_position)) {
+        return false;
+    }
+
+    const int zones = int(m_rgb.size() / 3);
+    colours.resize(zones);
+    for (int i = 0; i < zones; ++i) {
+        colours[i].setRgb(m_rgb[i * 3], m_rgb[i * 3 + 1], m_rgb[i * 3 + 2]);
+    }
+    if (offsetNs) {
+        *offsetNs = m_timeUs * 1000;
+    }
+    return true;
+}
+
+bool ColourRecording::decode(qint64 *position) {
+    const uchar *data = m_data;
+    const qint64 size = m_end;
+    qint64 at = *position;
+
+    quint64 head = 0;
+    if (!readVarint(data, size, &at, &head)) {
+        return false;
+    }
+    const bool keyframe = head & 1;
+
+    if (keyframe) {
+        quint64 zones = 0;
+        if (!readVarint(data, size, &at, &zones) || zones > kMaxZones ||
+            size - at < qint64(zones * 3)) {
+            return false;
+        }
+        m_rgb.assign(data + at, data + at + zones * 3);
+        at += qint64(zones * 3);
+    } else {
+        // A delta frame needs a keyframe before it
+        const int zones = int(m_rgb.size() / 3);
+        if (*position == ColourRecordingFormat::kHeaderSize) {
+            return false;
+        }
+        const int bitmapSize = (zones + 7) / 8;
+        if (size - at < bitmapSize) {
+            return false;
+        }
+        const uchar *bitmap = data + at;
+        at += bitmapSize;
+        for (int i = 0; i < zones; ++i) {
+            if (!(bitmap[i / 8] & (1 << (i % 8)))) {
+                continue;
+            }
+            if (size - at < 3) {
+                return false;
+            }
+            for (int c = 0; c < 3; ++c) {
+                m_rgb[i * 3 + c] = uchar(m_rgb[i * 3 + c] + data[at++]);
+            }
+        }
+    }
+
+    // Delta frames are applied in place, so a malformed one can't be undone;
+    // it's only ever the last frame, which opening has already cut off
+    m_timeUs += qint64(head >> 1);
+    *position = at;
+    return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QtCore/QFile>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <vector>
+
+// Colour streams as captured, one frame of zone colours at a time, in an
+// append-only file:
+//
+//   "WZCR", version byte, reserved byte
+//   per frame:
+//     varint  microseconds since the previous frame << 1 | keyframe
+//     keyframe:   varint zone count, then r,g,b per zone
+//     otherwise:  bitmap of the zones that changed, (zones + 7) / 8 bytes,
+//                 then r,g,b per changed zone as differences modulo 256
+//
+// The first frame, and any frame where the number of zones changes, is a
+// keyframe. A steady scene costs a couple of bytes per frame.
+namespace ColourRecordingFormat {
+const char kMagic[4] = { 'W', 'Z', 'C', 'R' };
+const int kVersion = 1;
+const int kHeaderSize = 6;
+}
+
+// Writes a recording. The file goes through QFile's buffer, so a frame
+// reaches the disk in batches and on close().
+class ColourRecorder {
+public:
+    ColourRecorder();
+    ~ColourRecorder();
+
+    // Creates or truncates path and writes the header
+    bool open(const QString &path, QString *error);
+    void close();
+    bool isOpen() const { return m_file.isOpen(); }
+    QString fileName() const { return m_file.fileName(); }
+
+    // Appends a frame captured at timestampNs, in monotonicNs() time.
+    // Timestamps before the previous frame's are recorded as no delay.
+    bool append(const QVector<QColor> &colours, qint64 timestampNs);
+
+    quint64 frames() const { return m_frames; }
+    quint64 bytes() const { return m_bytes; }
+
+private:
+    QFile m_file;
+    QByteArray m_record;            // Reused for every frame
+    std::vector<uchar> m_last;      // r,g,b per zone of the previous frame
+    qint64 m_lastUs;
+    quint64 m_frames;
+    quint64 m_bytes;
+};
+
+// Reads a recording through a memory map. Opening checks every frame once;
+// a frame cut short at the end, as when the recorder was killed, is
+// ignored along with anything after it.
+class ColourRecording {
+public:
+    ColourRecording();
+    ~ColourRecording();
+
+    bool open(const QString &path, QString *error);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    int frameCount() const { return m_frameCount; }
+    int maxZones() const { return m_maxZones; }
+
+    // Time from the first frame to the last
+    qint64 durationNs() const { return m_durationUs * 1000; }
+
+    // Decodes the next frame into colours, with its time since the first
+    // frame. Returns false after the last frame until rewind().
+    bool next(QVector<QColor> &colours, qint64 *offsetNs);
+    void rewind();
+
+private:
+    // Decodes the frame at *position, advancing past it, into m_rgb and
+    // m_timeUs. Returns false if it's cut short or malformed.
+    bool decode(qint64 *position);
+
+    QFile m_file;
+    uchar *m_data;
+    qint64 m_end;                   // Just past the last whole frame
+    qint64 m_position;
+    int m_frameCount;
+    int m_maxZones;
+    qint64 m_durationUs;
+
+    std::vector<uchar> m_rgb;
+    qint64 m_timeUs;
+};
@@ -0,0 +1,241 @@
+#include "DaemonConfig.h"
+
+#include <QtCore/QFileInfo>
+#include <QtCore/QSettings>
+#include <QtCore/QStringList>
+#include <memory>
+
+#include "UdpSender.h"
+
+namespace {
+
+// Comma-separated integers, exactly count of them
+bool parseInts(const QString &text, int count, int *values) {
+    const QStringList parts = text.split(',');
+    if (parts.size() != count) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        bool ok = false;
+        values[i] = parts[i].trimmed().toInt(&ok);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// QSettings splits unquoted values at commas, which lists of bulbs and
+// rectangles are full of, so lists are joined back up
+QString fileValue(const QSettings &file, const QString &key) {
+    const QVariant value = file.value(key);
+    if (value.type() == QVariant::StringList) {
+        return value.toStringList().join(',');
+    }
+    return value.toString();
+}
+
+// Overrides win over the file, which wins over the defaults
+class ConfigReader {
+public:
+    ConfigReader(QSettings *file, const QMap<QString, QString> &overrides)
+        : m_file(file), m_overrides(overrides) {}
+
+    bool contains(const QString &key) const {
+        return m_overrides.contains(key) || (m_file && m_file->contains(key));
+    }
+
+    QString string(const QString &key, const QString &fallback) const {
+        if (m_overrides.contains(key)) {
+            return m_overrides.value(key);
+        }
+        if (m_file && m_file->contains(key)) {
+            return fileValue(*m_file, key);
+        }
+        return fallback;
+    }
+
+    bool integer(const QString &key, int minimum, int maximum, int *value, QString *error) const {
+        if (!contains(key)) {
+            return true;
+        }
+        bool ok = false;
+        const int parsed = string(key, QString()).trimmed().toInt(&ok);
+        if (!ok || parsed < minimum || parsed > maximum) {
+            *error = QString("%1 must be a whole number from %2 to %3").arg(key).arg(minimum).arg(maximum);
+            return false;
+        }
+        *value = parsed;
+        return true;
+    }
+
+    bool real(const QString &key, float minimum, float maximum, float *value, QString *error) const {
+        if (!contains(key)) {
+            return true;
+        }
+        bool ok = false;
+        const float parsed = string(key, QString()).trimmed().toFloat(&ok);
+        if (!ok || !(parsed >= minimum && parsed <= maximum)) {
+            *error = QString("%1 must be a number from %2 to %3").arg(key).arg(minimum).arg(maximum);
+            return false;
+        }
+        *value = parsed;
+        return true;
+    }
+
+private:
+    QSettings *m_file;
+    const QMap<QString, QString> &m_overrides;
+};
+
+} // namespace
+
+bool loadDaemonConfig(const QString &path, const QMap<QString, QString> &overrides,
+                      DaemonConfig *config, QString *error) {
+    QString message;
+    auto fail = [error, &message]() {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    };
+
+    std::unique_ptr<QSettings> file;
+    if (!path.isEmpty()) {
+        if (!QFileInfo(path).isReadable()) {
+            message = QString("Can't read config file %1").arg(path);
+            return fail();
+        }
+        file.reset(new QSettings(path, QSettings::IniFormat));
+        if (file->status() != QSettings::NoError) {
+            message = QString("Invalid config file %1").arg(path);
+            return fail();
+        }
+    }
+
+    const ConfigReader reader(file.get(), overrides);
+    DaemonConfig loaded;
+    PipelineSettings &settings = loaded.settings;
+
+    loaded.source = reader.string("capture/source", "screen");
+    loaded.record = reader.string("capture/record", QString());
+
+    const QString eventsText = reader.string("capture/events", "on").toLower();
+    if (eventsText != "on" && eventsText != "off") {
+        message = QString("capture/events must be on or off, not %1").arg(eventsText);
+        return fail();
+    }
+    loaded.events = eventsText == "on";
+    if (!reader.integer("capture/fps", 0, 1000, &settings.fps, &message) ||
+        !reader.integer("capture/idle-fps", 0, 1000, &settings.idleFps, &message) ||
+        !reader.integer("capture/threshold", 0, 765, &settings.threshold, &message) ||
+        !reader.integer("capture/sample-budget", 0, 1 << 24, &settings.sampleBudget, &message) ||
+        !reader.real("capture/delta-e", 0, 50, &settings.deltaEThreshold, &message) ||
+        !reader.integer("output/brightness", 1, 100, &settings.brightness, &message) ||
+        !reader.integer("output/rate", 0, 1000, &settings.outputRate, &message) ||
+        !reader.integer("output/bulb-rate", 0, 1000, &settings.bulbRateLimit, &message) ||
+        !reader.real("correction/gamma", 0.5f, 3.0f, &settings.correction.gamma, &message) ||
+        !reader.real("correction/saturation", 0.5f, 2.5f, &settings.correction.saturation, &message) ||
+        !reader.real("correction/red", 0.5f, 2.0f, &settings.correction.redFactor, &message) ||
+        !reader.real("correction/green", 0.5f, 2.0f, &settings.correction.greenFactor, &message) ||
+        !reader.real("correction/blue", 0.5f, 2.0f, &settings.correction.blueFactor, &message)) {
+        return fail();
+    }
+
+    int port = 38899;
+    if (!reader.integer("output/port", 1, 65535, &port, &message)) {
+        return fail();
+    }
+
+    bool reducerOk = false;
+    const QString reducerText = reader.string("capture/reducer", "mean");
+    settings.reducer = parseColourReducer(reducerText, &reducerOk);
+    if (!reducerOk) {
+        message = QString("Invalid reducer: %1").arg(reducerText);
+        return fail();
+    }
+
+    bool metricOk = false;
+    const QString metricText = reader.string("capture/change-metric", "rgb");
+    settings.changeMetric = parseChangeMetric(metricText, &metricOk);
+    if (!metricOk) {
+        message = QString("Invalid change metric: %1").arg(metricText);
+        return fail();
+    }
+
+    bool filterOk = false;
+    const QString filterText = reader.string("output/filter", "none");
+    const FilterSettings filter = parseFilterSettings(filterText, &filterOk);
+    if (!filterOk) {
+        message = QString("Invalid filter: %1").arg(filterText);
+        return fail();
+    }
+    loaded.filter = filter;
+
+    // Zones from the [zones] group, or one region like the window's
+    if (file) {
+        file->beginGroup("zones");
+        const QStringList names = file->childKeys();
+        for (const QString &name : names) {
+            int values[4];
+            if (!parseInts(fileValue(*file, name), 4, values) || values[2] <= 0 || values[3] <= 0) {
+                message = QString("zones/%1 must be x,y,width,height").arg(name);
+                return fail();
+            }
+            settings.zones.append(CaptureZone{ name, QRect(values[0], values[1], values[2], values[3]),
+                                               filter });
+        }
+        file->endGroup();
+    }
+
+    if (reader.contains("capture/region")) {
+        int values[3];
+        if (!parseInts(reader.string("capture/region", QString()), 3, values) || values[2] <= 0) {
+            message = "capture/region must be x,y,size";
+            return fail();
+        }
+        const int half = values[2] / 2;
+        settings.zones = { CaptureZone{ "centre", QRect(values[0] - half, values[1] - half,
+                                                        values[2], values[2]), filter } };
+    }
+    if (!reader.integer("capture/size", 1, 10000, &loaded.centreSize, &message) ||
+        !reader.integer("capture/edge-depth", 1, 50, &loaded.edges.depth, &message) ||
+        !reader.integer("capture/edge-scale", 1, 256, &loaded.edges.scale, &message)) {
+        return fail();
+    }
+
+    bool edgesOk = false;
+    const QString edgesText = reader.string("capture/edges", "off");
+    loaded.edges = parseEdgeLayout(edgesText, loaded.edges, &edgesOk);
+    if (!edgesOk) {
+        message = QString("capture/edges must be like 16x9 or top,right,bottom,left, not %1").arg(edgesText);
+        return fail();
+    }
+
+    settings.targets = UdpSender::parseTargets(reader.string("output/bulbs", QString()),
+                                               settings.brightness, quint16(port));
+    if (settings.targets.isEmpty()) {
+        message = "No bulbs configured (output/bulbs)";
+        return fail();
+    }
+
+    *config = loaded;
+    return true;
+}
+
+void resolveDaemonZones(DaemonConfig *config, const QRect &sourceGeometry) {
+    if (!config->edges.isEmpty()) {
+        config->settings.zones = edgeZones(config->edges, sourceGeometry, config->filter);
+        config->settings.summedAreaScale = config->edges.scale;
+        assignEdgeZones(config->settings.targets, config->edges.segments());
+        return;
+    }
+    if (!config->settings.zones.isEmpty()) {
+        return;
+    }
+
+    const int size = config->centreSize;
+    const QPoint centre = sourceGeometry.center();
+    config->settings.zones = { CaptureZone{ "centre", QRect(centre.x() - size / 2, centre.y() - size / 2,
+                                                            size, size), config->filter } };
+}
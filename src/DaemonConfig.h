@@ -0,0 +1,87 @@
+#pragma once
+
+#include <QtCore/QMap>
+#include <QtCore/QRect>
+#include <QtCore/QString>
+
+#include "EdgeLayout.h"
+#include "PipelineSettings.h"
+
+// Everything the headless daemon runs with, read from an INI file such as:
+//
+//   [capture]
+//   ; Or replay:<path>[:fast] to play back a recording instead of capturing
+//   source=screen
+//   ; Records the captured colours to this file
+//   record=colours.wzcr
+//   ; on to grab only when a zone changes, where the screen reports it
+//   ; (X11 with DAMAGE); off to grab at the full frame rate regardless
+//   events=on
+//   fps=60
+//   ; Rate to fall to after a while without changes, 0 to stay at fps
+//   idle-fps=5
+//   threshold=3
+//   ; rgb uses threshold; cie76 or ciede2000 send changes above delta-e,
+//   ; from 0 to 50
+//   change-metric=ciede2000
+//   delta-e=2.3
+//   ; Centre x,y and size, like the window's
+//   region=960,540,10
+//   ; Pixels read per zone and frame, 0 for all of them
+//   sample-budget=4096
+//   ; mean, dominant or vivid
+//   reducer=mean
+//   ; Or segments along the screen's edges for the bulbs in order, as
+//   ; 16x9 or top,right,bottom,left, replacing the region and any zones
+//   edges=16x9
+//   ; Strip thickness, percent of the shorter side
+//   edge-depth=10
+//   ; Summed-area table cell size in pixels
+//   edge-scale=8
+//
+//   ; Or any number of zones as x,y,width,height, numbered for the
+//   ; bulbs' #n in alphabetical order of their names
+//   [zones]
+//   left=0,0,200,1080
+//   right=1720,0,200,1080
+//
+//   [output]
+//   bulbs=192.168.1.20#0, 192.168.1.21@60#1
+//   brightness=100
+//   port=38899
+//   filter=spring:200
+//   rate=30
+//   bulb-rate=20
+//
+//   [correction]
+//   ; 0.5 to 3, 0.5 to 2.5 and 0.5 to 2 for each channel, as in the window
+//   gamma=0.6
+//   saturation=1.8
+//   red=1.2
+//   green=1.0
+//   blue=1.2
+struct DaemonConfig {
+    QString source;
+    QString record;
+
+    // Sleep until the screen changes where possible, rather than polling
+    bool events = true;
+    PipelineSettings settings;
+
+    // Size of the zone centred on the source when no zones are given
+    int centreSize = 10;
+    FilterSettings filter;
+
+    // Segments along the source's edges, replacing the zones when not empty
+    EdgeLayout edges;
+};
+
+// Reads path (skipped if empty) and then overrides, keyed like the file
+// ("capture/fps", "output/bulbs"...), over the defaults. Returns false with
+// error set if a value is invalid.
+bool loadDaemonConfig(const QString &path, const QMap<QString, QString> &overrides,
+                      DaemonConfig *config, QString *error);
+
+// Fills in the edge segments, or the centre zone if the config has no
+// zones, now that the size of the source is known
+void resolveDaemonZones(DaemonConfig *config, const QRect &sourceGeometry);
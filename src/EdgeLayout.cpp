@@ -0,0 +1,111 @@
+#include "EdgeLayout.h"
+
+#include <QtCore/QStringList>
+
+namespace {
+
+// Splits length into count spans as evenly as whole pixels allow
+int spanStart(int length, int count, int index) {
+    return int(qint64(length) * index / count);
+}
+
+} // namespace
+
+EdgeLayout parseEdgeLayout(const QString &spec, const EdgeLayout &layout, bool *ok) {
+    EdgeLayout parsed = layout;
+    parsed.top = parsed.right = parsed.bottom = parsed.left = 0;
+
+    const QString text = spec.trimmed().toLower();
+    bool valid = text.isEmpty() || text == "off";
+    if (!valid) {
+        const QStringList grid = text.split('x');
+        const QStringList sides = text.split(',');
+        int counts[4] = { 0, 0, 0, 0 };
+        if (grid.size() == 2) {
+            bool widthOk = false;
+            bool heightOk = false;
+            counts[0] = counts[2] = grid[0].trimmed().toInt(&widthOk);
+            counts[1] = counts[3] = grid[1].trimmed().toInt(&heightOk);
+            valid = widthOk && heightOk;
+        } else if (sides.size() == 4) {
+            valid = true;
+            for (int i = 0; i < 4; ++i) {
+                bool sideOk = false;
+                counts[i] = sides[i].trimmed().toInt(&sideOk);
+                valid &= sideOk;
+            }
+        }
+        for (int count : counts) {
+            valid &= count >= 0 && count <= 256;
+        }
+        if (valid) {
+            parsed.top = counts[0];
+            parsed.right = counts[1];
+            parsed.bottom = counts[2];
+            parsed.left = counts[3];
+        }
+    }
+
+    if (ok) {
+        *ok = valid;
+    }
+    return valid ? parsed : layout;
+}
+
+QString edgeLayoutSpec(const EdgeLayout &layout) {
+    if (layout.isEmpty()) {
+        return "off";
+    }
+    if (layout.top == layout.bottom && layout.left == layout.right) {
+        return QString("%1x%2").arg(layout.top).arg(layout.left);
+    }
+    return QString("%1,%2,%3,%4").arg(layout.top).arg(layout.right).arg(layout.bottom).arg(layout.left);
+}
+
+QVector<CaptureZone> edgeZones(const EdgeLayout &layout, const QRect &screen,
+                               const FilterSettings &filter) {
+    QVector<CaptureZone> zones;
+    if (layout.isEmpty() || screen.isEmpty()) {
+        return zones;
+    }
+    zones.reserve(layout.segments());
+
+    const int depth = qMax(1, qMin(screen.width(), screen.height()) * qBound(1, layout.depth, 50) / 100);
+    const int width = screen.width();
+    const int height = screen.height();
+
+    auto add = [&zones, &filter](const QString &name, int index, const QRect &rect) {
+        zones.append(CaptureZone{ QString("%1 %2").arg(name).arg(index + 1), rect, filter });
+    };
+
+    for (int i = 0; i < layout.top; ++i) {
+        const int x = spanStart(width, layout.top, i);
+        add("top", i, QRect(screen.x() + x, screen.y(),
+                            spanStart(width, layout.top, i + 1) - x, depth));
+    }
+    for (int i = 0; i < layout.right; ++i) {
+        const int y = spanStart(height, layout.right, i);
+        add("right", i, QRect(screen.right() + 1 - depth, screen.y() + y,
+                              depth, spanStart(height, layout.right, i + 1) - y));
+    }
+    for (int i = 0; i < layout.bottom; ++i) {
+        const int x = width - spanStart(width, layout.bottom, i + 1);
+        add("bottom", i, QRect(screen.x() + x, screen.bottom() + 1 - depth,
+                               width - spanStart(width, layout.bottom, i) - x, depth));
+    }
+    for (int i = 0; i < layout.left; ++i) {
+        const int y = height - spanStart(height, layout.left, i + 1);
+        add("left", i, QRect(screen.x(), screen.y() + y,
+                             depth, height - spanStart(height, layout.left, i) - y));
+    }
+    return zones;
+}
+
+void assignEdgeZones(QVector<BulbTarget> &targets, int segments) {
+    if (segments <= 0) {
+        return;
+    }
+    for (int i = 0; i < targets.size(); ++i) {
+        targets[i].zone = i % segments;
+    }
+}
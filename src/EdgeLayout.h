@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QtCore/QRect>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include "PipelineSettings.h"
+
+// Segments along the edges of the screen, for bulbs placed around it as
+// ambient lighting. Each side is a strip split evenly into its number of
+// segments, and the strips overlap at the corners.
+struct EdgeLayout {
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+    int left = 0;
+    int depth = 10;     // Strip thickness, percent of the screen's shorter side
+    int scale = 8;      // Pixels per summed-area table cell, across and down
+
+    int segments() const { return top + right + bottom + left; }
+    bool isEmpty() const { return segments() == 0; }
+
+    bool operator==(const EdgeLayout &other) const {
+        return top == other.top && right == other.right && bottom == other.bottom &&
+               left == other.left && depth == other.depth && scale == other.scale;
+    }
+    bool operator!=(const EdgeLayout &other) const { return !(*this == other); }
+};
+
+// Parses segment counts as "16x9" (16 along the top and bottom, 9 down each
+// side) or "top,right,bottom,left", keeping depth and scale from layout.
+// "off" or an empty string gives no segments.
+EdgeLayout parseEdgeLayout(const QString &spec, const EdgeLayout &layout = EdgeLayout(),
+                           bool *ok = nullptr);
+
+// Inverse of parseEdgeLayout()'s segment counts
+QString edgeLayoutSpec(const EdgeLayout &layout);
+
+// One zone per segment, clockwise from the top left corner: along the top
+// left to right, down the right side, along the bottom right to left and
+// up the left side
+QVector<CaptureZone> edgeZones(const EdgeLayout &layout, const QRect &screen,
+                               const FilterSettings &filter);
+
+// Shows segment i on bulb i, in the order edgeZones() lists them; bulbs past
+// the last segment wrap around to the first
+void assignEdgeZones(QVector<BulbTarget> &targets, int segments);
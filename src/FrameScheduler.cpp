@@ -0,0 +1,132 @@
+#include "FrameScheduler.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include "LatencyStats.h"
+
+#ifdef Q_OS_LINUX
+#include <time.h>
+#endif
+
+void sleepUntilNs(qint64 deadline) {
+#ifdef Q_OS_LINUX
+    timespec until;
+    until.tv_sec = time_t(deadline / 1000000000);
+    until.tv_nsec = long(deadline % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR) {
+    }
+#else
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::nanoseconds(deadline))));
+#endif
+}
+
+FrameTiming::Stats FrameTiming::since(const FrameTiming &earlier) const {
+    Stats stats;
+    stats.frames = frames - earlier.frames;
+    stats.skipped = skipped - earlier.skipped;
+    if (stats.frames == 0) {
+        return stats;
+    }
+
+    const double count = double(stats.frames);
+    stats.meanIntervalUs = (intervalSumUs - earlier.intervalSumUs) / count;
+    const double meanSquare = (intervalSquareSumUs - earlier.intervalSquareSumUs) / count;
+    stats.jitterUs = std::sqrt(qMax(0.0, meanSquare - stats.meanIntervalUs * stats.meanIntervalUs));
+    stats.meanLatenessUs = (latenessSumUs - earlier.latenessSumUs) / count;
+    return stats;
+}
+
+FrameScheduler::FrameScheduler()
+    : m_fps(0), m_periodNs(0), m_deadlineNs(0), m_lastFrameNs(0) {
+    m_frames = 0;
+    m_skipped = 0;
+    m_intervalSumUs = 0;
+    m_intervalSquareSumUs = 0;
+    m_latenessSumUs = 0;
+    m_maxLatenessUs = 0;
+}
+
+void FrameScheduler::setRate(int fps) {
+    fps = qMax(0, fps);
+    if (fps == m_fps) {
+        return;
+    }
+
+    m_fps = fps;
+    m_periodNs = fps > 0 ? 1000000000 / fps : 0;
+    m_deadlineNs = 0;
+}
+
+void FrameScheduler::restart() {
+    m_deadlineNs = 0;
+    m_lastFrameNs = 0;
+}
+
+int FrameScheduler::waitForNextFrame() {
+    if (m_periodNs == 0) {
+        recordFrame(monotonicNs(), 0, 0);
+        return 0;
+    }
+
+    qint64 now = monotonicNs();
+    if (m_deadlineNs == 0) {
+        // First frame on a new grid starts straight away
+        m_deadlineNs = now;
+    }
+
+    int skipped = 0;
+    if (now < m_deadlineNs) {
+        sleepUntilNs(m_deadlineNs);
+        now = monotonicNs();
+    } else if (now - m_deadlineNs >= m_periodNs) {
+        // Overran by whole periods: drop those frames and start on the last
+        // deadline that has passed, staying on the grid
+        const qint64 missed = (now - m_deadlineNs) / m_periodNs;
+        m_deadlineNs += missed * m_periodNs;
+        skipped = int(missed);
+    }
+
+    recordFrame(now, qMax<qint64>(0, now - m_deadlineNs), skipped);
+    m_deadlineNs += m_periodNs;
+    return skipped;
+}
+
+FrameTiming FrameScheduler::timing() const {
+    FrameTiming timing;
+    timing.frames = m_frames.load(std::memory_order_relaxed);
+    timing.skipped = m_skipped.load(std::memory_order_relaxed);
+    timing.intervalSumUs = m_intervalSumUs.load(std::memory_order_relaxed);
+    timing.intervalSquareSumUs = m_intervalSquareSumUs.load(std::memory_order_relaxed);
+    timing.latenessSumUs = m_latenessSumUs.load(std::memory_order_relaxed);
+    timing.maxLatenessUs = m_maxLatenessUs.load(std::memory_order_relaxed);
+    return timing;
+}
+
+void FrameScheduler::recordFrame(qint64 now, qint64 lateness, int skipped) {
+    // The first frame has no interval, and counting it as one would skew
+    // the mean, so the totals only start with the second
+    if (m_lastFrameNs != 0) {
+        const quint64 intervalUs = quint64(now - m_lastFrameNs) / 1000;
+        const quint64 latenessUs = quint64(lateness) / 1000;
+
+        // Only this thread writes, so plain load/store pairs are enough
+        m_intervalSumUs.store(m_intervalSumUs.load(std::memory_order_relaxed) + intervalUs,
+                              std::memory_order_relaxed);
+        m_intervalSquareSumUs.store(m_intervalSquareSumUs.load(std::memory_order_relaxed) +
+                                    intervalUs * intervalUs, std::memory_order_relaxed);
+        m_latenessSumUs.store(m_latenessSumUs.load(std::memory_order_relaxed) + latenessUs,
+                              std::memory_order_relaxed);
+        if (latenessUs > m_maxLatenessUs.load(std::memory_order_relaxed)) {
+            m_maxLatenessUs.store(latenessUs, std::memory_order_relaxed);
+        }
+        m_skipped.store(m_skipped.load(std::memory_order_relaxed) + quint64(skipped),
+                        std::memory_order_relaxed);
+        m_frames.store(m_frames.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    m_lastFrameNs = now;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QtGlobal>
+#include <atomic>
+
+// Running totals of frame timing. Take one snapshot, take another later,
+// and since() gives the statistics for the frames in between.
+struct FrameTiming {
+    quint64 frames = 0;
+    quint64 skipped = 0;            // Deadlines missed entirely on overrun
+    quint64 intervalSumUs = 0;      // Between consecutive frame starts
+    quint64 intervalSquareSumUs = 0;
+    quint64 latenessSumUs = 0;      // Frame start past its deadline
+    quint64 maxLatenessUs = 0;      // Since the scheduler started
+
+    struct Stats {
+        quint64 frames = 0;
+        quint64 skipped = 0;
+        double meanIntervalUs = 0;
+        double jitterUs = 0;        // Standard deviation of the interval
+        double meanLatenessUs = 0;
+    };
+
+    Stats since(const FrameTiming &earlier) const;
+};
+
+// Sleeps until deadline, in monotonicNs() time, or returns at once if it
+// has passed
+void sleepUntilNs(qint64 deadline);
+
+// Paces a loop against absolute deadlines on a fixed grid of 1/fps apart,
+// so time spent on a frame never pushes the following ones back and
+// rounding never accumulates. On Linux it sleeps with
+// clock_nanosleep(TIMER_ABSTIME). A frame that overruns by more than a
+// whole period skips the deadlines it missed rather than bursting to catch
+// up.
+//
+// Only the thread running the loop may call waitForNextFrame() and
+// setRate(); timing() can be read from any thread.
+class FrameScheduler {
+public:
+    FrameScheduler();
+
+    // Frames per second, or 0 to run unthrottled. Restarts the grid from
+    // now if the rate changed.
+    void setRate(int fps);
+    int rate() const { return m_fps; }
+
+    // Forgets the previous frame, so a pause isn't counted as an interval
+    void restart();
+
+    // Sleeps until the next deadline, or returns at once if it has passed.
+    // Returns how many deadlines were skipped to get here.
+    int waitForNextFrame();
+
+    FrameTiming timing() const;
+
+private:
+    void recordFrame(qint64 now, qint64 lateness, int skipped);
+
+    int m_fps;
+    qint64 m_periodNs;
+    qint64 m_deadlineNs;        // Of the frame about to start, 0 when unset
+    qint64 m_lastFrameNs;
+
+    std::atomic<quint64> m_frames;
+    std::atomic<quint64> m_skipped;
+    std::atomic<quint64> m_intervalSumUs;
+    std::atomic<quint64> m_intervalSquareSumUs;
+    std::atomic<quint64> m_latenessSumUs;
+    std::atomic<quint64> m_maxLatenessUs;
+};
@@ -0,0 +1,302 @@
+#include "FrameSource.h"
+
+#include <QtGui/QGuiApplication>
+#include <QtGui/QPixmap>
+#include <QtGui/QScreen>
+#include <QtCore/QStringList>
+
+#ifdef WIZ_HAVE_XSHM
+#include "XShmFrameSource.h"
+#endif
+
+namespace {
+
+// Parses "WxH", e.g. "1920x1080"
+QSize parseSize(const QString &text) {
+    const QStringList parts = text.toLower().split('x');
+    if (parts.size() != 2) {
+        return QSize();
+    }
+
+    bool okWidth = false, okHeight = false;
+    QSize size(parts[0].toInt(&okWidth), parts[1].toInt(&okHeight));
+    return (okWidth && okHeight && !size.isEmpty()) ? size : QSize();
+}
+
+// Wraps a rect of a 32-bit buffer in a read-only image without copying
+QImage subImage(const uchar *bits, int bytesPerLine, const QRect &rect) {
+    return QImage(bits + rect.y() * bytesPerLine + rect.x() * 4,
+                  rect.width(), rect.height(), bytesPerLine, QImage::Format_RGB32);
+}
+
+#ifdef WIZ_HAVE_XSHM
+// A screen's rect on the X root window, in device pixels. Qt 5 keeps a
+// scaled screen's origin where the server has it and divides only its size
+// by the device pixel ratio, so only the size is scaled back.
+QRect nativeGeometry(const QScreen *screen) {
+    const QRect geometry = screen->geometry();
+    return QRect(geometry.topLeft(), geometry.size() * screen->devicePixelRatio());
+}
+#endif
+
+} // namespace
+
+QScreenFrameSource::QScreenFrameSource(QScreen *screen) : m_screen(screen) {
+}
+
+QRect QScreenFrameSource::geometry() const {
+    return m_screen ? m_screen->geometry() : QRect();
+}
+
+bool QScreenFrameSource::grab(const QRect &rect, QImage &frame) {
+    if (!m_screen) {
+        return false;
+    }
+
+    // Grabbing the desktop takes coordinates relative to the screen, while
+    // rect is in desktop coordinates like geometry()
+    const QPoint origin = rect.topLeft() - m_screen->geometry().topLeft();
+    QPixmap pixmap = m_screen->grabWindow(0,
+        origin.x(), origin.y(),
+        rect.width(), rect.height());
+
+    if (pixmap.isNull()) {
+        return false;
+    }
+
+    frame = pixmap.toImage();
+    return !frame.isNull();
+}
+
+SyntheticFrameSource::SyntheticFrameSource(Pattern pattern, const QSize &size)
+    : m_pattern(pattern), m_size(size), m_frame(0), m_noiseState(0x9e3779b9u) {
+}
+
+QString SyntheticFrameSource::name() const {
+    switch (m_pattern) {
+    case Flicker: return "synthetic:flicker";
+    case Noise: return "synthetic:noise";
+    case Gradient: break;
+    }
+    return "synthetic:gradient";
+}
+
+bool SyntheticFrameSource::grab(const QRect &rect, QImage &frame) {
+    if (rect.isEmpty()) {
+        return false;
+    }
+
+    // Only the requested rect is rendered; the buffer is reused between frames
+    if (m_buffer.width() < rect.width() || m_buffer.height() < rect.height()) {
+        m_buffer = QImage(rect.size(), QImage::Format_RGB32);
+    }
+
+    const int shift = int(m_frame * 4);
+
+    switch (m_pattern) {
+    case Gradient:
+        for (int y = 0; y < rect.height(); ++y) {
+            QRgb *line = reinterpret_cast<QRgb*>(m_buffer.scanLine(y));
+            const int gy = rect.y() + y;
+            for (int x = 0; x < rect.width(); ++x) {
+                const int gx = rect.x() + x;
+                line[x] = qRgb((gx * 256 / m_size.width() + shift) & 0xff,
+                               (gy * 256 / m_size.height()) & 0xff,
+                               (gx + gy + shift / 2) & 0xff);
+            }
+        }
+        break;
+    case Flicker:
+        m_buffer.fill((m_frame & 1) ? 0xffffffffu : 0xff000000u);
+        break;
+    case Noise: {
+        const int baseRed = shift & 0xff;
+        const int baseGreen = (shift / 3) & 0xff;
+        const int baseBlue = 255 - baseRed;
+        for (int y = 0; y < rect.height(); ++y) {
+            QRgb *line = reinterpret_cast<QRgb*>(m_buffer.scanLine(y));
+            for (int x = 0; x < rect.width(); ++x) {
+                // xorshift32
+                m_noiseState ^= m_noiseState << 13;
+                m_noiseState ^= m_noiseState >> 17;
+                m_noiseState ^= m_noiseState << 5;
+                const int n = int(m_noiseState & 0x1f) - 16;
+                line[x] = qRgb(qBound(0, baseRed + n, 255),
+                               qBound(0, baseGreen + n, 255),
+                               qBound(0, baseBlue + n, 255));
+            }
+        }
+        break;
+    }
+    }
+
+    ++m_frame;
+    frame = subImage(m_buffer.constBits(), m_buffer.bytesPerLine(),
+                     QRect(0, 0, rect.width(), rect.height()));
+    return true;
+}
+
+RawVideoFrameSource::RawVideoFrameSource(const QString &path, const QSize &size)
+    : m_file(path), m_size(size), m_data(nullptr),
+      m_frameBytes(qint64(size.width()) * size.height() * 4),
+      m_frameCount(0), m_frameIndex(0) {
+    if (m_frameBytes <= 0) {
+        m_error = "Invalid frame size";
+        return;
+    }
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_error = m_file.errorString();
+        return;
+    }
+
+    m_frameCount = m_file.size() / m_frameBytes;
+    if (m_frameCount == 0) {
+        m_error = QString("%1 is smaller than one %2x%3 frame")
+                      .arg(path).arg(size.width()).arg(size.height());
+        return;
+    }
+
+    m_data = m_file.map(0, m_frameCount * m_frameBytes);
+    if (!m_data) {
+        m_error = m_file.errorString();
+    }
+}
+
+RawVideoFrameSource::~RawVideoFrameSource() {
+    if (m_data) {
+        m_file.unmap(m_data);
+    }
+}
+
+QString RawVideoFrameSource::name() const {
+    return QString("raw:%1").arg(m_file.fileName());
+}
+
+bool RawVideoFrameSource::grab(const QRect &rect, QImage &frame) {
+    if (!isValid() || rect.isEmpty()) {
+        return false;
+    }
+
+    const uchar *bits = m_data + m_frameIndex * m_frameBytes;
+    m_frameIndex = (m_frameIndex + 1) % m_frameCount;
+
+    frame = subImage(bits, m_size.width() * 4, rect);
+    return true;
+}
+
+std::unique_ptr<FrameSource> createFrameSource(const QString &spec, QString *error) {
+    auto fail = [error](const QString &message) {
+        if (error) {
+            *error = message;
+        }
+        return std::unique_ptr<FrameSource>();
+    };
+
+    if (spec.isEmpty() || spec == "screen" || spec == "xshm") {
+#ifdef WIZ_HAVE_XSHM
+        // Prefer zero-copy shared memory capture when running on X11
+        if (QGuiApplication::platformName() == "xcb") {
+            if (auto source = XShmFrameSource::create()) {
+                return source;
+            }
+        }
+#endif
+        if (spec == "xshm") {
+            return fail("MIT-SHM capture is not available");
+        }
+    }
+
+    if (spec.isEmpty() || spec == "screen" || spec == "qscreen") {
+        QScreen *screen = QGuiApplication::primaryScreen();
+        if (!screen) {
+            return fail("No screen available");
+        }
+        return std::make_unique<QScreenFrameSource>(screen);
+    }
+
+    if (spec.startsWith("synthetic")) {
+        const QStringList parts = spec.split(':');
+        SyntheticFrameSource::Pattern pattern = SyntheticFrameSource::Gradient;
+        QSize size(1920, 1080);
+
+        if (parts.size() > 1) {
+            if (parts[1] == "gradient") {
+                pattern = SyntheticFrameSource::Gradient;
+            } else if (parts[1] == "flicker") {
+                pattern = SyntheticFrameSource::Flicker;
+            } else if (parts[1] == "noise") {
+                pattern = SyntheticFrameSource::Noise;
+            } else {
+                return fail(QString("Unknown synthetic pattern: %1").arg(parts[1]));
+            }
+        }
+        if (parts.size() > 2) {
+            size = parseSize(parts[2]);
+            if (size.isEmpty()) {
+                return fail(QString("Invalid size: %1").arg(parts[2]));
+            }
+        }
+        return std::make_unique<SyntheticFrameSource>(pattern, size);
+    }
+
+    if (spec.startsWith("raw:")) {
+        // The size is split off the end so paths may contain ':'
+        const int sizeSeparator = spec.lastIndexOf(':');
+        const QString path = spec.mid(4, sizeSeparator - 4);
+        const QSize size = parseSize(spec.mid(sizeSeparator + 1));
+        if (sizeSeparator <= 4 || path.isEmpty() || size.isEmpty()) {
+            return fail("Expected raw:<path>:<width>x<height>");
+        }
+
+        auto source = std::make_unique<RawVideoFrameSource>(path, size);
+        if (!source->isValid()) {
+            return fail(source->errorString());
+        }
+        return source;
+    }
+
+    return fail(QString("Unknown frame source: %1").arg(spec));
+}
+
+FrameSources createFrameSources(const QString &spec, QString *error) {
+    FrameSources sources;
+    const bool screens = spec.isEmpty() || spec == "screen" || spec == "xshm" || spec == "qscreen";
+    QList<QScreen *> screenList;
+    QScreen *primary = screens ? QGuiApplication::primaryScreen() : nullptr;
+    if (primary) {
+        screenList.append(primary);
+        for (QScreen *screen : QGuiApplication::screens()) {
+            if (screen != primary) {
+                screenList.append(screen);
+            }
+        }
+    }
+    if (!screens || screenList.size() < 2) {
+        if (std::unique_ptr<FrameSource> source = createFrameSource(spec, error)) {
+            sources.push_back(std::move(source));
+        }
+        return sources;
+    }
+
+    for (QScreen *screen : screenList) {
+#ifdef WIZ_HAVE_XSHM
+        // Each MIT-SHM source has its own display connection, so the screens
+        // can be grabbed at the same time
+        if (spec != "qscreen" && QGuiApplication::platformName() == "xcb") {
+            if (auto source = XShmFrameSource::create(nativeGeometry(screen))) {
+                sources.push_back(std::move(source));
+                continue;
+            }
+        }
+#endif
+        if (spec == "xshm") {
+            if (error) {
+                *error = "MIT-SHM capture is not available";
+            }
+            return FrameSources();
+        }
+        sources.push_back(std::make_unique<QScreenFrameSource>(screen));
+    }
+    return sources;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <QtCore/QRect>
+#include <QtCore/QString>
+#include <QtCore/QFile>
+#include <QtGui/QImage>
+#include <memory>
+#include <vector>
+
+class QScreen;
+
+// Supplies the pixels that ScreenCaptureThread reduces to a colour. Frames are
+// 32-bit (RGB32/ARGB32) images and may share the source's internal buffer, so
+// a frame is only valid until the next call to grab().
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    // Area that capture rects are clipped against
+    virtual QRect geometry() const = 0;
+
+    // Fills frame with the pixels inside rect, which lies within geometry()
+    virtual bool grab(const QRect &rect, QImage &frame) = 0;
+
+    virtual QString name() const = 0;
+};
+
+// Grabs from a live screen through QScreen::grabWindow
+class QScreenFrameSource : public FrameSource {
+public:
+    explicit QScreenFrameSource(QScreen *screen);
+
+    QRect geometry() const override;
+    bool grab(const QRect &rect, QImage &frame) override;
+    QString name() const override { return "screen"; }
+
+private:
+    QScreen *m_screen;
+};
+
+// Procedurally generated frames, so the pipeline can run without a display.
+// Every grab advances the animation by one frame.
+class SyntheticFrameSource : public FrameSource {
+public:
+    enum Pattern {
+        Gradient,   // Colour gradient scrolling across the screen
+        Flicker,    // Whole screen alternating between black and white
+        Noise       // Per-pixel random noise around a slowly drifting colour
+    };
+
+    SyntheticFrameSource(Pattern pattern, const QSize &size);
+
+    QRect geometry() const override { return QRect(QPoint(0, 0), m_size); }
+    bool grab(const QRect &rect, QImage &frame) override;
+    QString name() const override;
+
+private:
+    Pattern m_pattern;
+    QSize m_size;
+    QImage m_buffer;
+    quint64 m_frame;
+    quint32 m_noiseState;
+};
+
+// Plays back a file of raw BGRA frames (e.g. `ffmpeg -f rawvideo -pix_fmt bgra`),
+// looping at the end. The file is memory-mapped, so grabbing is zero-copy.
+class RawVideoFrameSource : public FrameSource {
+public:
+    RawVideoFrameSource(const QString &path, const QSize &size);
+    ~RawVideoFrameSource() override;
+
+    bool isValid() const { return m_data != nullptr && m_frameCount > 0; }
+    QString errorString() const { return m_error; }
+
+    QRect geometry() const override { return QRect(QPoint(0, 0), m_size); }
+    bool grab(const QRect &rect, QImage &frame) override;
+    QString name() const override;
+
+private:
+    QFile m_file;
+    QSize m_size;
+    uchar *m_data;
+    qint64 m_frameBytes;
+    qint64 m_frameCount;
+    qint64 m_frameIndex;
+    QString m_error;
+};
+
+// Creates a source from a command-line spec:
+//   screen                          primary screen, via MIT-SHM where available (default)
+//   xshm                            MIT-SHM only, fails instead of falling back
+//   qscreen                         QScreen::grabWindow only
+//   synthetic[:pattern[:WxH]]       pattern is gradient, flicker or noise
+//   raw:<path>:<WxH>                raw BGRA video file
+std::unique_ptr<FrameSource> createFrameSource(const QString &spec, QString *error = nullptr);
+
+typedef std::vector<std::unique_ptr<FrameSource>> FrameSources;
+
+// Like createFrameSource(), but screen, xshm and qscreen give one source per
+// screen, primary first, so each screen can be grabbed on its own thread.
+// Other specs give a single source.
+FrameSources createFrameSources(const QString &spec, QString *error = nullptr);
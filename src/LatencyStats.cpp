@@ -0,0 +1,217 @@
+#include "LatencyStats.h"
+
+#include <QtCore/QSaveFile>
+#include <QtCore/QTextStream>
+#include <QtCore/QtAlgorithms>
+#include <chrono>
+#include <cmath>
+
+#ifdef Q_OS_LINUX
+#include <time.h>
+#endif
+
+namespace {
+
+// Percentiles written out for every stage
+const double kPercentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+const char *const kPercentileNames[] = { "p50", "p90", "p99", "p999" };
+
+QString microseconds(double ns) {
+    return QString::number(ns / 1000.0, 'f', 3);
+}
+
+} // namespace
+
+qint64 monotonicNs() {
+#ifdef Q_OS_LINUX
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+LatencyHistogram::LatencyHistogram() {
+    for (int i = 0; i < kBuckets; ++i) {
+        m_buckets[i] = 0;
+    }
+    m_count = 0;
+    m_sum = 0;
+    m_max = 0;
+}
+
+int LatencyHistogram::bucketFor(qint64 ns) {
+    if (ns < kSubBuckets) {
+        return ns > 0 ? int(ns) : 0;
+    }
+
+    // Values in [2^n, 2^(n+1)) share one power of two, split into
+    // kSubBuckets linear steps
+    const int highestBit = 63 - int(qCountLeadingZeroBits(quint64(ns)));
+    const int shift = highestBit - kSubBucketBits;
+    return kSubBuckets * shift + int(ns >> shift);
+}
+
+qint64 LatencyHistogram::bucketLowerBound(int bucket) {
+    if (bucket < 2 * kSubBuckets) {
+        return bucket;
+    }
+    const int shift = bucket / kSubBuckets - 1;
+    return qint64(bucket % kSubBuckets + kSubBuckets) << shift;
+}
+
+void LatencyHistogram::record(qint64 ns) {
+    ns = qMax<qint64>(0, ns);
+    m_buckets[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(quint64(ns), std::memory_order_relaxed);
+
+    qint64 max = m_max.load(std::memory_order_relaxed);
+    while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::mean() const {
+    const quint64 values = count();
+    return values > 0 ? double(m_sum.load(std::memory_order_relaxed)) / values : 0;
+}
+
+qint64 LatencyHistogram::percentile(double fraction) const {
+    const quint64 values = count();
+    if (values == 0) {
+        return 0;
+    }
+
+    const quint64 wanted = qMax<quint64>(1, quint64(std::ceil(qBound(0.0, fraction, 1.0) * values)));
+    quint64 seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += bucketCount(i);
+        if (seen >= wanted) {
+            return bucketLowerBound(i);
+        }
+    }
+
+    // Buckets and count are read separately, so a racing record() can
+    // leave them a value apart
+    return max();
+}
+
+LatencyStats::LatencyStats() {
+    m_captured = 0;
+    m_emitted = 0;
+    m_sent = 0;
+    m_createdNs = monotonicNs();
+}
+
+const char *LatencyStats::stageName(Stage stage) {
+    switch (stage) {
+    case Grab: return "grab";
+    case Reduce: return "reduce";
+    case Emit: return "emit";
+    case Queue: return "queue";
+    case Correct: return "correct";
+    case Send: return "send";
+    case Total: return "total";
+    case Reply: return "reply";
+    case StageCount: break;
+    }
+    return "unknown";
+}
+
+void LatencyStats::recordSend(const FrameStamps &stamps, qint64 dequeued, qint64 corrected,
+                              qint64 written) {
+    record(Queue, dequeued - stamps.enqueued);
+    record(Correct, corrected - dequeued);
+    record(Send, written - corrected);
+    record(Total, written - stamps.grabStart);
+}
+
+QString LatencyStats::toCsv() const {
+    QString csv;
+    QTextStream out(&csv);
+
+    out << "stage,count,mean_us";
+    for (const char *name : kPercentileNames) {
+        out << "," << name << "_us";
+    }
+    out << ",max_us\n";
+
+    for (int stage = 0; stage < StageCount; ++stage) {
+        const LatencyHistogram &histogram = m_stages[stage];
+        out << stageName(Stage(stage)) << "," << histogram.count() << ","
+            << microseconds(histogram.mean());
+        for (double fraction : kPercentiles) {
+            out << "," << microseconds(histogram.percentile(fraction));
+        }
+        out << "," << microseconds(histogram.max()) << "\n";
+    }
+
+    out.flush();
+    return csv;
+}
+
+QString LatencyStats::toJson() const {
+    const double seconds = qMax<qint64>(1, monotonicNs() - m_createdNs) / 1e9;
+
+    QString json;
+    QTextStream out(&json);
+
+    out << "{\n";
+    out << "  \"seconds\": " << QString::number(seconds, 'f', 3) << ",\n";
+    out << "  \"capture_fps\": " << QString::number(captured() / seconds, 'f', 2) << ",\n";
+    out << "  \"emit_fps\": " << QString::number(emitted() / seconds, 'f', 2) << ",\n";
+    out << "  \"send_fps\": " << QString::number(sent() / seconds, 'f', 2) << ",\n";
+    out << "  \"stages\": {";
+
+    for (int stage = 0; stage < StageCount; ++stage) {
+        const LatencyHistogram &histogram = m_stages[stage];
+        out << (stage > 0 ? ",\n" : "\n");
+        out << "    \"" << stageName(Stage(stage)) << "\": {\n";
+        out << "      \"count\": " << histogram.count() << ",\n";
+        out << "      \"mean_us\": " << microseconds(histogram.mean()) << ",\n";
+        for (size_t i = 0; i < sizeof(kPercentiles) / sizeof(kPercentiles[0]); ++i) {
+            out << "      \"" << kPercentileNames[i] << "_us\": "
+                << microseconds(histogram.percentile(kPercentiles[i])) << ",\n";
+        }
+        out << "      \"max_us\": " << microseconds(histogram.max()) << ",\n";
+
+        // Lower bound in nanoseconds and count of every non-empty bucket
+        out << "      \"buckets\": [";
+        bool first = true;
+        for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+            const quint64 values = histogram.bucketCount(i);
+            if (values > 0) {
+                out << (first ? "" : ", ") << "[" << LatencyHistogram::bucketLowerBound(i)
+                    << ", " << values << "]";
+                first = false;
+            }
+        }
+        out << "]\n    }";
+    }
+
+    out << "\n  }\n}\n";
+    out.flush();
+    return json;
+}
+
+bool LatencyStats::save(const QString &path, QString *error) const {
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        if (error) {
+            *error = file.errorString();
+        }
+        return false;
+    }
+
+    const QString text = path.endsWith(".csv", Qt::CaseInsensitive) ? toCsv() : toJson();
+    file.write(text.toUtf8());
+    if (!file.commit()) {
+        if (error) {
+            *error = file.errorString();
+        }
+        return false;
+    }
+    return true;
+}
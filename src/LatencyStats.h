@@ -0,0 +1,99 @@
+#pragma once
+
+#include <QtCore/QString>
+#include <atomic>
+
+// Nanoseconds on a monotonic clock shared by every pipeline stage
+qint64 monotonicNs();
+
+// When a frame passed each point on the capture side, in monotonicNs()
+struct FrameStamps {
+    qint64 grabStart = 0;
+    qint64 grabEnd = 0;
+    qint64 reduced = 0;     // Zone colours worked out
+    qint64 enqueued = 0;    // Passed the threshold, about to be handed over
+};
+
+// Log-linear histogram of durations in the style of HdrHistogram: 32
+// linear sub-buckets per power of two keep every recorded value within about
+// 3% of its bucket's lower bound, from nanoseconds up to minutes. Recording
+// is lock-free and can happen on any thread.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(qint64 ns);
+
+    quint64 count() const { return m_count.load(std::memory_order_relaxed); }
+    qint64 max() const { return m_max.load(std::memory_order_relaxed); }
+    double mean() const;
+
+    // Lower bound of the bucket holding the given fraction (0-1) of values
+    qint64 percentile(double fraction) const;
+
+    static const int kSubBucketBits = 5;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kBuckets = kSubBuckets * (64 - kSubBucketBits);
+
+    static int bucketFor(qint64 ns);
+    static qint64 bucketLowerBound(int bucket);
+    quint64 bucketCount(int bucket) const { return m_buckets[bucket].load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<quint64> m_buckets[kBuckets];
+    std::atomic<quint64> m_count;
+    std::atomic<quint64> m_sum;
+    std::atomic<qint64> m_max;
+};
+
+// Where the time goes between grabbing a frame and its datagrams leaving,
+// plus how many frames made it through each stage
+class LatencyStats {
+public:
+    enum Stage {
+        Grab,       // Grab start to grab end
+        Reduce,     // Averaging zones
+        Emit,       // Threshold check
+        Queue,      // Hand-off through the ring to the sender thread
+        Correct,    // Waiting for an output tick, filtering and colour correction
+        Send,       // Formatting and writing the datagrams
+        Total,      // Grab start to datagrams written
+        Reply,      // Datagram written to the bulb's acknowledgement arriving
+        StageCount
+    };
+
+    LatencyStats();
+
+    static const char *stageName(Stage stage);
+
+    void record(Stage stage, qint64 ns) { m_stages[stage].record(ns); }
+    const LatencyHistogram &histogram(Stage stage) const { return m_stages[stage]; }
+
+    // Records the sender-side stages of a frame dequeued at dequeued,
+    // corrected by corrected and written by written
+    void recordSend(const FrameStamps &stamps, qint64 dequeued, qint64 corrected, qint64 written);
+
+    void countCaptured() { m_captured.fetch_add(1, std::memory_order_relaxed); }
+    void countEmitted() { m_emitted.fetch_add(1, std::memory_order_relaxed); }
+    void countSent() { m_sent.fetch_add(1, std::memory_order_relaxed); }
+
+    quint64 captured() const { return m_captured.load(std::memory_order_relaxed); }
+    quint64 emitted() const { return m_emitted.load(std::memory_order_relaxed); }
+    quint64 sent() const { return m_sent.load(std::memory_order_relaxed); }
+
+    // One row per stage with count, mean and percentiles in microseconds
+    QString toCsv() const;
+
+    // Frame rates since creation, per-stage summaries and non-empty buckets
+    QString toJson() const;
+
+    // Writes toJson(), or toCsv() for a path ending in .csv
+    bool save(const QString &path, QString *error = nullptr) const;
+
+private:
+    LatencyHistogram m_stages[StageCount];
+    std::atomic<quint64> m_captured;
+    std::atomic<quint64> m_emitted;
+    std::atomic<quint64> m_sent;
+    qint64 m_createdNs;
+};
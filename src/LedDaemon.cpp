@@ -0,0 +1,228 @@
+#include "LedDaemon.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QSocketNotifier>
+
+#include "FrameSource.h"
+#include "ReplayThread.h"
+#include "ScreenChangeWatcher.h"
+#include "ScreenCaptureThread.h"
+#include "SenderThread.h"
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef Q_OS_UNIX
+// Self-pipe: the handler only writes the signal number, and the notifier
+// picks it up on the event loop where it's safe to act on
+int g_signalSockets[2] = { -1, -1 };
+
+void signalHandler(int signal) {
+    const char number = char(signal);
+    const ssize_t written = ::write(g_signalSockets[0], &number, 1);
+    Q_UNUSED(written);
+}
+#endif
+
+} // namespace
+
+LedDaemon::LedDaemon(const QString &configPath, const QMap<QString, QString> &overrides,
+                     QObject *parent)
+    : QObject(parent), m_configPath(configPath), m_overrides(overrides), m_replayZones(0),
+      m_signalNotifier(nullptr) {
+    m_senderThread = new SenderThread(&m_settings, this);
+    m_senderThread->setLatencyStats(&m_latency);
+
+    m_captureThread = new ScreenCaptureThread(&m_settings, this);
+    m_captureThread->setLatencyStats(&m_latency);
+    connect(m_captureThread, &ScreenCaptureThread::coloursCaptured,
+            m_senderThread, &SenderThread::push, Qt::DirectConnection);
+    connect(m_captureThread, &ScreenCaptureThread::coloursCaptured, this,
+            [this](const QVector<QColor> &colours, const FrameStamps &stamps) {
+                if (m_recorder.isOpen()) {
+                    m_recorder.append(colours, stamps.grabStart);
+                }
+            }, Qt::DirectConnection);
+
+    m_replayThread = new ReplayThread(m_senderThread, this);
+    m_replayThread->setLatencyStats(&m_latency);
+}
+
+LedDaemon::~LedDaemon() {
+    stopProducer();
+    if (m_config.settings.idleFps > 0) {
+        const GovernorStats governor = m_captureThread->governorStats();
+        qInfo("Idle capture: %.1f s below %d FPS, %llu ramp-downs, %llu wake-ups",
+              governor.idleUs / 1e6, m_config.settings.fps, governor.rampDowns, governor.wakeUps);
+    }
+    m_senderThread->stopSending();
+    openRecorder(QString(), nullptr);
+}
+
+bool LedDaemon::start(QString *error) {
+    if (!loadDaemonConfig(m_configPath, m_overrides, &m_config, error) ||
+        !openSource(m_config.source, error) || !openRecorder(m_config.record, error)) {
+        return false;
+    }
+
+    watchChanges(m_config);
+    m_settings.publish(m_config.settings);
+    installSignalHandlers();
+
+    m_senderThread->startSending();
+    startProducer();
+
+    qInfo("Capturing %d zone(s) from %s for %d bulb(s)", m_config.settings.zones.size(),
+          qPrintable(m_config.source), m_config.settings.targets.size());
+    return true;
+}
+
+void LedDaemon::reload() {
+    DaemonConfig config;
+    QString error;
+    if (!loadDaemonConfig(m_configPath, m_overrides, &config, &error)) {
+        qWarning("Keeping current settings: %s", qPrintable(error));
+        return;
+    }
+
+    // A new source or recording means stopping capture to swap it; the
+    // sender keeps running with the bulbs' last colours
+    if (config.source != m_config.source || config.record != m_config.record ||
+        config.events != m_config.events) {
+        stopProducer();
+        if (config.source != m_config.source && !openSource(config.source, &error)) {
+            qWarning("Keeping source %s: %s", qPrintable(m_config.source), qPrintable(error));
+            config.source = m_config.source;
+            openSource(config.source, nullptr);
+        }
+        if (config.record != m_config.record && !openRecorder(config.record, &error)) {
+            qWarning("Not recording: %s", qPrintable(error));
+        }
+        watchChanges(config);
+        startProducer();
+    }
+
+    resolveZones(&config);
+    m_config = config;
+    m_settings.publish(m_config.settings);
+    m_senderThread->settingsChanged();
+
+    qInfo("Reloaded: %d zone(s) from %s for %d bulb(s)", m_config.settings.zones.size(),
+          qPrintable(m_config.source), m_config.settings.targets.size());
+}
+
+bool LedDaemon::openSource(const QString &spec, QString *error) {
+    if (spec.startsWith("replay:")) {
+        const bool fast = spec.endsWith(":fast");
+        const QString path = spec.mid(7, spec.size() - 7 - (fast ? 5 : 0));
+        if (!m_replayThread->open(path, error)) {
+            return false;
+        }
+        m_replayThread->setFast(fast);
+        m_replayZones = m_replayThread->recording().maxZones();
+        m_sourceGeometry = QRect();
+        resolveZones(&m_config);
+        return true;
+    }
+
+    FrameSources sources = createFrameSources(spec, error);
+    if (sources.empty()) {
+        return false;
+    }
+
+    // Edges and the centre zone go on the primary screen
+    m_replayZones = 0;
+    m_sourceGeometry = sources.front()->geometry();
+    resolveZones(&m_config);
+    m_captureThread->setFrameSources(std::move(sources));
+    return true;
+}
+
+// Capture sleeps until the screen changes where it can, unless told to poll
+void LedDaemon::watchChanges(const DaemonConfig &config) {
+    std::unique_ptr<ScreenChangeWatcher> watcher;
+    if (config.events) {
+        watcher = createScreenChangeWatcher(config.source);
+    }
+    if (watcher) {
+        qInfo("Capturing on %s events", qPrintable(watcher->name()));
+    }
+    m_captureThread->setChangeWatcher(std::move(watcher));
+}
+
+// Closes any recording in progress, then starts one at path unless it's empty
+bool LedDaemon::openRecorder(const QString &path, QString *error) {
+    if (m_recorder.isOpen()) {
+        qInfo("Recorded %llu frame(s), %llu bytes, to %s", m_recorder.frames(), m_recorder.bytes(),
+              qPrintable(m_recorder.fileName()));
+        m_recorder.close();
+    }
+    return path.isEmpty() || m_recorder.open(path, error);
+}
+
+void LedDaemon::resolveZones(DaemonConfig *config) const {
+    resolveDaemonZones(config, m_sourceGeometry);
+
+    // A replay has no screen to place zones on, but each recorded colour
+    // still gets a zone for its filter
+    QVector<CaptureZone> &zones = config->settings.zones;
+    if (m_replayZones > 0) {
+        zones.clear();
+        for (int i = 0; i < m_replayZones; ++i) {
+            zones.append(CaptureZone{ QString("replay %1").arg(i + 1), QRect(), config->filter });
+        }
+    }
+}
+
+void LedDaemon::startProducer() {
+    if (m_replayZones > 0) {
+        m_replayThread->startReplay();
+    } else {
+        m_captureThread->startCapture();
+    }
+}
+
+void LedDaemon::stopProducer() {
+    m_captureThread->stopCapture();
+    m_replayThread->stopReplay();
+}
+
+void LedDaemon::installSignalHandlers() {
+#ifdef Q_OS_UNIX
+    if (m_signalNotifier || ::socketpair(AF_UNIX, SOCK_STREAM, 0, g_signalSockets) != 0) {
+        return;
+    }
+
+    m_signalNotifier = new QSocketNotifier(g_signalSockets[1], QSocketNotifier::Read, this);
+    connect(m_signalNotifier, QOverload<QSocketDescriptor, QSocketNotifier::Type>::of(&QSocketNotifier::activated),
+            this, &LedDaemon::handleSignal);
+
+    struct sigaction action = {};
+    action.sa_handler = signalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGHUP, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+#endif
+}
+
+void LedDaemon::handleSignal() {
+#ifdef Q_OS_UNIX
+    char number = 0;
+    if (::read(g_signalSockets[1], &number, 1) != 1) {
+        return;
+    }
+
+    if (number == SIGHUP) {
+        reload();
+    } else {
+        QCoreApplication::quit();
+    }
+#endif
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QtCore/QMap>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include "ColourRecording.h"
+#include "DaemonConfig.h"
+#include "LatencyStats.h"
+#include "PipelineSettings.h"
+
+class QSocketNotifier;
+class ReplayThread;
+class ScreenCaptureThread;
+class SenderThread;
+
+// Runs the capture and send pipeline without any widgets, configured from a
+// file plus overrides. On Unix, SIGHUP reloads the configuration and
+// SIGINT/SIGTERM quit the application cleanly. A source of
+// replay:<path>[:fast] plays back a recording instead of capturing.
+class LedDaemon : public QObject {
+    Q_OBJECT
+public:
+    LedDaemon(const QString &configPath, const QMap<QString, QString> &overrides,
+              QObject *parent = nullptr);
+    ~LedDaemon() override;
+
+    // Loads the configuration and starts capturing
+    bool start(QString *error);
+
+    const LatencyStats &latencyStats() const { return m_latency; }
+
+public slots:
+    // Re-reads the config file, keeping the running settings if it's invalid
+    void reload();
+
+private slots:
+    void handleSignal();
+
+private:
+    bool openSource(const QString &spec, QString *error);
+    bool openRecorder(const QString &path, QString *error);
+    void watchChanges(const DaemonConfig &config);
+    void resolveZones(DaemonConfig *config) const;
+    void startProducer();
+    void stopProducer();
+    void installSignalHandlers();
+
+    QString m_configPath;
+    QMap<QString, QString> m_overrides;
+    DaemonConfig m_config;
+    QRect m_sourceGeometry;
+
+    // Zones in the recording being replayed, or 0 when capturing
+    int m_replayZones;
+
+    // Used by the threads, which are stopped before these go away
+    SettingsStore m_settings;
+    LatencyStats m_latency;
+    ScreenCaptureThread *m_captureThread;
+    ReplayThread *m_replayThread;
+    SenderThread *m_senderThread;
+
+    // Appended to on the capture thread, only opened while it's stopped
+    ColourRecorder m_recorder;
+    QSocketNotifier *m_signalNotifier;
+};
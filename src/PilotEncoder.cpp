@@ -0,0 +1,132 @@
+#include "PilotEncoder.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+// Decimal text of a number, padded so it copies as a single store
+struct Digits {
+    char text[4];
+    int length;
+};
+
+struct DigitTables {
+    Digits bytes[256];      // 0-255
+    char pairs[200];        // "00" to "99"
+
+    DigitTables() {
+        for (int value = 0; value < 256; ++value) {
+            Digits &digits = bytes[value];
+            std::memset(digits.text, 0, sizeof(digits.text));
+            digits.length = value >= 100 ? 3 : (value >= 10 ? 2 : 1);
+            for (int i = digits.length - 1, rest = value; i >= 0; --i, rest /= 10) {
+                digits.text[i] = char('0' + rest % 10);
+            }
+        }
+        for (int value = 0; value < 100; ++value) {
+            pairs[value * 2] = char('0' + value / 10);
+            pairs[value * 2 + 1] = char('0' + value % 10);
+        }
+    }
+};
+
+const DigitTables &digitTables() {
+    static const DigitTables tables;
+    return tables;
+}
+
+// Copies a literal without its NUL; the length is known at compile time,
+// so the copy is a few fixed-size stores
+template <size_t N>
+char *writeText(char *out, const char (&text)[N]) {
+    std::memcpy(out, text, N - 1);
+    return out + N - 1;
+}
+
+// Writes 0-255, and up to three bytes of padding after it
+char *writeByte(char *out, const DigitTables &tables, int value) {
+    const Digits &digits = tables.bytes[value];
+    std::memcpy(out, digits.text, sizeof(digits.text));
+    return out + digits.length;
+}
+
+// Writes value two digits at a time, from the end
+char *writeUnsigned(char *out, const DigitTables &tables, quint32 value) {
+    char text[10];
+    char *start = text + sizeof(text);
+    while (value >= 100) {
+        start -= 2;
+        std::memcpy(start, tables.pairs + (value % 100) * 2, 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        start -= 2;
+        std::memcpy(start, tables.pairs + value * 2, 2);
+    } else {
+        *--start = char('0' + value);
+    }
+
+    const size_t length = size_t(text + sizeof(text) - start);
+    std::memcpy(out, start, length);
+    return out + length;
+}
+
+} // namespace
+
+PilotEncoder::PilotEncoder(int brightness) {
+    setBrightness(brightness);
+}
+
+void PilotEncoder::setBrightness(int brightness) {
+    m_brightness = qBound(1, brightness, 100);
+
+    // Rendered with room for writeByte's padding, then trimmed to the tail
+    char tail[sizeof(m_tail) + 4];
+    char *out = writeText(tail, ",\"dimming\":");
+    out = writeByte(out, digitTables(), m_brightness);
+    out = writeText(out, "}}");
+    m_tailLength = int(out - tail);
+    std::memcpy(m_tail, tail, sizeof(m_tail));
+}
+
+int PilotEncoder::colour(char *buffer, quint32 id, int red, int green, int blue) const {
+    const DigitTables &tables = digitTables();
+    char *out = writeText(buffer, "{\"id\":");
+    out = writeUnsigned(out, tables, id);
+    out = writeText(out, ",\"method\":\"setPilot\",\"params\":{\"r\":");
+    out = writeByte(out, tables, red);
+    out = writeText(out, ",\"g\":");
+    out = writeByte(out, tables, green);
+    out = writeText(out, ",\"b\":");
+    out = writeByte(out, tables, blue);
+    std::memcpy(out, m_tail, sizeof(m_tail));
+    return int(out - buffer) + m_tailLength;
+}
+
+int PilotEncoder::temperature(char *buffer, quint32 id, int kelvin) const {
+    const DigitTables &tables = digitTables();
+    char *out = writeText(buffer, "{\"id\":");
+    out = writeUnsigned(out, tables, id);
+    out = writeText(out, ",\"method\":\"setPilot\",\"params\":{\"temp\":");
+    out = writeUnsigned(out, tables, quint32(qMax(0, kelvin)));
+    std::memcpy(out, m_tail, sizeof(m_tail));
+    return int(out - buffer) + m_tailLength;
+}
+
+// The tail without its leading comma
+int PilotEncoder::dimming(char *buffer, quint32 id) const {
+    char *out = writeText(buffer, "{\"id\":");
+    out = writeUnsigned(out, digitTables(), id);
+    out = writeText(out, ",\"method\":\"setPilot\",\"params\":{");
+    std::memcpy(out, m_tail + 1, sizeof(m_tail) - 1);
+    return int(out - buffer) + m_tailLength - 1;
+}
+
+int PilotEncoder::state(char *buffer, quint32 id, bool on) {
+    char *out = writeText(buffer, "{\"id\":");
+    out = writeUnsigned(out, digitTables(), id);
+    out = on ? writeText(out, ",\"method\":\"setState\",\"params\":{\"state\":true}}")
+             : writeText(out, ",\"method\":\"setState\",\"params\":{\"state\":false}}");
+    return int(out - buffer);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QtCore/QtGlobal>
+
+// Writes WiZ commands for one bulb into a datagram buffer without formatting
+// them. The text between fields is copied in whole, a colour channel is one
+// lookup into a table of rendered numbers, and the part that stays the same
+// for the bulb, its brightness, is rendered once into the command's tail. A
+// packet is then a handful of stores, with no allocation.
+//
+// Output is byte for byte what snprintf would make of the commands shown
+// below, e.g. UdpSender::formatPilot for colours. Buffers must hold
+// kMaxLength bytes, since writes may run a few bytes past the end of the
+// command; no NUL is written.
+class PilotEncoder {
+public:
+    static const int kMaxLength = 128;
+
+    explicit PilotEncoder(int brightness = 100);
+
+    // Brightness 1-100, which colour, temperature and dimming commands carry
+    void setBrightness(int brightness);
+    int brightness() const { return m_brightness; }
+
+    // Each returns the length of the command written to buffer
+
+    // {"id":7,"method":"setPilot","params":{"r":255,"g":128,"b":0,"dimming":60}}
+    // with each channel 0-255
+    int colour(char *buffer, quint32 id, int red, int green, int blue) const;
+
+    // {"id":7,"method":"setPilot","params":{"temp":2700,"dimming":60}}
+    int temperature(char *buffer, quint32 id, int kelvin) const;
+
+    // {"id":7,"method":"setPilot","params":{"dimming":60}}
+    int dimming(char *buffer, quint32 id) const;
+
+    // {"id":7,"method":"setState","params":{"state":true}}
+    static int state(char *buffer, quint32 id, bool on);
+
+private:
+    int m_brightness = 0;
+    char m_tail[16];        // ,"dimming":60}}
+    int m_tailLength = 0;
+};
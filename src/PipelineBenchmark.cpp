@@ -0,0 +1,242 @@
+#include "PipelineBenchmark.h"
+
+#include "RegionAverage.h"
+#include "ScreenCaptureThread.h"
+#include "SenderThread.h"
+
+#include <QtCore/QTimer>
+#include <QtCore/QTextStream>
+
+PipelineBenchmark::PipelineBenchmark(std::unique_ptr<FrameSource> source, const QString &ip,
+                                     int port, int captureSize, const QSize &zoneGrid,
+                                     QObject *parent)
+    : QObject(parent), m_ip(ip), m_port(port), m_captureSize(captureSize) {
+    m_sourceName = source->name();
+    const QRect geometry = source->geometry();
+    m_geometry = geometry;
+
+    // Either one zone in the centre, or a grid of zones covering the source
+    QVector<CaptureZone> zones;
+    if (zoneGrid.isEmpty()) {
+        const int size = captureSize;
+        zones.append(CaptureZone{ "centre", QRect(geometry.center().x() - size/2,
+                                                  geometry.center().y() - size/2, size, size),
+                                  FilterSettings() });
+    } else {
+        const int cellWidth = geometry.width() / zoneGrid.width();
+        const int cellHeight = geometry.height() / zoneGrid.height();
+        for (int row = 0; row < zoneGrid.height(); ++row) {
+            for (int column = 0; column < zoneGrid.width(); ++column) {
+                zones.append(CaptureZone{ QString("%1,%2").arg(column).arg(row),
+                                          QRect(geometry.x() + column * cellWidth,
+                                                geometry.y() + row * cellHeight,
+                                                cellWidth, cellHeight),
+                                          FilterSettings() });
+            }
+        }
+    }
+    m_zoneCount = zones.size();
+
+    // One bulb per zone, all at the same address
+    QVector<BulbTarget> targets;
+    for (int i = 0; i < zones.size(); ++i) {
+        BulbTarget target;
+        target.ip = ip;
+        target.port = quint16(port);
+        target.zone = i;
+        targets.append(target);
+    }
+
+    PipelineSettings settings;
+    settings.zones = zones;
+    settings.threshold = -1;
+    settings.fps = 0;
+    settings.targets = targets;
+    m_settings.publish(settings);
+
+    // A threshold of -1 emits every captured frame, so every frame pays for
+    // the whole pipeline. Frames reach the sender thread the same way they
+    // do in the GUI, so the sent rate shows how much of the capture rate
+    // the network side keeps up with.
+    m_senderThread = new SenderThread(&m_settings, this);
+    m_senderThread->setLatencyStats(&m_latency);
+
+    m_captureThread = new ScreenCaptureThread(&m_settings, this);
+    m_captureThread->setFrameSource(std::move(source));
+    m_captureThread->setLatencyStats(&m_latency);
+    connect(m_captureThread, &ScreenCaptureThread::coloursCaptured,
+            m_senderThread, &SenderThread::push, Qt::DirectConnection);
+    connect(m_captureThread, &QThread::finished, this, &PipelineBenchmark::report);
+}
+
+PipelineBenchmark::~PipelineBenchmark() {
+    m_captureThread->stopCapture();
+    m_senderThread->stopSending();
+}
+
+void PipelineBenchmark::setFrameRate(int fps) {
+    PipelineSettings settings = m_settings.current();
+    settings.fps = fps;
+    m_settings.publish(settings);
+}
+
+void PipelineBenchmark::setSmoothing(const FilterSettings &filter, int outputRate) {
+    PipelineSettings settings = m_settings.current();
+    for (CaptureZone &zone : settings.zones) {
+        zone.filter = filter;
+    }
+    settings.outputRate = outputRate;
+    m_settings.publish(settings);
+}
+
+void PipelineBenchmark::setBulbRateLimit(int perSecond) {
+    PipelineSettings settings = m_settings.current();
+    settings.bulbRateLimit = perSecond;
+    m_settings.publish(settings);
+}
+
+void PipelineBenchmark::setSampleBudget(int budget) {
+    PipelineSettings settings = m_settings.current();
+    settings.sampleBudget = budget;
+    m_settings.publish(settings);
+}
+
+void PipelineBenchmark::setReducer(ColourReducer reducer) {
+    PipelineSettings settings = m_settings.current();
+    settings.reducer = reducer;
+    m_settings.publish(settings);
+}
+
+void PipelineBenchmark::setEdges(const EdgeLayout &layout) {
+    PipelineSettings settings = m_settings.current();
+    const FilterSettings filter = settings.zones.isEmpty() ? FilterSettings() : settings.zones.first().filter;
+    settings.zones = edgeZones(layout, m_geometry, filter);
+    settings.summedAreaScale = layout.scale;
+
+    settings.targets.clear();
+    for (int i = 0; i < settings.zones.size(); ++i) {
+        BulbTarget target;
+        target.ip = m_ip;
+        target.port = quint16(m_port);
+        target.zone = i;
+        settings.targets.append(target);
+    }
+    m_settings.publish(settings);
+
+    m_edges = layout;
+    m_zoneCount = settings.zones.size();
+}
+
+void PipelineBenchmark::setChangeGate(ChangeMetric metric, float deltaE) {
+    PipelineSettings settings = m_settings.current();
+    settings.threshold = PipelineSettings().threshold;
+    settings.changeMetric = metric;
+    settings.deltaEThreshold = deltaE;
+    m_settings.publish(settings);
+}
+
+void PipelineBenchmark::start(int seconds) {
+    m_timer.start();
+    m_senderThread->startSending();
+    m_captureThread->startCapture();
+    QTimer::singleShot(seconds * 1000, this, &PipelineBenchmark::stop);
+}
+
+void PipelineBenchmark::stop() {
+    m_captureThread->requestStop();
+}
+
+void PipelineBenchmark::report() {
+    m_senderThread->stopSending();
+
+    const double seconds = m_timer.nsecsElapsed() / 1e9;
+    const quint64 captured = m_captureThread->capturedFrames();
+    const quint64 sent = m_senderThread->sentFrames();
+    const FrameTiming timing = m_captureThread->frameTiming();
+    const FrameTiming::Stats pacing = timing.since(FrameTiming());
+
+    QTextStream out(stdout);
+    out << "Source:        " << m_sourceName << "\n";
+    out << "Average:       " << averageKernelName(bestAverageKernel()) << "\n";
+    if (m_settings.current().reducer != ColourReducer::Mean) {
+        out << "Reducer:       " << colourReducerName(m_settings.current().reducer) << "\n";
+    }
+    if (!m_edges.isEmpty()) {
+        out << "Edges:         " << edgeLayoutSpec(m_edges) << ", " << m_edges.depth << "% deep, "
+            << m_edges.scale << " px cells\n";
+    } else if (m_zoneCount > 1) {
+        out << "Zones:         " << m_zoneCount << "\n";
+    } else {
+        out << "Capture size:  " << m_captureSize << "x" << m_captureSize << "\n";
+    }
+    out << "Target:        " << m_ip << ":" << m_port << "\n";
+    const PipelineSettings settings = m_settings.current();
+    if (settings.sampleBudget > 0) {
+        out << "Sampling:      " << settings.sampleBudget << " px per zone, within "
+            << QString::number(samplingErrorBound(settings.sampleBudget), 'f', 1) << " levels\n";
+    }
+    if (!settings.zones.isEmpty() && settings.zones.first().filter.type != FilterSettings::None) {
+        out << "Filter:        " << filterSpec(settings.zones.first().filter) << "\n";
+    }
+    if (settings.changeMetric != ChangeMetric::Rgb) {
+        out << "Change gate:   " << changeMetricName(settings.changeMetric) << " > "
+            << QString::number(settings.deltaEThreshold, 'f', 1) << ", "
+            << m_captureThread->suppressedFrames() << " sends suppressed and "
+            << m_captureThread->addedFrames() << " added vs rgb > " << settings.threshold << "\n";
+    }
+    if (settings.outputRate > 0) {
+        out << "Output rate:   " << settings.outputRate << " FPS\n";
+    }
+    if (settings.bulbRateLimit > 0) {
+        out << "Bulb limit:    " << settings.bulbRateLimit << " updates/s, burst "
+            << settings.bulbBurst << "\n";
+    }
+    out << "Duration:      " << QString::number(seconds, 'f', 2) << " s\n";
+    out << "Captured:      " << captured << " frames ("
+        << QString::number(captured / seconds, 'f', 1) << " FPS)\n";
+    out << "Sent:          " << sent << " frames ("
+        << QString::number(sent / seconds, 'f', 1) << " FPS)\n";
+    out << "Skipped:       " << m_senderThread->skippedFrames() << " superseded, "
+        << m_senderThread->droppedFrames() << " dropped\n";
+    out << "Bulb updates:  " << m_senderThread->coalescedUpdates() << " coalesced, "
+        << m_senderThread->droppedUpdates() << " dropped\n";
+    BulbLinkStats replies;
+    for (const BulbLinkStats &link : m_senderThread->linkStats()) {
+        replies.sent += link.sent;
+        replies.acknowledged += link.acknowledged;
+        replies.lost += link.lost;
+        replies.retransmits += link.retransmits;
+        replies.maxRttMs = qMax(replies.maxRttMs, link.maxRttMs);
+        replies.rttMs += link.rttMs * link.acknowledged;
+    }
+    if (replies.acknowledged > 0) {
+        out << "Replies:       " << replies.acknowledged << " of " << replies.sent << " acknowledged, "
+            << replies.lost << " lost, " << replies.retransmits << " retransmitted\n";
+        out << "Round trip:    " << QString::number(replies.rttMs / replies.acknowledged, 'f', 2) << " ms mean, "
+            << QString::number(replies.maxRttMs, 'f', 2) << " ms max\n";
+    }
+    if (captured > 0) {
+        out << "Per frame:     " << QString::number(seconds * 1e6 / captured, 'f', 2) << " us\n";
+    }
+    if (settings.fps > 0) {
+        out << "Interval:      " << QString::number(pacing.meanIntervalUs, 'f', 1) << " us mean, "
+            << QString::number(pacing.jitterUs, 'f', 1) << " us jitter\n";
+        out << "Lateness:      " << QString::number(pacing.meanLatenessUs, 'f', 1) << " us mean, "
+            << timing.maxLatenessUs << " us max, " << pacing.skipped << " frames skipped\n";
+    }
+
+    out << "Latency:       p50 / p99 / max in us\n";
+    for (int stage = 0; stage < LatencyStats::StageCount; ++stage) {
+        const LatencyHistogram &histogram = m_latency.histogram(LatencyStats::Stage(stage));
+        if (histogram.count() == 0) {
+            continue;
+        }
+        out << "  " << QString(LatencyStats::stageName(LatencyStats::Stage(stage))).leftJustified(12)
+            << QString::number(histogram.percentile(0.5) / 1000.0, 'f', 1) << " / "
+            << QString::number(histogram.percentile(0.99) / 1000.0, 'f', 1) << " / "
+            << QString::number(histogram.max() / 1000.0, 'f', 1) << "\n";
+    }
+    out.flush();
+
+    emit finished();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QSize>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <QElapsedTimer>
+#include <memory>
+
+#include "EdgeLayout.h"
+#include "FrameSource.h"
+#include "LatencyStats.h"
+#include "PipelineSettings.h"
+
+class ScreenCaptureThread;
+class SenderThread;
+
+// Runs the capture -> average -> correct -> send pipeline for a fixed time
+// and prints its throughput. Needs no widgets, and no display at
+// all when used with a synthetic or raw video source.
+class PipelineBenchmark : public QObject {
+    Q_OBJECT
+public:
+    // With a non-empty zoneGrid the source is split into that many columns
+    // and rows of zones, each sent to its own (loopback) bulb
+    PipelineBenchmark(std::unique_ptr<FrameSource> source, const QString &ip, int port,
+                      int captureSize, const QSize &zoneGrid, QObject *parent = nullptr);
+    ~PipelineBenchmark() override;
+
+    // Paces capture at fps instead of running unthrottled
+    void setFrameRate(int fps);
+
+    // Smooths every zone with filter, sending outputRate times a second
+    void setSmoothing(const FilterSettings &filter, int outputRate);
+
+    // Caps each bulb at perSecond updates, 0 for no limit
+    void setBulbRateLimit(int perSecond);
+
+    // Reads about budget pixels per zone instead of all of them, 0 for all
+    void setSampleBudget(int budget);
+
+    // Picks how each zone's pixels become one colour
+    void setReducer(ColourReducer reducer);
+
+    // Replaces the zones with segments along the source's edges, each sent
+    // to its own bulb and averaged through a summed-area table
+    void setEdges(const EdgeLayout &layout);
+
+    // Emits only frames that move a zone by more than deltaE under metric,
+    // instead of every frame, and reports how many sends that saved against
+    // the default RGB threshold
+    void setChangeGate(ChangeMetric metric, float deltaE);
+
+    void start(int seconds);
+
+    const LatencyStats &latencyStats() const { return m_latency; }
+
+signals:
+    void finished();
+
+private slots:
+    void stop();
+    void report();
+
+private:
+    SettingsStore m_settings;
+    LatencyStats m_latency;
+    ScreenCaptureThread *m_captureThread;
+    SenderThread *m_senderThread;
+    QString m_sourceName;
+    QString m_ip;
+    int m_port;
+    int m_captureSize;
+    int m_zoneCount;
+    QRect m_geometry;
+    EdgeLayout m_edges;
+    QElapsedTimer m_timer;
+};
@@ -0,0 +1,101 @@
+#include "PipelineSettings.h"
+
+#include <QtGlobal>
+
+SettingsStore::SettingsStore() {
+    m_current = new PipelineSettings;
+    m_version = 0;
+    for (int i = 0; i < kMaxReaders; ++i) {
+        m_hazards[i] = nullptr;
+        m_slotUsed[i] = false;
+    }
+}
+
+SettingsStore::~SettingsStore() {
+    // All readers must be gone by now
+    delete m_current.load();
+    for (const PipelineSettings *snapshot : m_retired) {
+        delete snapshot;
+    }
+}
+
+void SettingsStore::publish(const PipelineSettings &settings) {
+    QMutexLocker locker(&m_writeMutex);
+
+    PipelineSettings *snapshot = new PipelineSettings(settings);
+    snapshot->version = m_version.load() + 1;
+
+    m_retired.push_back(m_current.exchange(snapshot));
+    m_version.store(snapshot->version, std::memory_order_release);
+
+    reclaim();
+}
+
+PipelineSettings SettingsStore::current() const {
+    QMutexLocker locker(&m_writeMutex);
+    return *m_current.load();
+}
+
+int SettingsStore::claimSlot() {
+    for (int i = 0; i < kMaxReaders; ++i) {
+        bool expected = false;
+        if (m_slotUsed[i].compare_exchange_strong(expected, true)) {
+            return i;
+        }
+    }
+    qFatal("SettingsStore: more than %d readers", kMaxReaders);
+}
+
+void SettingsStore::releaseSlot(int slot) {
+    m_hazards[slot].store(nullptr);
+    m_slotUsed[slot].store(false);
+}
+
+// Frees retired snapshots that no reader has announced as in use. Called
+// with the write mutex held.
+void SettingsStore::reclaim() {
+    auto inUse = [this](const PipelineSettings *snapshot) {
+        for (int i = 0; i < kMaxReaders; ++i) {
+            if (m_hazards[i].load() == snapshot) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    auto it = m_retired.begin();
+    while (it != m_retired.end()) {
+        if (inUse(*it)) {
+            ++it;
+        } else {
+            delete *it;
+            it = m_retired.erase(it);
+        }
+    }
+}
+
+SettingsReader::SettingsReader(SettingsStore *store)
+    : m_store(store), m_slot(store->claimSlot()), m_snapshot(nullptr) {
+}
+
+SettingsReader::~SettingsReader() {
+    m_store->releaseSlot(m_slot);
+}
+
+const PipelineSettings &SettingsReader::acquire() {
+    if (m_snapshot && m_snapshot->version == m_store->m_version.load(std::memory_order_acquire)) {
+        return *m_snapshot;
+    }
+
+    // Announce the snapshot before using it, then check it is still current.
+    // If the writer swapped it out in between, it may already have decided
+    // to free it, so retry with the new one.
+    const PipelineSettings *snapshot;
+    do {
+        snapshot = m_store->m_current.load();
+        m_store->m_hazards[m_slot].store(snapshot);
+    } while (snapshot != m_store->m_current.load());
+
+    m_snapshot = snapshot;
+    return *m_snapshot;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <QtCore/QRect>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QMutex>
+#include <atomic>
+#include <vector>
+
+#include "ColourCorrection.h"
+#include "ColourDifference.h"
+#include "RegionAverage.h"
+#include "TemporalFilter.h"
+
+// A named screen region reduced to one colour per frame
+struct CaptureZone {
+    QString name;
+    QRect rect;
+    FilterSettings filter;
+
+    bool operator==(const CaptureZone &other) const {
+        return name == other.name && rect == other.rect && filter == other.filter;
+    }
+    bool operator!=(const CaptureZone &other) const { return !(*this == other); }
+};
+
+// A WiZ bulb to drive
+struct BulbTarget {
+    QString ip;
+    quint16 port = 38899;
+    int brightness = 100;
+    int zone = 0;           // Index of the capture zone whose colour it shows
+
+    bool operator==(const BulbTarget &other) const {
+        return ip == other.ip && port == other.port &&
+               brightness == other.brightness && zone == other.zone;
+    }
+    bool operator!=(const BulbTarget &other) const { return !(*this == other); }
+};
+
+// Everything the capture and send pipeline reads while running. Snapshots
+// are immutable once published, so the pipeline can read them without locks.
+struct PipelineSettings {
+    QVector<CaptureZone> zones;
+    int sampleBudget = 0;   // Pixels read per zone and frame, 0 to read them all
+    ColourReducer reducer = ColourReducer::Mean;
+    // Zone means from a summed-area table with cells this many pixels
+    // across, or 0 to reduce each zone on its own. Mean reducer only.
+    int summedAreaScale = 0;
+    int threshold = 3;      // Minimum sum of RGB differences worth sending
+    ChangeMetric changeMetric = ChangeMetric::Rgb;
+    float deltaEThreshold = 2.3f;   // Minimum ΔE worth sending, for the ΔE metrics
+    int fps = 60;           // Capture rate, 0 for unthrottled
+    // Rate capture falls to while nothing changes past the threshold, 0 to
+    // always capture at fps. Needs a capture rate.
+    int idleFps = 0;
+    int outputRate = 0;     // Filtered colours sent per second, 0 to follow capture
+    ColourCorrection correction;
+    QVector<BulbTarget> targets;
+    int brightness = 100;   // Default for bulbs without their own
+    int bulbRateLimit = 0;  // Updates per second per bulb, 0 for no limit
+    int bulbBurst = 2;      // Updates a bulb may take back to back within its limit
+
+    // Assigned by SettingsStore::publish and increasing with every snapshot,
+    // so readers can cheaply tell when to rebuild state derived from it
+    quint64 version = 0;
+};
+
+// Publishes settings snapshots RCU-style: the writer swaps in a new snapshot
+// with an atomic pointer exchange, and readers pick it up through a
+// SettingsReader without ever blocking. A replaced snapshot is freed once
+// no reader still holds it.
+class SettingsStore {
+public:
+    SettingsStore();
+    ~SettingsStore();
+
+    // Replaces the current snapshot with a copy of settings. Writers are
+    // serialised with a mutex, which readers never touch.
+    void publish(const PipelineSettings &settings);
+
+    // Copy of the current snapshot, for writers that modify and republish it
+    PipelineSettings current() const;
+
+    quint64 version() const { return m_version.load(std::memory_order_acquire); }
+
+private:
+    friend class SettingsReader;
+
+    static const int kMaxReaders = 8;
+
+    int claimSlot();
+    void releaseSlot(int slot);
+    void reclaim();
+
+    std::atomic<const PipelineSettings *> m_current;
+    std::atomic<quint64> m_version;
+
+    // Snapshot each reader is using (its hazard pointer), or null
+    std::atomic<const PipelineSettings *> m_hazards[kMaxReaders];
+    std::atomic<bool> m_slotUsed[kMaxReaders];
+
+    mutable QMutex m_writeMutex;
+    std::vector<const PipelineSettings *> m_retired;
+};
+
+// A single thread's view of a SettingsStore. The snapshot returned by
+// acquire() stays valid until that thread's next acquire() or until the
+// reader is destroyed.
+class SettingsReader {
+public:
+    explicit SettingsReader(SettingsStore *store);
+    ~SettingsReader();
+
+    SettingsReader(const SettingsReader &) = delete;
+    SettingsReader &operator=(const SettingsReader &) = delete;
+
+    // Latest snapshot. When nothing was published since the last call this
+    // is a single atomic load.
+    const PipelineSettings &acquire();
+
+private:
+    SettingsStore *m_store;
+    int m_slot;
+    const PipelineSettings *m_snapshot;
+};
@@ -0,0 +1,504 @@
+#include "RegionAverage.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define WIZ_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 instructions inside functions that opt in, so
+// the rest of the binary still runs on CPUs without it. MSVC needs no flag.
+#if defined(__GNUC__) || defined(__clang__)
+#define WIZ_TARGET(isa) __attribute__((target(isa)))
+#else
+#define WIZ_TARGET(isa)
+#endif
+
+namespace {
+
+// Mixes a cell's coordinates into 32 well-spread bits (lowbias32)
+quint32 cellHash(quint32 row, quint32 column) {
+    quint32 h = row * 0x9e3779b9u ^ column;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+void sumPixelsScalar(const QRgb *pixels, int count, ChannelSums &sums) {
+    quint64 rTotal = 0, gTotal = 0, bTotal = 0;
+    for (int x = 0; x < count; ++x) {
+        QRgb pixel = pixels[x];
+        rTotal += qRed(pixel);
+        gTotal += qGreen(pixel);
+        bTotal += qBlue(pixel);
+    }
+    sums.red += rTotal;
+    sums.green += gTotal;
+    sums.blue += bTotal;
+}
+
+#ifdef WIZ_X86_SIMD
+
+// Each kernel masks one channel out of the packed pixels and lets PSADBW add
+// up the remaining bytes against zero. SAD ignores byte positions, so this
+// yields exact per-channel sums in 64-bit lanes that cannot overflow.
+
+WIZ_TARGET("sse2")
+quint64 horizontalSum(__m128i v) {
+    alignas(16) quint64 lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), v);
+    return lanes[0] + lanes[1];
+}
+
+WIZ_TARGET("sse2")
+void sumPixelsSse2(const QRgb *pixels, int count, ChannelSums &sums) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i redMask = _mm_set1_epi32(0x00ff0000);
+    const __m128i greenMask = _mm_set1_epi32(0x0000ff00);
+    const __m128i blueMask = _mm_set1_epi32(0x000000ff);
+
+    __m128i red = zero, green = zero, blue = zero;
+
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + x));
+        red = _mm_add_epi64(red, _mm_sad_epu8(_mm_and_si128(p, redMask), zero));
+        green = _mm_add_epi64(green, _mm_sad_epu8(_mm_and_si128(p, greenMask), zero));
+        blue = _mm_add_epi64(blue, _mm_sad_epu8(_mm_and_si128(p, blueMask), zero));
+    }
+
+    sums.red += horizontalSum(red);
+    sums.green += horizontalSum(green);
+    sums.blue += horizontalSum(blue);
+
+    sumPixelsScalar(pixels + x, count - x, sums);
+}
+
+WIZ_TARGET("avx2")
+void sumPixelsAvx2(const QRgb *pixels, int count, ChannelSums &sums) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i redMask = _mm256_set1_epi32(0x00ff0000);
+    const __m256i greenMask = _mm256_set1_epi32(0x0000ff00);
+    const __m256i blueMask = _mm256_set1_epi32(0x000000ff);
+
+    __m256i red = zero, green = zero, blue = zero;
+
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + x));
+        red = _mm256_add_epi64(red, _mm256_sad_epu8(_mm256_and_si256(p, redMask), zero));
+        green = _mm256_add_epi64(green, _mm256_sad_epu8(_mm256_and_si256(p, greenMask), zero));
+        blue = _mm256_add_epi64(blue, _mm256_sad_epu8(_mm256_and_si256(p, blueMask), zero));
+    }
+
+    alignas(32) quint64 lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), red);
+    sums.red += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), green);
+    sums.green += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), blue);
+    sums.blue += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    sumPixelsScalar(pixels + x, count - x, sums);
+}
+
+bool cpuSupportsAvx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+
+    // The OS must save the YMM registers (OSXSAVE + XCR0 bits 1 and 2)
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool cpuSupportsSse2() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif // WIZ_X86_SIMD
+
+// Calls visit with one pixel from each cell of a grid of about budget
+// cells shaped like rect, and returns how many it visited
+template<typename Visit>
+quint64 forEachSample(const QImage &image, const QRect &rect, int budget, Visit visit) {
+    const int columns = qBound(1, int(std::lround(std::sqrt(double(budget) * rect.width() / rect.height()))),
+                               rect.width());
+    const int rows = qBound(1, budget / columns, rect.height());
+
+    for (int row = 0; row < rows; ++row) {
+        const int top = rect.top() + int(qint64(row) * rect.height() / rows);
+        const int cellHeight = rect.top() + int(qint64(row + 1) * rect.height() / rows) - top;
+
+        for (int column = 0; column < columns; ++column) {
+            const int left = rect.left() + int(qint64(column) * rect.width() / columns);
+            const int cellWidth = rect.left() + int(qint64(column + 1) * rect.width() / columns) - left;
+
+            // Same spot in a cell every frame, so a still image gives a
+            // still colour; multiply-shift scales the hash into the cell
+            const quint32 hash = cellHash(quint32(row), quint32(column));
+            const int x = left + int((quint64(hash & 0xffff) * quint64(cellWidth)) >> 16);
+            const int y = top + int((quint64(hash >> 16) * quint64(cellHeight)) >> 16);
+
+            visit(reinterpret_cast<const QRgb *>(image.constScanLine(y))[x]);
+        }
+    }
+    return quint64(rows) * quint64(columns);
+}
+
+} // namespace
+
+bool averageKernelSupported(AverageKernel kernel) {
+    switch (kernel) {
+    case AverageKernel::Scalar:
+        return true;
+#ifdef WIZ_X86_SIMD
+    case AverageKernel::Sse2:
+        return cpuSupportsSse2();
+    case AverageKernel::Avx2:
+        return cpuSupportsAvx2();
+#else
+    case AverageKernel::Sse2:
+    case AverageKernel::Avx2:
+        break;
+#endif
+    }
+    return false;
+}
+
+const char *averageKernelName(AverageKernel kernel) {
+    switch (kernel) {
+    case AverageKernel::Scalar: return "scalar";
+    case AverageKernel::Sse2: return "sse2";
+    case AverageKernel::Avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+AverageKernel bestAverageKernel() {
+    static const AverageKernel best = []() {
+        if (averageKernelSupported(AverageKernel::Avx2)) {
+            return AverageKernel::Avx2;
+        }
+        if (averageKernelSupported(AverageKernel::Sse2)) {
+            return AverageKernel::Sse2;
+        }
+        return AverageKernel::Scalar;
+    }();
+    return best;
+}
+
+void sumPixels(AverageKernel kernel, const QRgb *pixels, int count, ChannelSums &sums) {
+    sums.count += count;
+
+    switch (kernel) {
+#ifdef WIZ_X86_SIMD
+    case AverageKernel::Sse2:
+        sumPixelsSse2(pixels, count, sums);
+        return;
+    case AverageKernel::Avx2:
+        sumPixelsAvx2(pixels, count, sums);
+        return;
+#endif
+    default:
+        sumPixelsScalar(pixels, count, sums);
+        return;
+    }
+}
+
+ChannelSums sumImage(const QImage &image, AverageKernel kernel) {
+    return sumImage(image, image.rect(), kernel);
+}
+
+ChannelSums sumImage(const QImage &image, const QRect &rect, AverageKernel kernel) {
+    ChannelSums sums;
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        sumPixels(kernel, line + rect.left(), rect.width(), sums);
+    }
+    return sums;
+}
+
+ChannelSums sampleImage(const QImage &image, const QRect &rect, int budget) {
+    const qint64 area = qint64(rect.width()) * rect.height();
+    if (budget <= 0 || area <= budget) {
+        return sumImage(image, rect);
+    }
+
+    ChannelSums sums;
+    quint64 rTotal = 0, gTotal = 0, bTotal = 0;
+    sums.count = forEachSample(image, rect, budget, [&](QRgb pixel) {
+        rTotal += qRed(pixel);
+        gTotal += qGreen(pixel);
+        bTotal += qBlue(pixel);
+    });
+    sums.red = rTotal;
+    sums.green = gTotal;
+    sums.blue = bTotal;
+    return sums;
+}
+
+double samplingErrorBound(int budget) {
+    // Three standard errors of at most 127.5 / sqrt(n)
+    return budget > 0 ? 3 * 127.5 / std::sqrt(double(budget)) : 0;
+}
+
+QColor meanColour(const ChannelSums &sums) {
+    if (sums.count == 0) {
+        return QColor(0, 0, 0);
+    }
+
+    return QColor(
+        sums.red / sums.count,
+        sums.green / sums.count,
+        sums.blue / sums.count
+    );
+}
+
+QColor averageColour(const QImage &image) {
+    return averageColour(image, image.rect());
+}
+
+QColor averageColour(const QImage &image, const QRect &rect) {
+    return meanColour(sumImage(image, rect));
+}
+
+QColor sampledColour(const QImage &image, const QRect &rect, int budget) {
+    return meanColour(sampleImage(image, rect, budget));
+}
+
+const char *colourReducerName(ColourReducer reducer) {
+    switch (reducer) {
+    case ColourReducer::Mean: return "mean";
+    case ColourReducer::Dominant: return "dominant";
+    case ColourReducer::Vivid: return "vivid";
+    }
+    return "unknown";
+}
+
+ColourReducer parseColourReducer(const QString &name, bool *ok) {
+    const QString key = name.trimmed().toLower();
+    for (ColourReducer reducer : { ColourReducer::Mean, ColourReducer::Dominant, ColourReducer::Vivid }) {
+        if (key == colourReducerName(reducer)) {
+            if (ok) {
+                *ok = true;
+            }
+            return reducer;
+        }
+    }
+    if (ok) {
+        *ok = false;
+    }
+    return ColourReducer::Mean;
+}
+
+ColourHistogram::ColourHistogram() : m_count(0) {
+}
+
+void ColourHistogram::clear() {
+    for (quint16 index : m_touched) {
+        m_bins[index] = Bin{ 0, 0, 0, 0 };
+    }
+    m_touched.clear();
+    m_count = 0;
+}
+
+inline void ColourHistogram::addPixel(QRgb pixel) {
+    const int r = qRed(pixel), g = qGreen(pixel), b = qBlue(pixel);
+    const quint16 index = quint16(((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3));
+    Bin &bin = m_bins[index];
+    if (bin.count++ == 0) {
+        m_touched.push_back(index);
+    }
+    bin.red += quint64(r);
+    bin.green += quint64(g);
+    bin.blue += quint64(b);
+}
+
+void ColourHistogram::add(const QImage &image, const QRect &rect, int budget) {
+    if (m_bins.empty()) {
+        m_bins.assign(1 << 15, Bin{ 0, 0, 0, 0 });
+        m_touched.reserve(m_bins.size());
+    }
+
+    const qint64 area = qint64(rect.width()) * rect.height();
+    if (budget > 0 && area > budget) {
+        m_count += forEachSample(image, rect, budget, [this](QRgb pixel) { addPixel(pixel); });
+        return;
+    }
+
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y)) + rect.left();
+        for (int x = 0; x < rect.width(); ++x) {
+            addPixel(line[x]);
+        }
+    }
+    m_count += quint64(area);
+}
+
+QColor ColourHistogram::dominantColour(ColourReducer reducer) const {
+    if (m_touched.empty()) {
+        return QColor(0, 0, 0);
+    }
+
+    int best = m_touched.front();
+    quint64 bestScore = 0;
+    for (quint16 index : m_touched) {
+        const Bin &bin = m_bins[index];
+        quint64 score = bin.count;
+        if (reducer == ColourReducer::Vivid) {
+            const quint32 r = quint32(bin.red / bin.count), g = quint32(bin.green / bin.count),
+                          b = quint32(bin.blue / bin.count);
+            const quint32 chroma = qMax(r, qMax(g, b)) - qMin(r, qMin(g, b));
+            score *= chroma + 32;
+        }
+        if (score > bestScore) {
+            bestScore = score;
+            best = index;
+        }
+    }
+
+    // Pool the neighbourhood's exact sums
+    const int r0 = best >> 10, g0 = (best >> 5) & 31, b0 = best & 31;
+    quint64 count = 0, red = 0, green = 0, blue = 0;
+    for (int r = qMax(0, r0 - 1); r <= qMin(31, r0 + 1); ++r) {
+        for (int g = qMax(0, g0 - 1); g <= qMin(31, g0 + 1); ++g) {
+            for (int b = qMax(0, b0 - 1); b <= qMin(31, b0 + 1); ++b) {
+                const Bin &bin = m_bins[size_t((r << 10) | (g << 5) | b)];
+                count += bin.count;
+                red += bin.red;
+                green += bin.green;
+                blue += bin.blue;
+            }
+        }
+    }
+
+    return QColor(int(red / count), int(green / count), int(blue / count));
+}
+
+QColor reduceColour(const QImage &image, const QRect &rect, ColourReducer reducer, int budget,
+                    ColourHistogram &histogram) {
+    if (reducer == ColourReducer::Mean) {
+        return sampledColour(image, rect, budget);
+    }
+
+    histogram.clear();
+    histogram.add(image, rect, budget);
+    return histogram.dominantColour(reducer);
+}
+
+SummedAreaTable::SummedAreaTable()
+    : m_scale(1), m_columns(0), m_rows(0), m_width(0), m_height(0) {
+}
+
+void SummedAreaTable::build(const QImage &image, int scale) {
+    m_scale = qMax(1, scale);
+    m_width = image.width();
+    m_height = image.height();
+    m_columns = (m_width + m_scale - 1) / m_scale;
+    m_rows = (m_height + m_scale - 1) / m_scale;
+
+    const size_t stride = size_t(m_columns) + 1;
+    m_cells.resize(stride * (size_t(m_rows) + 1));
+    m_row.resize(size_t(m_columns));
+    std::fill(m_cells.begin(), m_cells.begin() + stride, Cell{ 0, 0, 0 });
+
+    for (int row = 0; row < m_rows; ++row) {
+        // Shrink: total up this row of cells over its scale lines of pixels
+        std::fill(m_row.begin(), m_row.end(), Cell{ 0, 0, 0 });
+        const int lastLine = qMin(m_height, (row + 1) * m_scale);
+        for (int y = row * m_scale; y < lastLine; ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            for (int column = 0, x = 0; column < m_columns; ++column) {
+                const int end = qMin(m_width, x + m_scale);
+                quint32 red = 0, green = 0, blue = 0;
+                for (; x < end; ++x) {
+                    const QRgb pixel = line[x];
+                    red += (pixel >> 16) & 0xff;
+                    green += (pixel >> 8) & 0xff;
+                    blue += pixel & 0xff;
+                }
+                Cell &cell = m_row[size_t(column)];
+                cell.red += red;
+                cell.green += green;
+                cell.blue += blue;
+            }
+        }
+
+        // Integrate: each cell is the row's running total plus the cell above
+        const Cell *above = &m_cells[size_t(row) * stride];
+        Cell *current = &m_cells[size_t(row + 1) * stride];
+        current[0] = Cell{ 0, 0, 0 };
+        Cell running = { 0, 0, 0 };
+        for (int column = 0; column < m_columns; ++column) {
+            const Cell &cell = m_row[size_t(column)];
+            running.red += cell.red;
+            running.green += cell.green;
+            running.blue += cell.blue;
+            current[column + 1] = Cell{ above[column + 1].red + running.red,
+                                        above[column + 1].green + running.green,
+                                        above[column + 1].blue + running.blue };
+        }
+    }
+}
+
+void SummedAreaTable::cellSpan(int start, int end, int length, int cells, int scale, int *first, int *last) {
+    *first = qBound(0, (start + scale / 2) / scale, cells - 1);
+    *last = end >= length ? cells : qBound(*first + 1, (end + scale / 2) / scale, cells);
+}
+
+ChannelSums SummedAreaTable::sum(const QRect &rect) const {
+    ChannelSums sums;
+    const QRect clipped = rect.intersected(QRect(0, 0, m_width, m_height));
+    if (clipped.isEmpty() || m_columns == 0 || m_rows == 0) {
+        return sums;
+    }
+
+    int left, right, top, bottom;
+    cellSpan(clipped.left(), clipped.right() + 1, m_width, m_columns, m_scale, &left, &right);
+    cellSpan(clipped.top(), clipped.bottom() + 1, m_height, m_rows, m_scale, &top, &bottom);
+
+    // Inclusion-exclusion over the four corners
+    const size_t stride = size_t(m_columns) + 1;
+    const Cell &a = m_cells[size_t(top) * stride + size_t(left)];
+    const Cell &b = m_cells[size_t(top) * stride + size_t(right)];
+    const Cell &c = m_cells[size_t(bottom) * stride + size_t(left)];
+    const Cell &d = m_cells[size_t(bottom) * stride + size_t(right)];
+    sums.red = d.red - b.red - c.red + a.red;
+    sums.green = d.green - b.green - c.green + a.green;
+    sums.blue = d.blue - b.blue - c.blue + a.blue;
+
+    // The last row and column of cells may be cut short by the image edge
+    const int width = qMin(m_width, right * m_scale) - left * m_scale;
+    const int height = qMin(m_height, bottom * m_scale) - top * m_scale;
+    sums.count = quint64(width) * quint64(height);
+    return sums;
+}
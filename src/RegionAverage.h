@@ -0,0 +1,163 @@
+#pragma once
+
+#include <QtCore/QString>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+#include <vector>
+
+// Per-channel totals of a block of pixels
+struct ChannelSums {
+    quint64 red = 0;
+    quint64 green = 0;
+    quint64 blue = 0;
+    quint64 count = 0;
+};
+
+// Implementations of the per-row channel sum. Scalar is the reference; the
+// SIMD kernels must produce bit-identical sums and are only used when the
+// CPU supports them.
+enum class AverageKernel {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+bool averageKernelSupported(AverageKernel kernel);
+const char *averageKernelName(AverageKernel kernel);
+
+// Fastest kernel supported by this CPU, detected once via CPUID
+AverageKernel bestAverageKernel();
+
+// Adds count packed 32-bit pixels to sums
+void sumPixels(AverageKernel kernel, const QRgb *pixels, int count, ChannelSums &sums);
+
+// Sums a 32-bit image row by row
+ChannelSums sumImage(const QImage &image, AverageKernel kernel = bestAverageKernel());
+
+// Sums the part of a 32-bit image inside rect, which must lie within it
+ChannelSums sumImage(const QImage &image, const QRect &rect,
+                     AverageKernel kernel = bestAverageKernel());
+
+// Sums about budget pixels of rect instead of all of them, so the cost stays
+// the same however large the rect. The rect is split into a grid of budget
+// cells shaped like it and one pixel is read from each, at a fixed
+// pseudo-random spot within the cell so regular content such as text or
+// dithering can't alias with the grid. Rects with no more than budget
+// pixels, or a budget <= 0, are summed in full.
+ChannelSums sampleImage(const QImage &image, const QRect &rect, int budget);
+
+// How far, in levels per channel, the mean of budget stratified samples may
+// stray from the full mean: three standard errors, so 99.7% of frames stay
+// within it for any content uncorrelated with the sampling pattern.
+// Stratifying is never worse than independent samples, whose standard
+// error is at most 127.5 / sqrt(n) levels since channels span 0-255.
+double samplingErrorBound(int budget);
+
+// Mean colour of the summed pixels, black if there are none
+QColor meanColour(const ChannelSums &sums);
+
+// Mean colour of a 32-bit image (or the part inside rect), black if empty
+QColor averageColour(const QImage &image);
+QColor averageColour(const QImage &image, const QRect &rect);
+
+// As averageColour(), reading at most about budget pixels when budget > 0
+QColor sampledColour(const QImage &image, const QRect &rect, int budget);
+
+// How a zone's pixels become one colour
+enum class ColourReducer {
+    Mean,       // Average of every pixel
+    Dominant,   // Most common colour cluster
+    Vivid       // Most common cluster, favouring colourful ones over greys
+};
+
+const char *colourReducerName(ColourReducer reducer);
+
+// Parses "mean", "dominant" or "vivid"
+ColourReducer parseColourReducer(const QString &name, bool *ok = nullptr);
+
+// Colour histogram with 32 levels per channel (5-5-5 bins), filled in one
+// pass over the pixels. Each bin also keeps the exact sums of its pixels,
+// so the colour picked from it isn't rounded to the bin. The 1 MB of bins is
+// allocated on first use, and only bins touched since the last clear() are
+// reset, which keeps small regions cheap. Sums are 64-bit: 32 bits would
+// overflow past 16 million pixels, such as a whole 8K screen.
+class ColourHistogram {
+public:
+    ColourHistogram();
+
+    void clear();
+
+    // Adds the pixels of rect, or about budget of them when budget > 0
+    void add(const QImage &image, const QRect &rect, int budget = 0);
+
+    quint64 count() const { return m_count; }
+
+    // Mean colour of the fullest bin and its 26 neighbours, so a colour
+    // straddling a bin edge still counts as one cluster. Vivid scores bins
+    // by count times (chroma + 32), so a colourful cluster wins over a grey
+    // one up to about nine times its size. Black if empty.
+    QColor dominantColour(ColourReducer reducer) const;
+
+private:
+    struct Bin {
+        quint64 count;
+        quint64 red;
+        quint64 green;
+        quint64 blue;
+    };
+
+    void addPixel(QRgb pixel);
+
+    std::vector<Bin> m_bins;
+    std::vector<quint16> m_touched;
+    quint64 m_count;
+};
+
+// Reduces rect to one colour with reducer, reading about budget pixels when
+// budget > 0. histogram is scratch space for the histogram reducers.
+QColor reduceColour(const QImage &image, const QRect &rect, ColourReducer reducer, int budget,
+                    ColourHistogram &histogram);
+
+// Summed-area table of a 32-bit image shrunk by an integer scale: each cell
+// holds the channel totals of every pixel above and to the left of it. It is
+// built in one pass over the image, after which the totals of any rect take
+// four lookups per channel however large the rect, so many overlapping
+// zones cost no more than one. Rect edges are rounded to the nearest cell.
+// Totals are 64-bit: 32 bits would overflow on rects past 16 million pixels,
+// such as a whole 8K screen.
+class SummedAreaTable {
+public:
+    SummedAreaTable();
+
+    // Rebuilds the table for image, reusing its storage
+    void build(const QImage &image, int scale);
+
+    // Cells across and down
+    QSize size() const { return QSize(m_columns, m_rows); }
+
+    // Totals of the pixels in rect (image coordinates), which must overlap
+    // the image, widened to at least one cell
+    ChannelSums sum(const QRect &rect) const;
+
+    QColor meanColour(const QRect &rect) const { return ::meanColour(sum(rect)); }
+
+private:
+    struct Cell {
+        quint64 red;
+        quint64 green;
+        quint64 blue;
+    };
+
+    // Cell span covering pixels [start, end) of length, rounded to the
+    // nearest cell edges and at least one cell wide; a span reaching the
+    // image edge keeps the last, partial cell
+    static void cellSpan(int start, int end, int length, int cells, int scale, int *first, int *last);
+
+    std::vector<Cell> m_cells;      // (columns + 1) x (rows + 1), zero first row and column
+    std::vector<Cell> m_row;        // One row of cell totals, while building
+    int m_scale;
+    int m_columns;
+    int m_rows;
+    int m_width;
+    int m_height;
+};
@@ -0,0 +1,80 @@
+#include "ReplayThread.h"
+
+#include "FrameScheduler.h"
+#include "SenderThread.h"
+
+namespace {
+
+// How long fast replay sleeps on a full ring before checking it should stop
+const int kRoomWaitMs = 100;
+
+} // namespace
+
+ReplayThread::ReplayThread(SenderThread *sender, QObject *parent)
+    : QThread(parent), m_sender(sender), m_latency(nullptr), m_fast(false) {
+    m_active = false;
+    m_replayedFrames = 0;
+    m_loops = 0;
+}
+
+ReplayThread::~ReplayThread() {
+    m_active = false;
+    wait();
+}
+
+bool ReplayThread::open(const QString &path, QString *error) {
+    return m_recording.open(path, error);
+}
+
+void ReplayThread::startReplay() {
+    if (!m_active && m_recording.isOpen()) {
+        m_active = true;
+        if (!isRunning()) {
+            start(QThread::HighPriority);
+        }
+    }
+}
+
+void ReplayThread::stopReplay() {
+    m_active = false;
+    wait();
+}
+
+void ReplayThread::run() {
+    QVector<QColor> colours;
+    m_recording.rewind();
+
+    // The next loop starts one average frame after the last frame of this one
+    const int frames = m_recording.frameCount();
+    const qint64 loopNs = m_recording.durationNs() +
+                          (frames > 1 ? m_recording.durationNs() / (frames - 1) : 0);
+    qint64 loopStart = monotonicNs();
+
+    while (m_active) {
+        qint64 offset = 0;
+        if (!m_recording.next(colours, &offset)) {
+            m_recording.rewind();
+            loopStart += loopNs;
+            ++m_loops;
+            continue;
+        }
+
+        if (!m_fast) {
+            sleepUntilNs(loopStart + offset);
+        }
+
+        FrameStamps stamps;
+        stamps.grabStart = stamps.grabEnd = stamps.reduced = stamps.enqueued = monotonicNs();
+        if (m_latency) {
+            m_latency->countCaptured();
+            m_latency->countEmitted();
+        }
+
+        // Fast replay waits for room rather than dropping frames, asleep
+        // until the sender drains the ring
+        while (m_fast && m_active && !m_sender->waitForRoom(kRoomWaitMs)) {
+        }
+        m_sender->push(colours, stamps);
+        ++m_replayedFrames;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QThread>
+#include <QtCore/QString>
+#include <atomic>
+
+#include "ColourRecording.h"
+#include "LatencyStats.h"
+
+class SenderThread;
+
+// Feeds a recorded colour stream to the sender in place of capture, looping
+// at the end. Paced, each frame goes out at its recorded offset from the
+// start of the loop; fast, frames go out as quickly as the sender's ring
+// takes them, for load testing.
+class ReplayThread : public QThread {
+    Q_OBJECT
+public:
+    // sender must outlive the thread, and nothing else may push() to it
+    // while the replay runs
+    explicit ReplayThread(SenderThread *sender, QObject *parent = nullptr);
+    ~ReplayThread() override;
+
+    // Replaces the recording; only call while the replay is stopped
+    bool open(const QString &path, QString *error);
+    const ColourRecording &recording() const { return m_recording; }
+
+    void setFast(bool fast) { m_fast = fast; }
+
+    // Counts frames into stats as captured and emitted; only call while the
+    // replay is stopped
+    void setLatencyStats(LatencyStats *stats) { m_latency = stats; }
+
+    quint64 replayedFrames() const { return m_replayedFrames; }
+    quint64 loops() const { return m_loops; }
+
+    void startReplay();
+    void stopReplay();
+
+protected:
+    void run() override;
+
+private:
+    SenderThread *m_sender;
+    LatencyStats *m_latency;
+    ColourRecording m_recording;
+    bool m_fast;
+    std::atomic<bool> m_active;
+    std::atomic<quint64> m_replayedFrames;
+    std::atomic<quint64> m_loops;
+};
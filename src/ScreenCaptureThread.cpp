@@ -0,0 +1,426 @@
+#include "ScreenCaptureThread.h"
+
+#include <QtCore/QSemaphore>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QImage>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include "ColourDifference.h"
+#include "RegionAverage.h"
+
+// Platform-specific includes
+#ifdef Q_OS_WIN
+#include <windows.h>
+#elif defined(Q_OS_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+// Below this many pixels in total, handing zones to the thread pool costs
+// more than reducing them on the capture thread
+const qint64 kParallelReducePixels = 256 * 256;
+
+// Longest a change watcher is waited on, which bounds how long new settings
+// and stopping take to be noticed on a static screen
+const int kChangeWaitMs = 100;
+
+// A wait longer than this slept, rather than finding a change waiting
+const qint64 kChangeWaitSleptNs = 1000000;
+
+struct ZoneJob {
+    int zone;       // Index into the settings' zones
+    QRect rect;     // Relative to the grabbed image
+    QColor colour;
+    ColourHistogram histogram;
+};
+
+// The zones on one source, captured from a single grab of their bounds
+struct ScreenGroup {
+    FrameSource *source = nullptr;
+    QRect bounds;
+    QVector<ZoneJob> jobs;
+    qint64 totalPixels = 0;
+
+    // Set before each frame
+    bool wanted = false;        // Has zones that changed, or may have
+    int sampleBudget = 0;
+    ColourReducer reducer = ColourReducer::Mean;
+    int summedAreaScale = 0;
+
+    QImage image;
+    SummedAreaTable summedArea;
+    bool grabbed = false;
+    qint64 grabEnd = 0;
+
+    // Grabs the bounds and reduces every zone, leaving the zones' last
+    // colours alone if the grab fails
+    void capture();
+};
+
+void ScreenGroup::capture() {
+    grabbed = !bounds.isEmpty() && source->grab(bounds, image) && !image.isNull();
+    grabEnd = monotonicNs();
+    if (!grabbed) {
+        return;
+    }
+
+    const QImage &frame = image;
+    const int budget = sampleBudget;
+    const ColourReducer zoneReducer = reducer;
+    auto reduce = [&frame, budget, zoneReducer](ZoneJob &job) {
+        job.colour = job.rect.isEmpty() ? QColor(0, 0, 0)
+                                        : reduceColour(frame, job.rect, zoneReducer, budget, job.histogram);
+    };
+
+    // Means of many zones over a large area, such as screen edges, come
+    // cheaper from one pass building a summed-area table
+    if (summedAreaScale > 0 && reducer == ColourReducer::Mean) {
+        summedArea.build(image, summedAreaScale);
+        for (ZoneJob &job : jobs) {
+            job.colour = job.rect.isEmpty() ? QColor(0, 0, 0) : summedArea.meanColour(job.rect);
+        }
+    } else if (jobs.size() > 1 && totalPixels >= kParallelReducePixels) {
+        QtConcurrent::blockingMap(jobs, reduce);
+    } else {
+        for (ZoneJob &job : jobs) {
+            reduce(job);
+        }
+    }
+}
+
+// Captures one screen's group each time it's told to begin, so the screens
+// are grabbed side by side rather than one after another
+class ScreenWorker : public QThread {
+public:
+    explicit ScreenWorker(ScreenGroup *group) : m_group(group), m_stopping(false) {}
+
+    ~ScreenWorker() override {
+        m_stopping = true;
+        m_start.release();
+        wait();
+    }
+
+    void begin() { m_start.release(); }
+    void finish() { m_done.acquire(); }
+
+protected:
+    void run() override {
+        for (;;) {
+            m_start.acquire();
+            if (m_stopping) {
+                return;
+            }
+            m_group->capture();
+            m_done.release();
+        }
+    }
+
+private:
+    ScreenGroup *m_group;
+    QSemaphore m_start;
+    QSemaphore m_done;
+    std::atomic<bool> m_stopping;
+};
+
+// The group whose source contains the centre of rect, or else the one it
+// overlaps most. Zones off every screen go to the first and come out black.
+int groupFor(const QRect &rect, const std::vector<ScreenGroup> &groups) {
+    int best = 0;
+    qint64 bestArea = 0;
+    for (int i = 0; i < int(groups.size()); ++i) {
+        const QRect geometry = groups[i].source->geometry();
+        if (geometry.contains(rect.center())) {
+            return i;
+        }
+        const QRect overlap = geometry.intersected(rect);
+        const qint64 area = qint64(overlap.width()) * overlap.height();
+        if (area > bestArea) {
+            best = i;
+            bestArea = area;
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+ScreenCaptureThread::ScreenCaptureThread(SettingsStore *settings, QObject *parent)
+    : QThread(parent), m_settings(settings), m_latency(nullptr) {
+    qRegisterMetaType<QVector<QColor>>();
+
+    m_active = false;
+    m_capturedFrames = 0;
+    m_suppressedFrames = 0;
+    m_addedFrames = 0;
+    m_idleWaits = 0;
+}
+
+ScreenCaptureThread::~ScreenCaptureThread() {
+    m_active = false;
+    wait();
+}
+
+void ScreenCaptureThread::setFrameSources(FrameSources sources) {
+    m_sources = std::move(sources);
+}
+
+void ScreenCaptureThread::setChangeWatcher(std::unique_ptr<ScreenChangeWatcher> watcher) {
+    m_watcher = std::move(watcher);
+}
+
+void ScreenCaptureThread::setFrameSource(std::unique_ptr<FrameSource> source) {
+    m_sources.clear();
+    if (source) {
+        m_sources.push_back(std::move(source));
+    }
+}
+
+void ScreenCaptureThread::startCapture() {
+    if (!m_active) {
+        m_active = true;
+        if (!isRunning()) {
+            start(QThread::HighPriority);
+        }
+    }
+}
+
+void ScreenCaptureThread::stopCapture() {
+    m_active = false;
+    wait();
+}
+
+bool ScreenCaptureThread::coloursChanged(const QVector<QColor> &last,
+                                         const QVector<QColor> &current, int threshold) {
+    if (last.size() != current.size()) {
+        return true;
+    }
+    for (int i = 0; i < current.size(); ++i) {
+        const QColor &now = current[i];
+        const QColor &before = last[i];
+        if (qAbs(now.red() - before.red()) + qAbs(now.green() - before.green()) +
+            qAbs(now.blue() - before.blue()) > threshold) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ScreenCaptureThread::run() {
+    // Set maximum thread priority
+    #ifdef Q_OS_WIN
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+    #elif defined(Q_OS_LINUX)
+    struct sched_param param;
+    param.sched_priority = sched_get_priority_max(SCHED_RR);
+    pthread_setschedparam(pthread_self(), SCHED_RR, &param);
+    #endif
+
+    if (m_sources.empty()) {
+        m_sources = createFrameSources("screen");
+        if (m_sources.empty()) return;
+        m_watcher = createScreenChangeWatcher("screen");
+    }
+
+    SettingsReader settingsReader(m_settings);
+    quint64 settingsVersion = 0;
+
+    QVector<QColor> lastColours;
+    QVector<QColor> colours;
+
+    // The frame before, for the governor, which idles once consecutive
+    // frames stop differing past the threshold
+    QVector<QColor> previousColours;
+
+    // This frame's, the frame before's and the last sent colours in Lab,
+    // kept while a ΔE metric is in use so each frame is converted once.
+    // Left empty under RGB, which counts as a change when switching to ΔE.
+    QVector<LabColour> lab;
+    QVector<LabColour> previousLab;
+    QVector<LabColour> lastLab;
+
+    // Zones in desktop coordinates for the watcher, and which it saw change
+    QVector<QRect> zoneRects;
+    QVector<bool> changedZones;
+    bool captureAll = true;
+
+    // The first screen is captured on this thread and the others on workers
+    std::vector<ScreenGroup> groups(m_sources.size());
+    std::vector<std::unique_ptr<ScreenWorker>> workers;
+    for (size_t i = 0; i < groups.size(); ++i) {
+        groups[i].source = m_sources[i].get();
+        if (i > 0) {
+            workers.push_back(std::make_unique<ScreenWorker>(&groups[i]));
+            workers.back()->start(QThread::HighPriority);
+        }
+    }
+
+    m_scheduler.restart();
+
+    while (m_active) {
+        const PipelineSettings &settings = settingsReader.acquire();
+
+        // Work out each screen's grab and the zone rects within it only
+        // when they change
+        if (settings.version != settingsVersion) {
+            settingsVersion = settings.version;
+            captureAll = true;
+
+            zoneRects.resize(settings.zones.size());
+            for (int i = 0; i < settings.zones.size(); ++i) {
+                zoneRects[i] = settings.zones[i].rect;
+            }
+
+            for (ScreenGroup &group : groups) {
+                group.bounds = QRect();
+                group.jobs.clear();
+                group.totalPixels = 0;
+            }
+            for (int i = 0; i < settings.zones.size(); ++i) {
+                ScreenGroup &group = groups[groupFor(settings.zones[i].rect, groups)];
+                ZoneJob job;
+                job.zone = i;
+                job.rect = settings.zones[i].rect.intersected(group.source->geometry());
+                job.colour = QColor(0, 0, 0);
+                group.bounds |= job.rect;
+                group.jobs.append(job);
+            }
+            for (ScreenGroup &group : groups) {
+                for (ZoneJob &job : group.jobs) {
+                    job.rect.translate(-group.bounds.topLeft());
+                    const qint64 area = qint64(job.rect.width()) * job.rect.height();
+                    group.totalPixels += settings.sampleBudget > 0 ? qMin<qint64>(area, settings.sampleBudget)
+                                                                   : area;
+                }
+            }
+        }
+
+        m_governor.setRates(settings.fps, settings.idleFps);
+        m_scheduler.setRate(m_governor.rate());
+
+        // Event-driven, sleep until a zone changes; every zone is captured
+        // once at the start and whenever the zones move
+        if (m_watcher && !captureAll) {
+            const qint64 waitStart = monotonicNs();
+            if (!m_watcher->waitForChanges(zoneRects, kChangeWaitMs, changedZones)) {
+                ++m_idleWaits;
+                continue;
+            }
+            // After sleeping, the frame starts a new grid rather than
+            // counting the pause as skipped frames
+            if (monotonicNs() - waitStart > kChangeWaitSleptNs) {
+                m_scheduler.restart();
+            }
+            for (ScreenGroup &group : groups) {
+                group.wanted = false;
+                for (const ZoneJob &job : group.jobs) {
+                    group.wanted |= changedZones[job.zone];
+                }
+            }
+        } else {
+            for (ScreenGroup &group : groups) {
+                group.wanted = !group.jobs.isEmpty();
+            }
+            captureAll = false;
+        }
+
+        m_scheduler.waitForNextFrame();
+
+        for (ScreenGroup &group : groups) {
+            group.sampleBudget = settings.sampleBudget;
+            group.reducer = settings.reducer;
+            group.summedAreaScale = settings.summedAreaScale;
+            group.grabbed = false;
+        }
+
+        FrameStamps stamps;
+        stamps.grabStart = monotonicNs();
+        for (size_t i = 1; i < groups.size(); ++i) {
+            if (groups[i].wanted) {
+                workers[i - 1]->begin();
+            }
+        }
+        if (groups[0].wanted) {
+            groups[0].capture();
+        }
+        for (size_t i = 1; i < groups.size(); ++i) {
+            if (groups[i].wanted) {
+                workers[i - 1]->finish();
+            }
+        }
+
+        // A screen that failed to grab keeps its zones' last colours, and
+        // the grab stage lasts until the slowest screen's grab returned
+        bool grabbed = false;
+        stamps.grabEnd = stamps.grabStart;
+        for (const ScreenGroup &group : groups) {
+            if (group.grabbed) {
+                grabbed = true;
+                stamps.grabEnd = qMax(stamps.grabEnd, group.grabEnd);
+            }
+        }
+        if (!grabbed) {
+            captureAll = true;
+            if (m_scheduler.rate() == 0) {
+                QThread::msleep(1);
+            }
+            continue;
+        }
+
+        ++m_capturedFrames;
+
+        colours.resize(settings.zones.size());
+        for (const ScreenGroup &group : groups) {
+            for (const ZoneJob &job : group.jobs) {
+                colours[job.zone] = job.colour;
+            }
+        }
+
+        stamps.reduced = monotonicNs();
+        if (m_latency) {
+            m_latency->countCaptured();
+            m_latency->record(LatencyStats::Grab, stamps.grabEnd - stamps.grabStart);
+            m_latency->record(LatencyStats::Reduce, stamps.reduced - stamps.grabEnd);
+        }
+
+        // Only emit if a zone's colour changed significantly. The RGB gate is
+        // still checked under a ΔE metric, to count where the two disagree.
+        // The governor gets the same test against the frame before, so
+        // noise under the threshold doesn't hold the full rate.
+        bool changed = coloursChanged(lastColours, colours, settings.threshold);
+        bool moved = coloursChanged(previousColours, colours, settings.threshold);
+        if (settings.changeMetric != ChangeMetric::Rgb) {
+            toLab(colours, lab);
+            const bool rgbChanged = changed;
+            changed = coloursDiffer(lastLab, lab, settings.changeMetric, settings.deltaEThreshold);
+            moved = coloursDiffer(previousLab, lab, settings.changeMetric, settings.deltaEThreshold);
+            if (rgbChanged && !changed) {
+                ++m_suppressedFrames;
+            } else if (changed && !rgbChanged) {
+                ++m_addedFrames;
+            }
+        } else {
+            lab.clear();
+        }
+
+        // A change from the frame before brings the rate straight back up,
+        // and the grid restarts from now so the next frame isn't held to the
+        // idle rate's deadline
+        m_governor.frame(stamps.grabStart, moved);
+        previousColours = colours;
+        previousLab.swap(lab);
+
+        if (changed) {
+            lastColours = colours;
+            lastLab = previousLab;
+
+            stamps.enqueued = monotonicNs();
+            if (m_latency) {
+                m_latency->countEmitted();
+                m_latency->record(LatencyStats::Emit, stamps.enqueued - stamps.reduced);
+            }
+            emit coloursCaptured(colours, stamps);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QThread>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <atomic>
+#include <memory>
+
+#include "CaptureGovernor.h"
+#include "FrameScheduler.h"
+#include "FrameSource.h"
+#include "LatencyStats.h"
+#include "PipelineSettings.h"
+#include "ScreenChangeWatcher.h"
+
+// High-priority thread for screen capture. The zones on each screen are
+// reduced from a single grab of their bounding box, and each frame is
+// emitted as one colour per zone. With several screens, each one is grabbed
+// and reduced on a worker thread of its own, all at the same time.
+class ScreenCaptureThread : public QThread {
+    Q_OBJECT
+public:
+    // Zones, threshold and frame rate are read from the latest snapshot in
+    // settings, which must outlive the thread. Zones are in screen
+    // coordinates, and a frame is emitted when any zone's colour moves more
+    // than the threshold under the settings' change metric.
+    ScreenCaptureThread(SettingsStore *settings, QObject *parent = nullptr);
+    ~ScreenCaptureThread() override;
+
+    // Replaces the pixel sources, normally one per screen; only call while
+    // capture is stopped. Without any, every screen is used. A zone is
+    // captured from the source containing its centre, or else the one it
+    // overlaps most, and clipped to it.
+    void setFrameSources(FrameSources sources);
+    void setFrameSource(std::unique_ptr<FrameSource> source);
+
+    // With a watcher, the loop sleeps until something changes inside a zone
+    // and only grabs the screens whose zones changed, instead of grabbing
+    // every frame; only call while capture is stopped. Without one, capture
+    // polls at its frame rate. Sources set without a watcher are polled,
+    // and with no sources set, every screen is watched where possible.
+    void setChangeWatcher(std::unique_ptr<ScreenChangeWatcher> watcher);
+
+    // Waits on the watcher that timed out with nothing changed in a zone
+    quint64 idleWaits() const { return m_idleWaits; }
+
+    // Records capture stage timings and frame counts into stats, which must
+    // outlive the thread; only call while capture is stopped
+    void setLatencyStats(LatencyStats *stats) { m_latency = stats; }
+
+    // Frames grabbed since the thread was created, whether emitted or not
+    quint64 capturedFrames() const { return m_capturedFrames; }
+
+    // With a ΔE change metric, frames the RGB threshold would have emitted
+    // but ΔE held back, and frames ΔE emitted that RGB would have held back.
+    // Both compare against the last emitted colours.
+    quint64 suppressedFrames() const { return m_suppressedFrames; }
+    quint64 addedFrames() const { return m_addedFrames; }
+
+    // Pacing of the capture loop against the configured frame rate
+    FrameTiming frameTiming() const { return m_scheduler.timing(); }
+
+    // How far the rate has dropped on still content, with an idle rate set
+    GovernorStats governorStats() const { return m_governor.stats(); }
+
+    void startCapture();
+    void stopCapture();
+
+    // Asks the capture loop to exit without waiting for it, for callers that
+    // must keep their event loop running until finished() is emitted
+    void requestStop() { m_active = false; }
+
+    // Whether any zone's colour moved more than threshold (sum of RGB
+    // differences) since last, or the number of zones changed
+    static bool coloursChanged(const QVector<QColor> &last, const QVector<QColor> &current,
+                               int threshold);
+
+signals:
+    // One colour per zone, in zone order, and when the frame passed each
+    // capture stage
+    void coloursCaptured(const QVector<QColor> &colours, const FrameStamps &stamps);
+
+protected:
+    void run() override;
+
+private:
+    SettingsStore *m_settings;
+    LatencyStats *m_latency;
+    std::atomic<bool> m_active;
+    std::atomic<quint64> m_capturedFrames;
+    std::atomic<quint64> m_suppressedFrames;
+    std::atomic<quint64> m_addedFrames;
+    std::atomic<quint64> m_idleWaits;
+    FrameSources m_sources;
+    std::unique_ptr<ScreenChangeWatcher> m_watcher;
+    FrameScheduler m_scheduler;
+    CaptureGovernor m_governor;
+};
@@ -0,0 +1,19 @@
+#include "ScreenChangeWatcher.h"
+
+#include <QtGui/QGuiApplication>
+
+#ifdef WIZ_HAVE_XDAMAGE
+#include "XDamageWatcher.h"
+#endif
+
+std::unique_ptr<ScreenChangeWatcher> createScreenChangeWatcher(const QString &spec) {
+#ifdef WIZ_HAVE_XDAMAGE
+    const bool screens = spec.isEmpty() || spec == "screen" || spec == "xshm" || spec == "qscreen";
+    if (screens && QGuiApplication::platformName() == "xcb") {
+        return XDamageWatcher::create();
+    }
+#else
+    Q_UNUSED(spec);
+#endif
+    return nullptr;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QtCore/QRect>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <memory>
+
+// Tells the capture loop when pixels on the screen change, so it can sleep
+// through static content such as an idle desktop or a paused video instead
+// of grabbing at the full frame rate. Only ever used from one thread.
+class ScreenChangeWatcher {
+public:
+    virtual ~ScreenChangeWatcher() = default;
+
+    // Waits up to timeoutMs for anything on the screen to change, returning
+    // at once if something already has since the last call. Sets changed[i]
+    // for each of rects, in desktop coordinates, that the changes touched,
+    // and returns whether any of them did.
+    virtual bool waitForChanges(const QVector<QRect> &rects, int timeoutMs, QVector<bool> &changed) = 0;
+
+    virtual QString name() const = 0;
+};
+
+// Watches the screens behind a frame source spec: the X DAMAGE extension
+// on X11 for screen, xshm and qscreen. Returns nullptr, and capture polls at
+// its frame rate, for other sources and wherever damage isn't available.
+std::unique_ptr<ScreenChangeWatcher> createScreenChangeWatcher(const QString &spec);
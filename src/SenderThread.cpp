@@ -0,0 +1,327 @@
+#include "SenderThread.h"
+
+#include <QElapsedTimer>
+#include <algorithm>
+
+#include "ColourCorrection.h"
+#include "TemporalFilter.h"
+
+namespace {
+
+const int kPreviewIntervalMs = 33;
+
+// How often the per-bulb link stats are published to other threads
+const int kLinkStatsIntervalMs = 250;
+
+// Output rate for filtered zones when neither it nor the capture rate is set
+const int kDefaultFilterRate = 60;
+
+// How long the thread sleeps without work before checking it should exit
+const int kIdleWaitMs = 100;
+
+// Copies into dst's existing buffer, so a QVector that stays the same size
+// is never reallocated
+void copyColours(const QVector<QColor> &src, QVector<QColor> &dst) {
+    dst.resize(src.size());
+    std::copy(src.constBegin(), src.constEnd(), dst.begin());
+}
+
+} // namespace
+
+SenderThread::SenderThread(SettingsStore *settings, QObject *parent)
+    : QThread(parent), m_settings(settings), m_latency(nullptr) {
+    qRegisterMetaType<QVector<QColor>>();
+
+    m_active = false;
+    m_sentFrames = 0;
+    m_skippedFrames = 0;
+    m_droppedFrames = 0;
+    m_coalescedUpdates = 0;
+    m_droppedUpdates = 0;
+    m_hasManualColours = false;
+    m_waitingForRoom = false;
+}
+
+SenderThread::~SenderThread() {
+    stopSending();
+}
+
+bool SenderThread::push(const QVector<QColor> &colours, const FrameStamps &stamps) {
+    CapturedFrame *slot = m_ring.beginWrite();
+    if (!slot) {
+        ++m_droppedFrames;
+        return false;
+    }
+
+    copyColours(colours, slot->colours);
+    slot->stamps = stamps;
+    m_ring.commitWrite();
+    m_wake.release();
+    return true;
+}
+
+bool SenderThread::waitForRoom(int timeoutMs) {
+    // A drain that raced the end of an earlier wait may have left a permit
+    // behind; spend it, so only a drain after the check can end this one
+    m_drained.tryAcquire(m_drained.available());
+    m_waitingForRoom = true;
+    // Pairs with the fence after draining: either the thread sees the flag,
+    // or this sees the room it made
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!canPush()) {
+        m_drained.tryAcquire(1, timeoutMs);
+    }
+    m_waitingForRoom = false;
+    return canPush();
+}
+
+void SenderThread::sendColours(const QVector<QColor> &colours) {
+    {
+        QMutexLocker locker(&m_manualMutex);
+        m_manualColours = colours;
+        m_hasManualColours = true;
+    }
+    m_wake.release();
+}
+
+QVector<BulbLinkStats> SenderThread::linkStats() const {
+    QMutexLocker locker(&m_linkMutex);
+    return m_linkStats;
+}
+
+void SenderThread::startSending() {
+    if (!m_active) {
+        m_active = true;
+        if (!isRunning()) {
+            start(QThread::HighPriority);
+        }
+    }
+}
+
+void SenderThread::stopSending() {
+    m_active = false;
+    m_wake.release();
+    wait();
+}
+
+void SenderThread::run() {
+    // Created here so the socket belongs to this thread
+    UdpSender udpSender;
+    udpSender.setLatencyStats(m_latency);
+    ColourCorrector colourCorrector;
+    QVector<BulbTarget> targets;
+
+    SettingsReader settingsReader(m_settings);
+    quint64 settingsVersion = 0;
+
+    // With a tick period, captured colours only feed the zone filters, and
+    // the filtered colours go out on a fixed grid of ticks instead
+    QVector<ColourFilter> filters;
+    qint64 tickPeriodNs = 0;
+    qint64 nextTickNs = 0;
+    bool ticking = false;
+    bool resend = false;
+
+    // Stamps of the newest frame, until the first send after it arrived
+    FrameStamps stamps;
+    qint64 dequeued = 0;
+    bool stampsPending = false;
+
+    // Captured colours are kept apart from test colours, so a resend after
+    // a test colour goes back to the capture
+    QVector<QColor> colours;
+    QVector<QColor> manualColours;
+    QVector<QColor> outputColours;
+    QVector<QColor> lastOutputColours;
+    QVector<QColor> correctedColours;
+
+    QElapsedTimer previewTimer;
+    previewTimer.start();
+    bool previewPending = false;
+
+    QElapsedTimer linkStatsTimer;
+    linkStatsTimer.start();
+
+    while (m_active) {
+        // Sleep until the next tick while the output is moving, and until a
+        // held-back preview is due, even if no new frame arrives by then
+        int wait = kIdleWaitMs;
+        if (ticking) {
+            wait = int(qBound<qint64>(0, (nextTickNs - monotonicNs() + 999999) / 1000000, kIdleWaitMs));
+        }
+        const int pendingWait = udpSender.msUntilPending();
+        if (pendingWait >= 0) {
+            wait = qMin(wait, pendingWait);
+        }
+        if (previewPending) {
+            wait = qMin(wait, int(qBound<qint64>(0, kPreviewIntervalMs - previewTimer.elapsed(), kPreviewIntervalMs)));
+        }
+        m_wake.tryAcquire(1, wait);
+
+        // Every wakeup drains the whole ring, so permits left over from the
+        // frames about to be drained are spent now. Taking them after the
+        // drain could swallow the wakeup for a frame pushed in between.
+        const int pending = m_wake.available();
+        if (pending > 0) {
+            m_wake.tryAcquire(pending);
+        }
+
+        // Replies are matched before sending, so a colour acknowledged in
+        // the meantime isn't retransmitted
+        udpSender.pollResponses();
+
+        const PipelineSettings &settings = settingsReader.acquire();
+        if (settings.version != settingsVersion) {
+            settingsVersion = settings.version;
+            colourCorrector.setCorrection(settings.correction);
+            if (settings.targets != targets) {
+                targets = settings.targets;
+                udpSender.setTargets(targets);
+            }
+            udpSender.setRateLimit(settings.bulbRateLimit, settings.bulbBurst);
+
+            bool filtering = false;
+            filters.resize(settings.zones.size());
+            for (int i = 0; i < settings.zones.size(); ++i) {
+                filters[i].setSettings(settings.zones[i].filter);
+                filtering |= settings.zones[i].filter.type != FilterSettings::None;
+            }
+
+            // Filters need ticks to move between captured frames, so they
+            // default to the capture rate
+            int outputRate = settings.outputRate;
+            if (outputRate <= 0 && filtering) {
+                outputRate = settings.fps > 0 ? settings.fps : kDefaultFilterRate;
+            }
+            tickPeriodNs = outputRate > 0 ? 1000000000 / outputRate : 0;
+
+            // Show the new settings on the bulbs straight away
+            resend = true;
+        }
+
+        const qint64 now = monotonicNs();
+
+        bool fresh = false;
+        while (const CapturedFrame *frame = m_ring.beginRead()) {
+            if (fresh && tickPeriodNs == 0) {
+                ++m_skippedFrames;
+            }
+            copyColours(frame->colours, colours);
+            stamps = frame->stamps;
+            m_ring.commitRead();
+            fresh = true;
+            dequeued = monotonicNs();
+            stampsPending = stamps.grabStart != 0;
+
+            if (tickPeriodNs > 0) {
+                for (int i = 0; i < colours.size() && i < filters.size(); ++i) {
+                    filters[i].measure(colours[i], now);
+                }
+            }
+        }
+        // Only release with the producer waiting, so permits can't pile up
+        // while nobody takes them
+        if (fresh) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_waitingForRoom.exchange(false)) {
+                m_drained.release();
+            }
+        }
+
+        bool manual = false;
+        {
+            QMutexLocker locker(&m_manualMutex);
+            if (m_hasManualColours) {
+                copyColours(m_manualColours, manualColours);
+                m_hasManualColours = false;
+                manual = true;
+            }
+        }
+
+        bool send = false;
+        if (manual) {
+            // Test colours skip the filters
+            copyColours(manualColours, outputColours);
+            send = true;
+        } else if (tickPeriodNs == 0) {
+            if (fresh || resend) {
+                copyColours(colours, outputColours);
+                send = true;
+                resend = false;
+            }
+        } else {
+            if ((fresh || resend) && !ticking) {
+                // Coming out of idle, the first tick is due straight away
+                ticking = true;
+                nextTickNs = qMax(nextTickNs, now);
+            }
+
+            if (ticking && now >= nextTickNs) {
+                outputColours.resize(colours.size());
+                bool settling = false;
+                for (int i = 0; i < colours.size(); ++i) {
+                    if (i < filters.size() && filters[i].isValid()) {
+                        outputColours[i] = filters[i].sample(now);
+                        settling |= filters[i].isSettling();
+                    } else {
+                        outputColours[i] = colours[i];
+                    }
+                }
+
+                // Unchanged output isn't worth a packet
+                send = resend || outputColours != lastOutputColours;
+                resend = false;
+
+                nextTickNs += tickPeriodNs;
+                if (nextTickNs <= now) {
+                    nextTickNs = now + tickPeriodNs;
+                }
+                ticking = settling || fresh;
+            }
+        }
+
+        if (send && !outputColours.isEmpty()) {
+            correctedColours.resize(outputColours.size());
+            for (int i = 0; i < outputColours.size(); ++i) {
+                correctedColours[i] = colourCorrector.correct(outputColours[i]);
+            }
+
+            const qint64 corrected = monotonicNs();
+            udpSender.sendColours(correctedColours);
+            copyColours(outputColours, lastOutputColours);
+            ++m_sentFrames;
+            previewPending = true;
+
+            if (m_latency) {
+                m_latency->countSent();
+                if (stampsPending && !manual) {
+                    m_latency->recordSend(stamps, dequeued, corrected, monotonicNs());
+                    stampsPending = false;
+                }
+            }
+        }
+        udpSender.flushPending();
+
+        m_coalescedUpdates = udpSender.coalescedUpdates();
+        m_droppedUpdates = udpSender.droppedUpdates();
+
+        if (previewPending && previewTimer.hasExpired(kPreviewIntervalMs)) {
+            previewTimer.restart();
+            previewPending = false;
+            emit preview(lastOutputColours, correctedColours);
+        }
+
+        if (linkStatsTimer.hasExpired(kLinkStatsIntervalMs)) {
+            linkStatsTimer.restart();
+            const QVector<BulbLinkStats> stats = udpSender.linkStats();
+            QMutexLocker locker(&m_linkMutex);
+            m_linkStats = stats;
+        }
+    }
+
+    // Replies that arrived since the last pass still count
+    udpSender.pollResponses();
+    const QVector<BulbLinkStats> stats = udpSender.linkStats();
+    QMutexLocker locker(&m_linkMutex);
+    m_linkStats = stats;
+}
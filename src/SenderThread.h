@@ -0,0 +1,113 @@
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QSemaphore>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <atomic>
+
+#include "LatencyStats.h"
+#include "PipelineSettings.h"
+#include "SpscRing.h"
+#include "UdpSender.h"
+
+// Smooths and corrects captured colours and sends them to the bulbs on its
+// own thread, so LED latency doesn't depend on how busy the GUI event loop
+// is. Capture hands frames over through a lock-free single-producer ring.
+// Unfiltered, only the newest waiting frame is sent; zones with a temporal
+// filter are fed every frame and sampled at the output rate instead, and a
+// sample that hasn't changed since the last one isn't sent.
+class SenderThread : public QThread {
+    Q_OBJECT
+public:
+    // Colour correction and bulbs come from the latest snapshot in settings,
+    // which must outlive the thread
+    SenderThread(SettingsStore *settings, QObject *parent = nullptr);
+    ~SenderThread() override;
+
+    // Queues one colour per zone for sending. Only ever call this from a
+    // single producer thread, normally by connecting the capture thread's
+    // coloursCaptured() with Qt::DirectConnection. Returns false and drops
+    // the frame if the ring is full.
+    bool push(const QVector<QColor> &colours, const FrameStamps &stamps = FrameStamps());
+
+    // Whether push() would find room in the ring; only call from the
+    // producer thread
+    bool canPush() { return m_ring.beginWrite() != nullptr; }
+
+    // Sleeps until the thread next drains the ring, or for timeoutMs, if
+    // push() would find it full. Returns canPush(). Only call from the
+    // producer thread.
+    bool waitForRoom(int timeoutMs);
+
+    // Sends colours outside the capture stream, such as a test colour. Safe
+    // to call from any thread.
+    void sendColours(const QVector<QColor> &colours);
+
+    // Wakes the thread to pick up a newly published snapshot, resending the
+    // last colours with it
+    void settingsChanged() { m_wake.release(); }
+
+    quint64 sentFrames() const { return m_sentFrames; }
+
+    // Frames replaced by a newer one before they were sent
+    quint64 skippedFrames() const { return m_skippedFrames; }
+
+    // Frames lost because the ring was full
+    quint64 droppedFrames() const { return m_droppedFrames; }
+
+    // Bulb updates replaced by a newer one while held back by the per-bulb
+    // rate limit, and lost because the socket buffer was full
+    quint64 coalescedUpdates() const { return m_coalescedUpdates; }
+    quint64 droppedUpdates() const { return m_droppedUpdates; }
+
+    // Acknowledgements and round-trip times per bulb, refreshed a few times
+    // a second and when the thread stops
+    QVector<BulbLinkStats> linkStats() const;
+
+    // Records sender stage timings and sent frames into stats, which must
+    // outlive the thread; only call while the thread is stopped
+    void setLatencyStats(LatencyStats *stats) { m_latency = stats; }
+
+    void startSending();
+    void stopSending();
+
+signals:
+    // The last frame sent, after smoothing and before and after colour
+    // correction. Emitted at most about 30 times a second so a busy
+    // pipeline can't flood the GUI.
+    void preview(const QVector<QColor> &original, const QVector<QColor> &corrected);
+
+protected:
+    void run() override;
+
+private:
+    static const int kRingSize = 8;
+
+    struct CapturedFrame {
+        QVector<QColor> colours;
+        FrameStamps stamps;
+    };
+
+    SettingsStore *m_settings;
+    LatencyStats *m_latency;
+    SpscRing<CapturedFrame, kRingSize> m_ring;
+    QSemaphore m_wake;
+    QSemaphore m_drained;       // Released on a drain while the producer waits
+    std::atomic<bool> m_waitingForRoom;
+    std::atomic<bool> m_active;
+    std::atomic<quint64> m_sentFrames;
+    std::atomic<quint64> m_skippedFrames;
+    std::atomic<quint64> m_droppedFrames;
+    std::atomic<quint64> m_coalescedUpdates;
+    std::atomic<quint64> m_droppedUpdates;
+
+    mutable QMutex m_linkMutex;
+    QVector<BulbLinkStats> m_linkStats;
+
+    // Colours from sendColours(), waiting for the thread
+    QMutex m_manualMutex;
+    QVector<QColor> m_manualColours;
+    bool m_hasManualColours;
+};
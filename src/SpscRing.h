@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QtGlobal>
+#include <atomic>
+
+// Fixed-size lock-free queue for exactly one producer thread and one
+// consumer thread. Slots are filled and read in place, so element types
+// that own memory (such as QVector) keep their buffers between uses and
+// steady-state traffic allocates nothing.
+template <typename T, int Capacity>
+class SpscRing {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscRing capacity must be a power of two");
+
+public:
+    SpscRing() : m_head(0), m_tail(0) {}
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Producer: slot to fill, or null if the ring is full. The slot is
+    // handed over by commitWrite().
+    T *beginWrite() {
+        const quint32 head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == quint32(Capacity)) {
+            return nullptr;
+        }
+        return &m_slots[head & kMask];
+    }
+
+    void commitWrite() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: oldest filled slot, or null if the ring is empty. The slot
+    // goes back to the producer on commitRead().
+    T *beginRead() {
+        const quint32 tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &m_slots[tail & kMask];
+    }
+
+    void commitRead() {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    static int capacity() { return Capacity; }
+
+private:
+    static const quint32 kMask = quint32(Capacity) - 1;
+
+    // Kept on separate cache lines so the two threads don't false-share
+    alignas(64) std::atomic<quint32> m_head;
+    alignas(64) std::atomic<quint32> m_tail;
+    alignas(64) T m_slots[Capacity];
+};
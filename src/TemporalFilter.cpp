@@ -0,0 +1,207 @@
+#include "TemporalFilter.h"
+
+#include <QtCore/QStringList>
+#include <cmath>
+
+namespace {
+
+// ln(10): an EMA covers 90% of a step in ln(10) time constants
+const float kEmaStepsTo90 = 2.302585f;
+
+// A critically damped spring covers 90% of a step when omega * t is this
+const float kSpringStepsTo90 = 3.889720f;
+
+// Output within this many levels of the target counts as settled
+const float kSettledLevels = 0.5f;
+
+} // namespace
+
+FilterSettings parseFilterSettings(const QString &spec, bool *ok) {
+    FilterSettings settings;
+    bool valid = true;
+
+    const QStringList parts = spec.trimmed().toLower().split(':');
+    auto number = [&parts, &valid](int index, float *value) {
+        if (index < parts.size()) {
+            bool isNumber = false;
+            const float parsed = parts[index].toFloat(&isNumber);
+            if (isNumber && parsed > 0) {
+                *value = parsed;
+            } else {
+                valid = false;
+            }
+        }
+    };
+
+    const QString &type = parts.first();
+    if (type == "none" || type.isEmpty()) {
+        settings.type = FilterSettings::None;
+    } else if (type == "ema") {
+        settings.type = FilterSettings::Ema;
+        number(1, &settings.responseMs);
+    } else if (type == "spring") {
+        settings.type = FilterSettings::Spring;
+        number(1, &settings.responseMs);
+    } else if (type == "kalman") {
+        settings.type = FilterSettings::Kalman;
+        number(1, &settings.processNoise);
+        number(2, &settings.measurementNoise);
+    } else {
+        valid = false;
+    }
+
+    if (ok) {
+        *ok = valid;
+    }
+    return valid ? settings : FilterSettings();
+}
+
+QString filterSpec(const FilterSettings &settings) {
+    switch (settings.type) {
+    case FilterSettings::Ema:
+        return QString("ema:%1").arg(settings.responseMs);
+    case FilterSettings::Spring:
+        return QString("spring:%1").arg(settings.responseMs);
+    case FilterSettings::Kalman:
+        return QString("kalman:%1:%2").arg(settings.processNoise).arg(settings.measurementNoise);
+    case FilterSettings::None:
+        break;
+    }
+    return "none";
+}
+
+ColourFilter::ColourFilter() : m_timeConstant(0), m_omega(0) {
+    setSettings(FilterSettings());
+}
+
+void ColourFilter::setSettings(const FilterSettings &settings) {
+    if (settings == m_settings && m_timeConstant > 0) {
+        return;
+    }
+
+    m_settings = settings;
+    const float responseSeconds = qMax(1.0f, settings.responseMs) / 1000.0f;
+    m_timeConstant = responseSeconds / kEmaStepsTo90;
+    m_omega = kSpringStepsTo90 / responseSeconds;
+    reset();
+}
+
+void ColourFilter::reset() {
+    m_valid = false;
+    m_timeNs = 0;
+    for (int i = 0; i < 3; ++i) {
+        m_target[i] = 0;
+        m_value[i] = 0;
+        m_velocity[i] = 0;
+        m_variance[i] = 0;
+    }
+}
+
+void ColourFilter::measure(const QColor &colour, qint64 timeNs) {
+    const float measured[3] = { float(colour.red()), float(colour.green()), float(colour.blue()) };
+
+    if (!m_valid) {
+        // Nothing to smooth from yet, so start at the first colour
+        for (int i = 0; i < 3; ++i) {
+            m_target[i] = measured[i];
+            m_value[i] = measured[i];
+            m_velocity[i] = 0;
+            m_variance[i] = m_settings.measurementNoise;
+        }
+        m_timeNs = timeNs;
+        m_valid = true;
+        return;
+    }
+
+    advance(timeNs);
+
+    for (int i = 0; i < 3; ++i) {
+        m_target[i] = measured[i];
+    }
+
+    switch (m_settings.type) {
+    case FilterSettings::None:
+        for (int i = 0; i < 3; ++i) {
+            m_value[i] = measured[i];
+        }
+        break;
+    case FilterSettings::Kalman:
+        for (int i = 0; i < 3; ++i) {
+            const float gain = m_variance[i] / (m_variance[i] + m_settings.measurementNoise);
+            m_value[i] += gain * (measured[i] - m_value[i]);
+            m_variance[i] *= 1.0f - gain;
+        }
+        break;
+    case FilterSettings::Ema:
+    case FilterSettings::Spring:
+        // These move towards the target as time advances
+        break;
+    }
+}
+
+QColor ColourFilter::sample(qint64 timeNs) {
+    if (!m_valid) {
+        return QColor(0, 0, 0);
+    }
+
+    advance(timeNs);
+
+    auto level = [](float value) {
+        return qBound(0, int(std::lround(value)), 255);
+    };
+    return QColor(level(m_value[0]), level(m_value[1]), level(m_value[2]));
+}
+
+bool ColourFilter::isSettling() const {
+    if (!m_valid || m_settings.type == FilterSettings::None ||
+        m_settings.type == FilterSettings::Kalman) {
+        return false;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        if (std::fabs(m_target[i] - m_value[i]) > kSettledLevels ||
+            std::fabs(m_velocity[i]) > kSettledLevels) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Moves the state on to timeNs with the last measurement held as the target
+void ColourFilter::advance(qint64 timeNs) {
+    const float dt = qMax<qint64>(0, timeNs - m_timeNs) / 1e9f;
+    m_timeNs = qMax(m_timeNs, timeNs);
+    if (dt <= 0) {
+        return;
+    }
+
+    switch (m_settings.type) {
+    case FilterSettings::None:
+        break;
+    case FilterSettings::Ema: {
+        const float alpha = 1.0f - std::exp(-dt / m_timeConstant);
+        for (int i = 0; i < 3; ++i) {
+            m_value[i] += alpha * (m_target[i] - m_value[i]);
+        }
+        break;
+    }
+    case FilterSettings::Spring: {
+        // Exact solution of x'' = -w^2 (x - target) - 2w x' over dt, so it
+        // stays stable however long the step
+        const float decay = std::exp(-m_omega * dt);
+        for (int i = 0; i < 3; ++i) {
+            const float offset = m_value[i] - m_target[i];
+            const float drift = m_velocity[i] + m_omega * offset;
+            m_value[i] = m_target[i] + (offset + drift * dt) * decay;
+            m_velocity[i] = (m_velocity[i] - m_omega * drift * dt) * decay;
+        }
+        break;
+    }
+    case FilterSettings::Kalman:
+        // Constant-colour model: only the uncertainty grows between frames
+        for (int i = 0; i < 3; ++i) {
+            m_variance[i] += m_settings.processNoise * dt;
+        }
+        break;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QtCore/QString>
+#include <QtGui/QColor>
+
+// How a zone's output colour follows the captured one
+struct FilterSettings {
+    enum Type {
+        None,       // Captured colour as is
+        Ema,        // Exponential moving average
+        Spring,     // Critically damped spring: smooth, no overshoot
+        Kalman      // 1-D Kalman filter per channel, tuned by noise levels
+    };
+
+    Type type = None;
+    float responseMs = 150;         // EMA and spring: time to cover 90% of a step
+    float processNoise = 2000;      // Kalman: expected drift, in levels^2 per second
+    float measurementNoise = 100;   // Kalman: capture noise, in levels^2
+
+    bool operator==(const FilterSettings &other) const {
+        return type == other.type && responseMs == other.responseMs &&
+               processNoise == other.processNoise && measurementNoise == other.measurementNoise;
+    }
+    bool operator!=(const FilterSettings &other) const { return !(*this == other); }
+};
+
+// Parses "none", "ema[:ms]", "spring[:ms]" or "kalman[:process[:measurement]]"
+FilterSettings parseFilterSettings(const QString &spec, bool *ok = nullptr);
+
+// Inverse of parseFilterSettings()
+QString filterSpec(const FilterSettings &settings);
+
+// Smooths one zone's colour over time. Captured colours are fed in with
+// measure() whenever they arrive, and the output is read with sample() at
+// whatever rate it is sent, so the two rates are independent. Times are in
+// nanoseconds on any monotonic clock.
+class ColourFilter {
+public:
+    ColourFilter();
+
+    // Starts again from the next measurement if the settings changed
+    void setSettings(const FilterSettings &settings);
+    void reset();
+
+    void measure(const QColor &colour, qint64 timeNs);
+    QColor sample(qint64 timeNs);
+
+    // False until the first measurement
+    bool isValid() const { return m_valid; }
+
+    // True while the output is still moving towards the last measurement
+    bool isSettling() const;
+
+private:
+    void advance(qint64 timeNs);
+
+    FilterSettings m_settings;
+    float m_timeConstant;   // EMA, in seconds
+    float m_omega;          // Spring, in radians per second
+
+    bool m_valid;
+    qint64 m_timeNs;
+    float m_target[3];
+    float m_value[3];
+    float m_velocity[3];    // Spring
+    float m_variance[3];    // Kalman
+};
@@ -0,0 +1,630 @@
+#include "UdpSender.h"
+
+#include <QtCore/QStringList>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#endif
+
+#include "PilotEncoder.h"
+
+namespace {
+
+// Datagrams per bulb whose replies are still awaited; older ones are
+// counted lost when a newer one takes their place. Enough for a load test
+// at thousands of updates a second, not just the tens bulbs manage.
+const int kOutstanding = 32;
+
+// How long a reply may take before its datagram counts as lost
+const qint64 kReplyTimeoutNs = 1000000000;
+
+// Bounds on the retransmit timeout, which otherwise follows the round-trip
+// time as in TCP: smoothed RTT plus four times its deviation
+const qint64 kMinRetransmitNs = 20000000;
+const qint64 kMaxRetransmitNs = 500000000;
+
+// Retransmits of one colour before giving up on the bulb acknowledging it
+const int kMaxRetransmits = 2;
+
+} // namespace
+
+struct UdpSender::Private {
+    struct Sent {
+        quint32 id;         // 0 once answered or settled as lost
+        qint64 sentNs;
+    };
+
+    struct Target {
+        QHostAddress address;
+        quint32 ip;
+        quint16 port;
+        PilotEncoder encoder;
+        int zone;
+        QColor colour;      // Newest colour, which every (re)send carries
+        char payload[PilotEncoder::kMaxLength];
+        int length;
+
+        // Token bucket, and whether colour is waiting for a token
+        double tokens;
+        qint64 refilledNs;
+        bool pending;
+
+        // Acknowledgement of the current colour: replies to any id from
+        // colourId on are for it
+        Sent outstanding[kOutstanding];
+        int nextSlot;
+        quint32 colourId;
+        qint64 colourSentNs;
+        bool awaiting;
+        int retransmits;
+        bool responsive;    // Has replied at least once
+        double srttNs;
+        double rttVarNs;
+        BulbLinkStats stats;
+    };
+
+    std::vector<Target> targets;
+    quint32 nextId = 1;
+
+    // Targets whose payloads go out in the next flushBatch()
+    std::vector<int> batchTargets;
+
+    QElapsedTimer clock;
+    double tokensPerNs = 0;     // 0 when unlimited
+    double burst = 1;
+
+    quint64 coalesced = 0;
+    quint64 dropped = 0;
+
+    LatencyStats *latency = nullptr;
+
+    double tokensAt(const Target &target, qint64 now) const {
+        return qMin(burst, target.tokens + (now - target.refilledNs) * tokensPerNs);
+    }
+
+    bool takeToken(Target &target, qint64 now) {
+        if (tokensPerNs <= 0) {
+            return true;
+        }
+        target.tokens = tokensAt(target, now);
+        target.refilledNs = now;
+        if (target.tokens < 1) {
+            return false;
+        }
+        target.tokens -= 1;
+        return true;
+    }
+
+    qint64 retransmitTimeout(const Target &target) const {
+        return qBound(kMinRetransmitNs, qint64(target.srttNs + 4 * target.rttVarNs), kMaxRetransmitNs);
+    }
+
+    // Whether target should get its colour again once due
+    bool retransmitting(const Target &target) const {
+        return target.awaiting && target.responsive && !target.pending &&
+               target.retransmits < kMaxRetransmits;
+    }
+
+    void queue(int index, qint64 now);
+    void acknowledge(quint32 ip, quint16 port, quint32 id, bool error, qint64 arrivedNs);
+    void expire(qint64 now);
+
+#ifdef Q_OS_LINUX
+    // One message per target, pointing at its payload and address. Rebuilt
+    // only when the targets change.
+    std::vector<sockaddr_in> addresses;
+    std::vector<iovec> vectors;
+    std::vector<mmsghdr> messages;
+    std::vector<mmsghdr> batch;
+#endif
+};
+
+// Formats the target's colour under a fresh id, remembering when it went out
+void UdpSender::Private::queue(int index, qint64 now) {
+    Target &target = targets[size_t(index)];
+    const quint32 id = nextId++;
+    if (nextId == 0) {
+        nextId = 1;
+    }
+    target.length = target.encoder.colour(target.payload, id, target.colour.red(), target.colour.green(),
+                                          target.colour.blue());
+
+    Sent &slot = target.outstanding[target.nextSlot];
+    if (slot.id != 0) {
+        ++target.stats.lost;
+    }
+    slot.id = id;
+    slot.sentNs = now;
+    target.nextSlot = (target.nextSlot + 1) % kOutstanding;
+    target.colourSentNs = now;
+    ++target.stats.sent;
+
+    batchTargets.push_back(index);
+#ifdef Q_OS_LINUX
+    vectors[index].iov_len = size_t(target.length);
+    batch.push_back(messages[index]);
+#endif
+}
+
+// Ids are unique across bulbs, so several bulbs behind one address (or a
+// stand-in on loopback) still have their replies told apart
+void UdpSender::Private::acknowledge(quint32 ip, quint16 port, quint32 id, bool error, qint64 arrivedNs) {
+    for (Target &target : targets) {
+        if (target.ip != ip || target.port != port) {
+            continue;
+        }
+        for (Sent &sent : target.outstanding) {
+            if (sent.id != id) {
+                continue;
+            }
+            sent.id = 0;
+
+            const double rtt = double(qMax<qint64>(0, arrivedNs - sent.sentNs));
+            if (latency) {
+                latency->record(LatencyStats::Reply, qint64(rtt));
+            }
+            if (!target.responsive) {
+                target.srttNs = rtt;
+                target.rttVarNs = rtt / 2;
+                target.responsive = true;
+            } else {
+                target.rttVarNs += (std::fabs(target.srttNs - rtt) - target.rttVarNs) / 4;
+                target.srttNs += (rtt - target.srttNs) / 8;
+            }
+
+            BulbLinkStats &stats = target.stats;
+            ++stats.acknowledged;
+            if (error) {
+                ++stats.rejected;
+            }
+            stats.rttMs = target.srttNs / 1e6;
+            stats.rttJitterMs = target.rttVarNs / 1e6;
+            stats.maxRttMs = qMax(stats.maxRttMs, rtt / 1e6);
+
+            // Ids only grow, so this reply is for the current colour or a
+            // retransmit of it
+            if (id - target.colourId < 0x80000000u) {
+                target.awaiting = false;
+            }
+            return;
+        }
+    }
+}
+
+void UdpSender::Private::expire(qint64 now) {
+    for (Target &target : targets) {
+        for (Sent &sent : target.outstanding) {
+            if (sent.id != 0 && now - sent.sentNs > kReplyTimeoutNs) {
+                sent.id = 0;
+                ++target.stats.lost;
+            }
+        }
+    }
+}
+
+UdpSender::UdpSender() : d(new Private) {
+    d->clock.start();
+    m_socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    m_socket.bind(QHostAddress::Any, 0, QUdpSocket::ShareAddress);
+
+#ifdef Q_OS_LINUX
+    // Replies are read when the sender thread next wakes, so have the kernel
+    // stamp their arrival to keep the wait out of the round-trip times
+    const int fd = int(m_socket.socketDescriptor());
+    const int on = 1;
+    if (fd != -1) {
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    }
+#endif
+}
+
+UdpSender::~UdpSender() = default;
+
+int UdpSender::targetCount() const {
+    return int(d->targets.size());
+}
+
+quint64 UdpSender::coalescedUpdates() const {
+    return d->coalesced;
+}
+
+quint64 UdpSender::droppedUpdates() const {
+    return d->dropped;
+}
+
+void UdpSender::setLatencyStats(LatencyStats *stats) {
+    d->latency = stats;
+}
+
+QVector<BulbLinkStats> UdpSender::linkStats() const {
+    QVector<BulbLinkStats> stats;
+    stats.reserve(int(d->targets.size()));
+    for (const Private::Target &target : d->targets) {
+        stats.append(target.stats);
+    }
+    return stats;
+}
+
+void UdpSender::setRateLimit(double perSecond, int burst) {
+    d->tokensPerNs = perSecond > 0 ? perSecond / 1e9 : 0;
+    d->burst = qMax(1, burst);
+
+    const qint64 now = d->clock.nsecsElapsed();
+    for (Private::Target &target : d->targets) {
+        target.tokens = d->burst;
+        target.refilledNs = now;
+    }
+}
+
+void UdpSender::setTargets(const QVector<BulbTarget> &targets) {
+    d->targets.clear();
+    d->targets.reserve(targets.size());
+    d->batchTargets.reserve(targets.size());
+
+    const qint64 now = d->clock.nsecsElapsed();
+
+    for (const BulbTarget &bulb : targets) {
+        QHostAddress address(bulb.ip);
+        bool isIPv4 = false;
+        address.toIPv4Address(&isIPv4);
+        if (!isIPv4) {
+            qWarning("Skipping bulb with invalid address: %s", qPrintable(bulb.ip));
+            continue;
+        }
+
+        Private::Target target;
+        target.address = address;
+        target.ip = address.toIPv4Address();
+        target.port = bulb.port;
+        target.encoder.setBrightness(bulb.brightness);
+        target.zone = bulb.zone;
+        target.length = 0;
+        target.tokens = d->burst;
+        target.refilledNs = now;
+        target.pending = false;
+        for (Private::Sent &sent : target.outstanding) {
+            sent.id = 0;
+            sent.sentNs = 0;
+        }
+        target.nextSlot = 0;
+        target.colourId = 0;
+        target.colourSentNs = 0;
+        target.awaiting = false;
+        target.retransmits = 0;
+        target.responsive = false;
+        target.srttNs = 0;
+        target.rttVarNs = 0;
+        target.stats.ip = bulb.ip;
+        d->targets.push_back(target);
+    }
+
+#ifdef Q_OS_LINUX
+    const size_t count = d->targets.size();
+    d->addresses.assign(count, sockaddr_in());
+    d->vectors.assign(count, iovec());
+    d->messages.assign(count, mmsghdr());
+    d->batch.reserve(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        Private::Target &target = d->targets[i];
+
+        sockaddr_in &address = d->addresses[i];
+        address.sin_family = AF_INET;
+        address.sin_port = htons(target.port);
+        address.sin_addr.s_addr = htonl(target.address.toIPv4Address());
+
+        d->vectors[i].iov_base = target.payload;
+
+        msghdr &header = d->messages[i].msg_hdr;
+        header.msg_name = &address;
+        header.msg_namelen = sizeof(address);
+        header.msg_iov = &d->vectors[i];
+        header.msg_iovlen = 1;
+    }
+#endif
+}
+
+void UdpSender::sendColour(const QColor &colour) {
+    send(&colour, 1, false);
+}
+
+void UdpSender::sendColours(const QVector<QColor> &colours) {
+    send(colours.constData(), colours.size(), true);
+}
+
+// Sends colour data to WiZ lights via UDP
+void UdpSender::send(const QColor *colours, int count, bool useZones) {
+    if (d->targets.empty() || count == 0) {
+        return;
+    }
+
+    const qint64 now = d->clock.nsecsElapsed();
+
+    for (size_t i = 0; i < d->targets.size(); ++i) {
+        Private::Target &target = d->targets[i];
+        const int zone = useZones ? target.zone : 0;
+        if (zone < 0 || zone >= count) {
+            continue;
+        }
+
+        // Any id from here on carries this colour
+        target.colour = colours[zone];
+        target.colourId = d->nextId;
+        target.awaiting = true;
+        target.retransmits = 0;
+
+        // Over budget: hold on to the newest colour until a token is free
+        if (!d->takeToken(target, now)) {
+            if (target.pending) {
+                ++d->coalesced;
+            }
+            target.pending = true;
+            continue;
+        }
+
+        target.pending = false;
+        d->queue(int(i), now);
+    }
+
+    flushBatch();
+}
+
+void UdpSender::flushPending() {
+    const qint64 now = d->clock.nsecsElapsed();
+
+    for (size_t i = 0; i < d->targets.size(); ++i) {
+        Private::Target &target = d->targets[i];
+
+        // An unacknowledged colour goes back through the rate limit like
+        // any held-back update
+        if (d->retransmitting(target) && now - target.colourSentNs >= d->retransmitTimeout(target)) {
+            ++target.retransmits;
+            ++target.stats.retransmits;
+            target.pending = true;
+        }
+
+        if (target.pending && d->takeToken(target, now)) {
+            target.pending = false;
+            d->queue(int(i), now);
+        }
+    }
+
+    flushBatch();
+}
+
+void UdpSender::pollResponses() {
+    char buffer[512];
+    int length = 0;
+    quint32 address = 0;
+    quint16 port = 0;
+    qint64 arrivedNs = 0;
+    while (receive(buffer, int(sizeof(buffer)), &length, &address, &port, &arrivedNs)) {
+        quint32 id = 0;
+        bool error = false;
+        if (parseReply(buffer, length, &id, &error)) {
+            d->acknowledge(address, port, id, error, arrivedNs);
+        }
+    }
+
+    d->expire(d->clock.nsecsElapsed());
+}
+
+bool UdpSender::receive(char *buffer, int size, int *length, quint32 *address, quint16 *port,
+                        qint64 *arrivedNs) {
+#ifdef Q_OS_LINUX
+    const int fd = int(m_socket.socketDescriptor());
+    if (fd != -1) {
+        sockaddr_in from;
+        iovec vector = { buffer, size_t(size) };
+        char control[CMSG_SPACE(sizeof(timespec))];
+        msghdr header;
+        std::memset(&header, 0, sizeof(header));
+        header.msg_name = &from;
+        header.msg_namelen = sizeof(from);
+        header.msg_iov = &vector;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        ssize_t result;
+        do {
+            result = recvmsg(fd, &header, MSG_DONTWAIT);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0) {
+            return false;
+        }
+
+        *length = int(result);
+        *address = ntohl(from.sin_addr.s_addr);
+        *port = ntohs(from.sin_port);
+        *arrivedNs = d->clock.nsecsElapsed();
+
+        // The kernel stamps arrival on the wall clock; move it onto ours
+        for (cmsghdr *message = CMSG_FIRSTHDR(&header); message; message = CMSG_NXTHDR(&header, message)) {
+            if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SCM_TIMESTAMPNS) {
+                timespec stamp;
+                timespec wall;
+                std::memcpy(&stamp, CMSG_DATA(message), sizeof(stamp));
+                clock_gettime(CLOCK_REALTIME, &wall);
+                const qint64 ageNs = (qint64(wall.tv_sec) - stamp.tv_sec) * 1000000000 +
+                                     (wall.tv_nsec - stamp.tv_nsec);
+                *arrivedNs -= qMax<qint64>(0, ageNs);
+            }
+        }
+        return true;
+    }
+#endif
+
+    if (!m_socket.hasPendingDatagrams()) {
+        return false;
+    }
+    QHostAddress from;
+    *length = int(m_socket.readDatagram(buffer, size, &from, port));
+    *address = from.toIPv4Address();
+    *arrivedNs = d->clock.nsecsElapsed();
+    return *length >= 0;
+}
+
+int UdpSender::formatPilot(char *buffer, int size, quint32 id, const QColor &colour, int brightness) {
+    return snprintf(buffer, size_t(size),
+        "{\"id\":%u,\"method\":\"setPilot\",\"params\":{\"r\":%d,\"g\":%d,\"b\":%d,\"dimming\":%d}}",
+        id, colour.red(), colour.green(), colour.blue(), brightness);
+}
+
+// Replies look like {"method":"setPilot","id":7,"env":"pro","result":{"success":true}},
+// or carry an "error" object instead of "result"
+bool UdpSender::parseReply(const char *data, int length, quint32 *id, bool *error) {
+    static const char kIdKey[] = "\"id\":";
+    const char *end = data + length;
+    const char *found = std::search(data, end, kIdKey, kIdKey + sizeof(kIdKey) - 1);
+    if (found == end) {
+        return false;
+    }
+
+    const char *digit = found + sizeof(kIdKey) - 1;
+    while (digit < end && *digit == ' ') {
+        ++digit;
+    }
+    quint64 value = 0;
+    const char *start = digit;
+    while (digit < end && *digit >= '0' && *digit <= '9' && value <= 0xffffffffu) {
+        value = value * 10 + quint64(*digit - '0');
+        ++digit;
+    }
+    if (digit == start || value > 0xffffffffu) {
+        return false;
+    }
+
+    static const char kErrorKey[] = "\"error\"";
+    *id = quint32(value);
+    *error = std::search(data, end, kErrorKey, kErrorKey + sizeof(kErrorKey) - 1) != end;
+    return true;
+}
+
+int UdpSender::msUntilPending() const {
+    const qint64 now = d->clock.nsecsElapsed();
+
+    double soonest = -1;
+    for (const Private::Target &target : d->targets) {
+        double waitNs;
+        if (target.pending) {
+            const double missing = 1 - d->tokensAt(target, now);
+            waitNs = missing > 0 ? missing / d->tokensPerNs : 0;
+        } else if (d->retransmitting(target)) {
+            waitNs = double(qMax<qint64>(0, target.colourSentNs + d->retransmitTimeout(target) - now));
+        } else {
+            continue;
+        }
+        if (soonest < 0 || waitNs < soonest) {
+            soonest = waitNs;
+        }
+    }
+
+    return soonest < 0 ? -1 : int(std::ceil(soonest / 1e6));
+}
+
+void UdpSender::flushBatch() {
+    if (d->batchTargets.empty()) {
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    const int fd = int(m_socket.socketDescriptor());
+    if (fd != -1) {
+        // Datagrams that don't fit the socket buffer are dropped rather than
+        // waited for; a stale colour is not worth blocking capture on
+        const unsigned int batchSize = unsigned(d->batch.size());
+        unsigned int sent = 0;
+        while (sent < batchSize) {
+            const int result = sendmmsg(fd, d->batch.data() + sent, batchSize - sent, MSG_DONTWAIT);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            sent += unsigned(result);
+        }
+
+        d->dropped += batchSize - sent;
+        d->batch.clear();
+        d->batchTargets.clear();
+        return;
+    }
+    d->batch.clear();
+#endif
+
+    for (int index : d->batchTargets) {
+        const Private::Target &target = d->targets[size_t(index)];
+        if (m_socket.writeDatagram(target.payload, target.length, target.address, target.port) < 0) {
+            ++d->dropped;
+        }
+    }
+    d->batchTargets.clear();
+}
+
+QVector<BulbTarget> UdpSender::parseTargets(const QString &text, int brightness, quint16 port) {
+    QVector<BulbTarget> targets;
+
+    QString normalised = text;
+    normalised.replace(',', ' ').replace(';', ' ');
+
+    const QStringList entries = normalised.split(' ', Qt::SkipEmptyParts);
+    for (const QString &entry : entries) {
+        BulbTarget target;
+        target.port = port;
+        target.brightness = brightness;
+
+        // Suffixes may come in either order: ip[@brightness][#zone]
+        const int at = entry.indexOf('@');
+        const int hash = entry.indexOf('#');
+        auto suffixValue = [&entry, at, hash](int start, int *value) {
+            const int end = (at > start) ? at : (hash > start ? hash : entry.size());
+            bool ok = false;
+            const int parsed = entry.mid(start + 1, end - start - 1).toInt(&ok);
+            if (ok) {
+                *value = parsed;
+            }
+        };
+
+        if (at >= 0) {
+            suffixValue(at, &target.brightness);
+        }
+        if (hash >= 0) {
+            suffixValue(hash, &target.zone);
+        }
+
+        int ipEnd = entry.size();
+        if (at >= 0) {
+            ipEnd = qMin(ipEnd, at);
+        }
+        if (hash >= 0) {
+            ipEnd = qMin(ipEnd, hash);
+        }
+        target.ip = entry.left(ipEnd);
+
+        const int colon = target.ip.indexOf(':');
+        if (colon >= 0) {
+            bool ok = false;
+            const int parsed = target.ip.mid(colon + 1).toInt(&ok);
+            if (ok && parsed > 0 && parsed <= 65535) {
+                target.port = quint16(parsed);
+            }
+            target.ip.truncate(colon);
+        }
+
+        targets.append(target);
+    }
+
+    return targets;
+}
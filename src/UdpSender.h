@@ -0,0 +1,112 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QVector>
+#include <QtGui/QColor>
+#include <QtNetwork/QUdpSocket>
+#include <memory>
+
+#include "LatencyStats.h"
+#include "PipelineSettings.h"
+
+// How one bulb has been answering the updates sent to it. WiZ bulbs reply to
+// each setPilot with the id it carried, so every datagram is either
+// acknowledged or, after a second without a reply, counted lost.
+struct BulbLinkStats {
+    QString ip;
+    quint64 sent = 0;           // Datagrams, retransmits included
+    quint64 acknowledged = 0;
+    quint64 lost = 0;
+    quint64 retransmits = 0;
+    quint64 rejected = 0;       // Replies reporting an error
+    double rttMs = 0;           // Smoothed round-trip time, 0 before the first reply
+    double rttJitterMs = 0;     // Smoothed deviation from it
+    double maxRttMs = 0;
+
+    // Share of settled datagrams that went unanswered
+    double lossRatio() const {
+        const quint64 settled = acknowledged + lost;
+        return settled > 0 ? double(lost) / settled : 0;
+    }
+};
+
+class UdpSender : public QObject {
+    Q_OBJECT
+public:
+    UdpSender();
+    ~UdpSender() override;
+
+    // Replaces the bulbs to send to. Addresses are resolved once here; bulbs
+    // without a valid IPv4 address are skipped.
+    void setTargets(const QVector<BulbTarget> &targets);
+    int targetCount() const;
+
+    // Caps each bulb at perSecond updates with a token bucket holding up to
+    // burst, or lifts the cap with perSecond <= 0. An update for a bulb
+    // that's out of tokens is held back, replacing any it already held, and
+    // goes out from flushPending() once the bucket refills.
+    void setRateLimit(double perSecond, int burst);
+
+    // Sends colour data to every bulb via UDP, batched into a single
+    // sendmmsg() call where available
+    void sendColour(const QColor &colour);
+
+    // Sends each bulb the colour of its zone; bulbs whose zone is out of
+    // range are skipped
+    void sendColours(const QVector<QColor> &colours);
+
+    // Sends held-back updates whose bulbs have tokens again. A bulb that has
+    // replied before but hasn't acknowledged its current colour within a few
+    // round-trip times gets it again, up to twice; only the newest colour is
+    // ever resent, so a lost update can't bring back an older one.
+    void flushPending();
+
+    // Reads every reply waiting on the socket without blocking, matching
+    // them to bulbs by id and address
+    void pollResponses();
+
+    // Milliseconds until the next held-back update or retransmit can go
+    // out, or -1 if there are none
+    int msUntilPending() const;
+
+    // Updates replaced by a newer one while held back by the rate limit
+    quint64 coalescedUpdates() const;
+
+    // Updates lost because the socket buffer was full
+    quint64 droppedUpdates() const;
+
+    // Replies and round-trip times per bulb, in target order
+    QVector<BulbLinkStats> linkStats() const;
+
+    // Records every round trip into stats' reply stage, which must outlive
+    // the sender
+    void setLatencyStats(LatencyStats *stats);
+
+    // Parses a list of bulbs such as "192.168.1.20, 192.168.1.21@60#2", where
+    // "@n" overrides the brightness for that bulb and "#n" picks its zone. An
+    // address may end in ":port", such as an emulated bulb's.
+    static QVector<BulbTarget> parseTargets(const QString &text, int brightness, quint16 port);
+
+    // Writes the setPilot command with request id for colour at brightness
+    // (1-100) into buffer and returns its length. Sends use PilotEncoder;
+    // this is the reference it is checked against.
+    static int formatPilot(char *buffer, int size, quint32 id, const QColor &colour, int brightness);
+
+    // Reads the request id from a bulb's reply, and whether it reported an
+    // error. Returns false if there is no id.
+    static bool parseReply(const char *data, int length, quint32 *id, bool *error);
+
+private:
+    struct Private;
+
+    void send(const QColor *colours, int count, bool useZones);
+    void flushBatch();
+
+    // Reads one waiting datagram, with the time it arrived on d->clock.
+    // Returns false once there are none.
+    bool receive(char *buffer, int size, int *length, quint32 *address, quint16 *port,
+                 qint64 *arrivedNs);
+
+    QUdpSocket m_socket;
+    std::unique_ptr<Private> d;
+};
@@ -0,0 +1,104 @@
+#include "XDamageWatcher.h"
+
+#include <poll.h>
+
+// X11 headers come last, their macros (None, Bool, Status...) clash with Qt
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+
+struct XDamageWatcher::Private {
+    Display *display = nullptr;
+    Damage damage = 0;
+    XserverRegion parts = 0;    // Reused to fetch the damaged rectangles
+    int eventBase = 0;
+    bool damaged = false;       // Notified but not yet taken
+};
+
+XDamageWatcher::XDamageWatcher(std::unique_ptr<Private> dd) : d(std::move(dd)) {
+}
+
+XDamageWatcher::~XDamageWatcher() {
+    if (d->parts) {
+        XFixesDestroyRegion(d->display, d->parts);
+    }
+    if (d->damage) {
+        XDamageDestroy(d->display, d->damage);
+    }
+    XCloseDisplay(d->display);
+}
+
+std::unique_ptr<XDamageWatcher> XDamageWatcher::create() {
+    // A private connection, so waiting on it never touches Qt's
+    Display *display = XOpenDisplay(nullptr);
+    if (!display) {
+        return nullptr;
+    }
+
+    // Both extensions want their versions agreed before the first request,
+    // and fetching a region's rectangles needs XFIXES 2
+    int damageEvent = 0, damageError = 0, damageMajor = 0, damageMinor = 0;
+    int fixesEvent = 0, fixesError = 0, fixesMajor = 0, fixesMinor = 0;
+    if (!XDamageQueryExtension(display, &damageEvent, &damageError) ||
+        !XDamageQueryVersion(display, &damageMajor, &damageMinor) ||
+        !XFixesQueryExtension(display, &fixesEvent, &fixesError) ||
+        !XFixesQueryVersion(display, &fixesMajor, &fixesMinor) || fixesMajor < 2) {
+        XCloseDisplay(display);
+        return nullptr;
+    }
+
+    auto d = std::make_unique<Private>();
+    d->display = display;
+    d->eventBase = damageEvent;
+    d->damage = XDamageCreate(display, DefaultRootWindow(display), XDamageReportNonEmpty);
+    d->parts = XFixesCreateRegion(display, nullptr, 0);
+    XFlush(display);
+    return std::unique_ptr<XDamageWatcher>(new XDamageWatcher(std::move(d)));
+}
+
+bool XDamageWatcher::readEvents() {
+    bool damaged = false;
+    while (XPending(d->display) > 0) {
+        XEvent event;
+        XNextEvent(d->display, &event);
+        damaged |= event.type == d->eventBase + XDamageNotify;
+    }
+    return damaged;
+}
+
+bool XDamageWatcher::waitForChanges(const QVector<QRect> &rects, int timeoutMs, QVector<bool> &changed) {
+    changed.fill(false, rects.size());
+
+    d->damaged |= readEvents();
+    if (!d->damaged) {
+        pollfd socket = { ConnectionNumber(d->display), POLLIN, 0 };
+        if (::poll(&socket, 1, timeoutMs) > 0) {
+            d->damaged = readEvents();
+        }
+    }
+    if (!d->damaged) {
+        return false;
+    }
+    d->damaged = false;
+
+    // Take the damage so far and clear it; anything drawn from here on
+    // raises a new event, so no change is missed between two waits
+    XDamageSubtract(d->display, d->damage, None, d->parts);
+    int count = 0;
+    XRectangle *boxes = XFixesFetchRegion(d->display, d->parts, &count);
+
+    bool any = false;
+    for (int b = 0; b < count; ++b) {
+        const QRect box(boxes[b].x, boxes[b].y, boxes[b].width, boxes[b].height);
+        for (int i = 0; i < rects.size(); ++i) {
+            if (!changed[i] && rects[i].intersects(box)) {
+                changed[i] = true;
+                any = true;
+            }
+        }
+    }
+    if (boxes) {
+        XFree(boxes);
+    }
+    return any;
+}
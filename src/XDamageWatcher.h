@@ -0,0 +1,30 @@
+#pragma once
+
+#include "ScreenChangeWatcher.h"
+
+// Follows damage to the X root window through the DAMAGE and XFIXES
+// extensions on a private display connection. The server sends one event
+// when the damage goes from empty to not, so a static screen sends none;
+// each wait then takes the damaged region in one round trip and clears it.
+// Linux/X11 only.
+class XDamageWatcher : public ScreenChangeWatcher {
+public:
+    ~XDamageWatcher() override;
+
+    // Returns nullptr when the display or either extension is unavailable
+    static std::unique_ptr<XDamageWatcher> create();
+
+    bool waitForChanges(const QVector<QRect> &rects, int timeoutMs, QVector<bool> &changed) override;
+    QString name() const override { return "xdamage"; }
+
+private:
+    struct Private;
+
+    explicit XDamageWatcher(std::unique_ptr<Private> d);
+
+    // Reads the events already queued or waiting on the socket, returning
+    // whether damage was reported
+    bool readEvents();
+
+    std::unique_ptr<Private> d;
+};
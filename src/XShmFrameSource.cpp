@@ -0,0 +1,173 @@
+#include "XShmFrameSource.h"
+
+#include <QtCore/QMutex>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+// X11 headers come last, their macros (None, Bool, Status...) clash with Qt
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+namespace {
+
+// The error handler is process-wide, so sources attaching segments on
+// different threads take turns
+QMutex g_xErrorMutex;
+bool g_xErrorOccurred = false;
+
+int trapXError(Display *, XErrorEvent *) {
+    g_xErrorOccurred = true;
+    return 0;
+}
+
+} // namespace
+
+struct XShmFrameSource::Private {
+    Private() {
+        segment.shmid = -1;
+    }
+
+    Display *display = nullptr;
+    Window root = 0;
+    XImage *image = nullptr;
+    XShmSegmentInfo segment = {};
+    bool attached = false;
+};
+
+XShmFrameSource::XShmFrameSource(std::unique_ptr<Private> dd, const QRect &area) : d(std::move(dd)) {
+    const int screen = DefaultScreen(d->display);
+    m_geometry = QRect(0, 0, DisplayWidth(d->display, screen), DisplayHeight(d->display, screen));
+    if (!area.isEmpty()) {
+        m_geometry = m_geometry.intersected(area);
+    }
+}
+
+XShmFrameSource::~XShmFrameSource() {
+    releaseSegment();
+    XCloseDisplay(d->display);
+}
+
+std::unique_ptr<XShmFrameSource> XShmFrameSource::create(const QRect &area) {
+    // A private connection, so the capture thread never touches Qt's
+    Display *display = XOpenDisplay(nullptr);
+    if (!display) {
+        return nullptr;
+    }
+
+    if (!XShmQueryExtension(display)) {
+        XCloseDisplay(display);
+        return nullptr;
+    }
+
+    auto d = std::make_unique<Private>();
+    d->display = display;
+    d->root = DefaultRootWindow(display);
+
+    std::unique_ptr<XShmFrameSource> source(new XShmFrameSource(std::move(d), area));
+
+    // Attaching fails asynchronously on displays that can't share memory with
+    // us, so probe with a 1x1 segment before committing to this backend
+    if (!source->resizeSegment(QSize(1, 1))) {
+        return nullptr;
+    }
+    return source;
+}
+
+bool XShmFrameSource::resizeSegment(const QSize &size) {
+    releaseSegment();
+
+    const int screen = DefaultScreen(d->display);
+    d->image = XShmCreateImage(d->display, DefaultVisual(d->display, screen),
+                               DefaultDepth(d->display, screen), ZPixmap, nullptr,
+                               &d->segment, size.width(), size.height());
+    if (!d->image) {
+        return false;
+    }
+
+    // The reduction code reads pixels as QRgb
+    if (d->image->bits_per_pixel != 32) {
+        releaseSegment();
+        return false;
+    }
+
+    d->segment.shmid = shmget(IPC_PRIVATE, d->image->bytes_per_line * d->image->height,
+                              IPC_CREAT | 0600);
+    if (d->segment.shmid < 0) {
+        releaseSegment();
+        return false;
+    }
+
+    d->segment.shmaddr = d->image->data = static_cast<char *>(shmat(d->segment.shmid, nullptr, 0));
+    if (d->segment.shmaddr == reinterpret_cast<char *>(-1)) {
+        d->segment.shmaddr = d->image->data = nullptr;
+        releaseSegment();
+        return false;
+    }
+    d->segment.readOnly = False;
+
+    {
+        QMutexLocker locker(&g_xErrorMutex);
+        g_xErrorOccurred = false;
+        XErrorHandler previousHandler = XSetErrorHandler(trapXError);
+        const Bool attached = XShmAttach(d->display, &d->segment);
+        XSync(d->display, False);
+        XSetErrorHandler(previousHandler);
+
+        d->attached = attached && !g_xErrorOccurred;
+    }
+
+    // Once the server holds the segment it can be marked for removal, so it
+    // is freed even if we crash
+    shmctl(d->segment.shmid, IPC_RMID, nullptr);
+
+    if (!d->attached) {
+        releaseSegment();
+        return false;
+    }
+    return true;
+}
+
+void XShmFrameSource::releaseSegment() {
+    if (d->attached) {
+        XShmDetach(d->display, &d->segment);
+        XSync(d->display, False);
+        d->attached = false;
+    }
+    if (d->segment.shmaddr) {
+        shmdt(d->segment.shmaddr);
+        d->segment.shmaddr = nullptr;
+    }
+    if (d->segment.shmid >= 0) {
+        shmctl(d->segment.shmid, IPC_RMID, nullptr);
+        d->segment.shmid = -1;
+    }
+    if (d->image) {
+        // XDestroyImage would free() the shared memory and our segment info
+        d->image->data = nullptr;
+        d->image->obdata = nullptr;
+        XDestroyImage(d->image);
+        d->image = nullptr;
+    }
+}
+
+bool XShmFrameSource::grab(const QRect &rect, QImage &frame) {
+    if (rect.isEmpty()) {
+        return false;
+    }
+
+    if (!d->image || d->image->width != rect.width() || d->image->height != rect.height()) {
+        if (!resizeSegment(rect.size())) {
+            return false;
+        }
+    }
+
+    if (!XShmGetImage(d->display, d->root, d->image, rect.x(), rect.y(), AllPlanes)) {
+        return false;
+    }
+
+    frame = QImage(reinterpret_cast<const uchar *>(d->image->data),
+                   d->image->width, d->image->height, d->image->bytes_per_line,
+                   QImage::Format_RGB32);
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "FrameSource.h"
+
+// Captures straight out of an MIT-SHM segment attached to the X server, so a
+// grab is a single request with no pixmap round trip or intermediate copies.
+// The segment persists between frames and is only recreated when the capture
+// rect changes size. Linux/X11 only.
+class XShmFrameSource : public FrameSource {
+public:
+    ~XShmFrameSource() override;
+
+    // Returns nullptr when the display or the MIT-SHM extension is unavailable
+    // (e.g. Wayland, remote X), so callers can fall back to QScreenFrameSource.
+    // With an area, such as one monitor's geometry, the source covers only
+    // that part of the root window.
+    static std::unique_ptr<XShmFrameSource> create(const QRect &area = QRect());
+
+    QRect geometry() const override { return m_geometry; }
+    bool grab(const QRect &rect, QImage &frame) override;
+    QString name() const override { return "xshm"; }
+
+private:
+    struct Private;
+
+    XShmFrameSource(std::unique_ptr<Private> d, const QRect &area);
+    bool resizeSegment(const QSize &size);
+    void releaseSegment();
+
+    std::unique_ptr<Private> d;
+    QRect m_geometry;
+};
@@ -0,0 +1,142 @@
+// Headless entry point: the same capture and send pipeline as the window,
+// configured from a file and flags, without loading QtWidgets
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QSettings>
+#include <QtGui/QGuiApplication>
+#include <QScopedPointer>
+
+#include "LedDaemon.h"
+
+// The last value given for any of names, as "--name value" or "--name=value"
+static QByteArray argumentValue(int argc, char *argv[], const QList<QByteArray> &names) {
+    QByteArray value;
+    for (int i = 1; i < argc; ++i) {
+        const QByteArray arg(argv[i]);
+        for (const QByteArray &name : names) {
+            if (arg == name && i + 1 < argc) {
+                value = argv[++i];
+                break;
+            }
+            if (arg.startsWith(name + '=')) {
+                value = arg.mid(name.size() + 1);
+                break;
+            }
+        }
+    }
+    return value;
+}
+
+// Screen capture needs a display connection; synthetic and raw sources and
+// replays don't, so the daemon can run without one. The source comes from
+// --source or else the config file, which is all read again once the
+// application exists. Reloading can't switch to screen capture afterwards;
+// that fails like any unavailable source and keeps the running one.
+static QCoreApplication *createApplication(int &argc, char *argv[]) {
+    QByteArray source = argumentValue(argc, argv, { "--source" });
+    if (source.isEmpty()) {
+        const QByteArray config = argumentValue(argc, argv, { "-c", "--config" });
+        if (!config.isEmpty()) {
+            const QSettings file(QString::fromLocal8Bit(config), QSettings::IniFormat);
+            source = file.value("capture/source").toString().toUtf8();
+        }
+    }
+
+    if (source.startsWith("synthetic") || source.startsWith("raw:") || source.startsWith("replay:")) {
+        return new QCoreApplication(argc, argv);
+    }
+    return new QGuiApplication(argc, argv);
+}
+
+int main(int argc, char *argv[]) {
+    QScopedPointer<QCoreApplication> app(createApplication(argc, argv));
+    QCoreApplication::setApplicationName("WizLedDaemon");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Mirrors screen regions onto WiZ LEDs without a window. Flags override the config file; "
+        "SIGHUP reloads it.");
+    parser.addHelpOption();
+    QCommandLineOption configOption({ "c", "config" }, "INI config file.", "path");
+    QCommandLineOption sourceOption("source",
+        "Frame source: screen, xshm, qscreen, synthetic[:gradient|flicker|noise[:WxH]], raw:<path>:<WxH> "
+        "or replay:<path>[:fast] for a recording.",
+        "spec");
+    QCommandLineOption eventsOption("events",
+        "on to grab only when the screen changes where that can be watched, off to poll.", "on|off");
+    QCommandLineOption recordOption("record", "Record the captured colours to a file for replay.", "path");
+    QCommandLineOption bulbsOption("bulbs", "Bulb addresses, e.g. \"192.168.1.20, 192.168.1.21@60#1\".",
+                                   "list");
+    QCommandLineOption regionOption("region", "Capture region as centre x,y,size.", "x,y,size");
+    QCommandLineOption fpsOption("fps", "Capture rate, or 0 for unthrottled.", "fps");
+    QCommandLineOption idleFpsOption("idle-fps", "Capture rate on still content, or 0 to stay at --fps.", "fps");
+    QCommandLineOption thresholdOption("threshold", "Minimum sum of RGB differences worth sending.",
+                                       "levels");
+    QCommandLineOption changeMetricOption("change-metric", "Change gate: rgb, cie76 or ciede2000.", "name");
+    QCommandLineOption deltaEOption("delta-e", "Minimum ΔE worth sending, with a ΔE change gate.", "delta");
+    QCommandLineOption sampleOption("sample-budget", "Pixels read per zone and frame, or 0 for all.",
+                                    "pixels");
+    QCommandLineOption reducerOption("reducer", "Zone colour: mean, dominant or vivid.", "name");
+    QCommandLineOption edgesOption("edges", "Segments along the screen's edges, as 16x9 or top,right,bottom,left.",
+                                   "segments");
+    QCommandLineOption brightnessOption("brightness", "Bulb brightness, 1-100.", "percent");
+    QCommandLineOption filterOption("filter",
+        "Smoothing: none, ema[:ms], spring[:ms] or kalman[:process[:measurement]].", "spec");
+    QCommandLineOption outputRateOption("output-rate", "Colours sent per second, or 0 to follow capture.",
+                                        "fps");
+    QCommandLineOption bulbRateOption("bulb-rate", "Updates per second per bulb, or 0 for no limit.",
+                                      "rate");
+    QCommandLineOption latencyOption("latency-dump",
+        "Write per-stage latency histograms on exit, as CSV if the path ends in .csv or JSON otherwise.",
+        "path");
+    parser.addOptions({ configOption, sourceOption, eventsOption, recordOption, bulbsOption, regionOption,
+                        fpsOption, idleFpsOption, thresholdOption, changeMetricOption, deltaEOption, sampleOption, reducerOption,
+                        edgesOption, brightnessOption, filterOption, outputRateOption, bulbRateOption,
+                        latencyOption });
+    parser.process(*app);
+
+    // Flags are applied over the file on every load, so they survive reloads
+    const QPair<const QCommandLineOption *, QString> keys[] = {
+        { &sourceOption, "capture/source" },
+        { &eventsOption, "capture/events" },
+        { &recordOption, "capture/record" },
+        { &regionOption, "capture/region" },
+        { &fpsOption, "capture/fps" },
+        { &idleFpsOption, "capture/idle-fps" },
+        { &thresholdOption, "capture/threshold" },
+        { &changeMetricOption, "capture/change-metric" },
+        { &deltaEOption, "capture/delta-e" },
+        { &sampleOption, "capture/sample-budget" },
+        { &reducerOption, "capture/reducer" },
+        { &edgesOption, "capture/edges" },
+        { &bulbsOption, "output/bulbs" },
+        { &brightnessOption, "output/brightness" },
+        { &filterOption, "output/filter" },
+        { &outputRateOption, "output/rate" },
+        { &bulbRateOption, "output/bulb-rate" },
+    };
+    QMap<QString, QString> overrides;
+    for (const auto &key : keys) {
+        if (parser.isSet(*key.first)) {
+            overrides.insert(key.second, parser.value(*key.first));
+        }
+    }
+
+    LedDaemon daemon(parser.value(configOption), overrides);
+    QString error;
+    if (!daemon.start(&error)) {
+        qCritical("%s", qPrintable(error));
+        return 1;
+    }
+
+    const int result = app->exec();
+    if (parser.isSet(latencyOption)) {
+        QString latencyError;
+        if (!daemon.latencyStats().save(parser.value(latencyOption), &latencyError)) {
+            qWarning("Couldn't write latency stats to %s: %s",
+                     qPrintable(parser.value(latencyOption)), qPrintable(latencyError));
+        }
+    }
+    return result;
+}
@@ -1,4 +1,3 @@
-#include <iostream>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QMainWindow>
 #include <QtWidgets/QPushButton>
@@ -9,212 +8,33 @@
 #include <QtWidgets/QLineEdit>
 #include <QtWidgets/QGroupBox>
 #include <QtWidgets/QDoubleSpinBox>
+#include <QtWidgets/QComboBox>
+#include <QtWidgets/QFileDialog>
 #include <QDateTime>
 #include <QtGui/QScreen>
 #include <QtGui/QColor>
 #include <QtCore/QTimer>
 #include <QtCore/QPoint>
-#include <QtNetwork/QUdpSocket>
 #include <QtGui/QPainter>
 #include <QtGui/QMouseEvent>
 #include <QThread>
-#include <QMutex>
-#include <QWaitCondition>
 #include <QElapsedTimer>
-#include <atomic>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QScopedPointer>
+
+#include "EdgeLayout.h"
+#include "FrameSource.h"
+#include "LatencyStats.h"
+#include "PipelineBenchmark.h"
+#include "ScreenCaptureThread.h"
+#include "SenderThread.h"
+#include "UdpSender.h"
 
 // Platform-specific includes
 #ifdef Q_OS_WIN
 #include <windows.h>
-#elif defined(Q_OS_LINUX)
-#include <pthread.h>
-#include <sched.h>
 #endif
 
-class UdpSender : public QObject {
-    Q_OBJECT
-public:
-    UdpSender() {
-        m_socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
-        m_socket.bind(QHostAddress::Any, 0, QUdpSocket::ShareAddress);
-    }
-
-    // Sends colour data to WiZ light via UDP
-    void sendColour(const QString &ip, int port, const QColor &colour, int brightness) {
-        char buffer[128];
-        int len = snprintf(buffer, sizeof(buffer), 
-            "{\"id\":1,\"method\":\"setPilot\",\"params\":{\"r\":%d,\"g\":%d,\"b\":%d,\"dimming\":%d}}", 
-            colour.red(), colour.green(), colour.blue(), brightness);
-        
-        if (m_cachedIp != ip) {
-            m_cachedIp = ip;
-            m_cachedAddress = QHostAddress(ip);
-        }
-        
-        m_socket.writeDatagram(buffer, len, m_cachedAddress, port);
-    }
-
-private:
-    QUdpSocket m_socket;
-    QString m_cachedIp;
-    QHostAddress m_cachedAddress;
-};
-
-// High-priority thread for screen capture
-class ScreenCaptureThread : public QThread {
-    Q_OBJECT
-public:
-    ScreenCaptureThread(QObject *parent = nullptr) : QThread(parent) {
-        m_active = false;
-        m_x = 0;
-        m_y = 0;
-        m_size = 10;
-        m_updateThreshold = 1;
-    }
-    
-    void setParameters(int x, int y, int size, int threshold) {
-        QMutexLocker locker(&m_mutex);
-        m_x = x;
-        m_y = y;
-        m_size = size;
-        m_updateThreshold = threshold;
-    }
-    
-    void startCapture() {
-        if (!m_active) {
-            m_active = true;
-            if (!isRunning()) {
-                start(QThread::HighPriority);
-            }
-        }
-    }
-    
-    void stopCapture() {
-        m_active = false;
-        wait();
-    }
-
-signals:
-    void colourCaptured(const QColor &colour);
-
-protected:
-    void run() override {
-        // Set maximum thread priority
-        #ifdef Q_OS_WIN
-        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
-        #elif defined(Q_OS_LINUX)
-        struct sched_param param;
-        param.sched_priority = sched_get_priority_max(SCHED_RR);
-        pthread_setschedparam(pthread_self(), SCHED_RR, &param);
-        #endif
-        
-        QScreen *screen = QGuiApplication::primaryScreen();
-        if (!screen) return;
-        
-        QColor lastColour;
-        QColor currentColour;
-        
-        const int targetFPS = 60;
-        const int sleepTime = 1000 / targetFPS;
-        
-        QRect captureRect;
-        QRect screenRect = screen->geometry();
-        
-        QElapsedTimer timer;
-        timer.start();
-        
-        while (m_active) {
-            {
-                QMutexLocker locker(&m_mutex);
-                captureRect.setRect(m_x - m_size/2, m_y - m_size/2, m_size, m_size);
-            }
-            
-            if (captureRect.width() <= 0 || captureRect.height() <= 0) {
-                captureRect.setWidth(1);
-                captureRect.setHeight(1);
-            }
-            
-            captureRect = captureRect.intersected(screenRect);
-            
-            if (captureRect.isEmpty()) {
-                QThread::msleep(sleepTime);
-                continue;
-            }
-            
-            QPixmap pixmap = screen->grabWindow(0, 
-                captureRect.x(), captureRect.y(), 
-                captureRect.width(), captureRect.height());
-            
-            if (pixmap.isNull()) {
-                QThread::msleep(sleepTime);
-                continue;
-            }
-            
-            if (captureRect.width() == 1 && captureRect.height() == 1) {
-                currentColour = pixmap.toImage().pixelColor(0, 0);
-            } else {
-                QImage image = pixmap.toImage();
-                
-                if (image.isNull()) {
-                    QThread::msleep(sleepTime);
-                    continue;
-                }
-                
-                quint64 rTotal = 0, gTotal = 0, bTotal = 0;
-                int pixelCount = 0;
-                
-                for (int y = 0; y < image.height(); ++y) {
-                    const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
-                    for (int x = 0; x < image.width(); ++x) {
-                        QRgb pixel = line[x];
-                        rTotal += qRed(pixel);
-                        gTotal += qGreen(pixel);
-                        bTotal += qBlue(pixel);
-                        pixelCount++;
-                    }
-                }
-
-                if (pixelCount > 0) {
-                    currentColour = QColor(
-                        rTotal / pixelCount,
-                        gTotal / pixelCount,
-                        bTotal / pixelCount
-                    );
-                } else {
-                    currentColour = QColor(0, 0, 0);
-                }
-            }
-            
-            if (!currentColour.isValid()) {
-                currentColour = QColor(0, 0, 0);
-            }
-            
-            // Only emit if colour changed significantly
-            if (!lastColour.isValid() || 
-                qAbs(currentColour.red() - lastColour.red()) +
-                qAbs(currentColour.green() - lastColour.green()) +
-                qAbs(currentColour.blue() - lastColour.blue()) > m_updateThreshold) {
-                
-                lastColour = currentColour;
-                emit colourCaptured(currentColour);
-            }
-            
-            int elapsed = timer.elapsed();
-            timer.restart();
-            if (elapsed < sleepTime) {
-                QThread::msleep(sleepTime - elapsed);
-            }
-        }
-    }
-
-private:
-    QMutex m_mutex;
-    std::atomic<bool> m_active;
-    int m_x, m_y, m_size;
-    int m_updateThreshold;
-};
-
-// Overlay for mouse-based position selection
 // Overlay for mouse-based position selection
 class EyedropperOverlay : public QWidget {
     Q_OBJECT
@@ -331,10 +151,18 @@ public:
         m_captureX = QGuiApplication::primaryScreen()->geometry().width() / 2;
         m_captureY = QGuiApplication::primaryScreen()->geometry().height() / 2;
         m_captureSize = 10;
+        m_sampleBudget = 0;
+        m_reducer = ColourReducer::Mean;
         m_wizIp = "192.168.";
         m_wizPort = 38899;
         m_brightness = 100;
+        m_rateLimit = 0;
         m_updateThreshold = 3;
+        m_changeMetric = ChangeMetric::Rgb;
+        m_deltaEThreshold = 2.3;
+        m_fpsLimit = 60;
+        m_idleFps = 0;
+        m_outputRate = 0;
         m_gamma = 0.6;
         m_saturation = 1.8;
         m_redFactor = 1.2;
@@ -370,27 +198,74 @@ public:
         QHBoxLayout *posLayout = new QHBoxLayout;
         posLayout->addWidget(new QLabel("X:"));
         m_xSpinBox = new QSpinBox;
-        m_xSpinBox->setRange(0, 5000);
-        m_xSpinBox->setValue(m_captureX);
         posLayout->addWidget(m_xSpinBox);
         
         posLayout->addWidget(new QLabel("Y:"));
         m_ySpinBox = new QSpinBox;
-        m_ySpinBox->setRange(0, 5000);
-        m_ySpinBox->setValue(m_captureY);
         posLayout->addWidget(m_ySpinBox);
         
+        // Positions span the whole desktop, which changes with the monitors
+        updatePositionRanges();
+        m_xSpinBox->setValue(m_captureX);
+        m_ySpinBox->setValue(m_captureY);
+        connect(qApp, &QGuiApplication::screenAdded, this, &WizLedController::updatePositionRanges);
+        connect(qApp, &QGuiApplication::screenRemoved, this, &WizLedController::updatePositionRanges);
+        
         posLayout->addWidget(new QLabel("Size:"));
         m_sizeSpinBox = new QSpinBox;
-        m_sizeSpinBox->setRange(1, 50);
+        m_sizeSpinBox->setRange(1, 2000);
         m_sizeSpinBox->setValue(m_captureSize);
         posLayout->addWidget(m_sizeSpinBox);
 
+        posLayout->addWidget(new QLabel("Sample:"));
+        m_sampleSpinBox = new QSpinBox;
+        m_sampleSpinBox->setRange(0, 65536);
+        m_sampleSpinBox->setSingleStep(256);
+        m_sampleSpinBox->setSuffix(" px");
+        m_sampleSpinBox->setSpecialValueText("All");
+        m_sampleSpinBox->setValue(m_sampleBudget);
+        m_sampleSpinBox->setToolTip("Pixels read per frame from large regions, spread evenly over them. Keeps the cost of big regions down with a colour that's off by at most a few levels.");
+        posLayout->addWidget(m_sampleSpinBox);
+
         QPushButton *eyedropperButton = new QPushButton("Pick Position");
         connect(eyedropperButton, &QPushButton::clicked, this, &WizLedController::startEyedropperMode);
         posLayout->addWidget(eyedropperButton);
         
         captureLayout->addLayout(posLayout);
+
+        QHBoxLayout *reducerLayout = new QHBoxLayout;
+        reducerLayout->addWidget(new QLabel("Colour:"));
+        m_reducerComboBox = new QComboBox;
+        m_reducerComboBox->addItem("Average", int(ColourReducer::Mean));
+        m_reducerComboBox->addItem("Dominant", int(ColourReducer::Dominant));
+        m_reducerComboBox->addItem("Dominant (vivid)", int(ColourReducer::Vivid));
+        m_reducerComboBox->setToolTip("Average blends everything in the region, which turns mixed content grey. Dominant picks the most common colour, and vivid prefers colourful ones over greys.");
+        reducerLayout->addWidget(m_reducerComboBox);
+        reducerLayout->addWidget(new QLabel("Change:"));
+        m_changeMetricComboBox = new QComboBox;
+        m_changeMetricComboBox->addItem("RGB", int(ChangeMetric::Rgb));
+        m_changeMetricComboBox->addItem("ΔE 1976", int(ChangeMetric::Cie76));
+        m_changeMetricComboBox->addItem("ΔE 2000", int(ChangeMetric::Ciede2000));
+        m_changeMetricComboBox->setToolTip("How far the colour must move before it's sent. RGB reacts to invisible shifts in dark tones; ΔE measures the difference as the eye sees it, and ΔE 2000 most closely.");
+        reducerLayout->addWidget(m_changeMetricComboBox);
+        m_deltaESpinBox = new QDoubleSpinBox;
+        m_deltaESpinBox->setRange(0.1, 50.0);
+        m_deltaESpinBox->setSingleStep(0.1);
+        m_deltaESpinBox->setDecimals(1);
+        m_deltaESpinBox->setValue(m_deltaEThreshold);
+        m_deltaESpinBox->setEnabled(false);
+        m_deltaESpinBox->setToolTip("Smallest ΔE worth sending. Around 2.3 is the smallest difference most people notice.");
+        reducerLayout->addWidget(m_deltaESpinBox);
+        reducerLayout->addStretch();
+        captureLayout->addLayout(reducerLayout);
+
+        QHBoxLayout *edgesLayout = new QHBoxLayout;
+        edgesLayout->addWidget(new QLabel("Edges:"));
+        m_edgesEdit = new QLineEdit;
+        m_edgesEdit->setPlaceholderText("Off, or e.g. 16x9");
+        m_edgesEdit->setToolTip("Segments along the screen's edges, one bulb each in the order of the IP addresses, clockwise from the top left: 16x9 for 16 along the top and bottom and 9 down each side, or top,right,bottom,left. Replaces the region above.");
+        edgesLayout->addWidget(m_edgesEdit);
+        captureLayout->addLayout(edgesLayout);
         
         connect(m_xSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), 
                 this, &WizLedController::onCapturePositionChanged);
@@ -398,6 +273,29 @@ public:
                 this, &WizLedController::onCapturePositionChanged);
         connect(m_sizeSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), 
                 this, [this](int value) { m_captureSize = value; updateCaptureParameters(); });
+        connect(m_sampleSpinBox, QOverload<int>::of(&QSpinBox::valueChanged),
+                this, [this](int value) { m_sampleBudget = value; publishSettings(); });
+        connect(m_reducerComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this]() {
+            m_reducer = ColourReducer(m_reducerComboBox->currentData().toInt());
+            publishSettings();
+        });
+        connect(m_changeMetricComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this]() {
+            m_changeMetric = ChangeMetric(m_changeMetricComboBox->currentData().toInt());
+            m_deltaESpinBox->setEnabled(m_changeMetric != ChangeMetric::Rgb);
+            publishSettings();
+        });
+        connect(m_deltaESpinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
+                this, [this](double value) { m_deltaEThreshold = value; publishSettings(); });
+        connect(m_edgesEdit, &QLineEdit::editingFinished, this, [this]() {
+            bool ok = false;
+            const EdgeLayout edges = parseEdgeLayout(m_edgesEdit->text(), m_edges, &ok);
+            if (!ok) {
+                m_statusLabel->setText("Edges must be like 16x9 or top,right,bottom,left");
+                return;
+            }
+            m_edges = edges;
+            publishSettings();
+        });
         
         QPushButton *testColourButton = new QPushButton("Test: Send Red Colour");
         connect(testColourButton, &QPushButton::clicked, this, [this]() {
@@ -420,6 +318,9 @@ public:
         QHBoxLayout *ipLayout = new QHBoxLayout;
         ipLayout->addWidget(new QLabel("IP Address:"));
         m_ipEdit = new QLineEdit(m_wizIp);
+        m_ipEdit->setToolTip("One or more bulb IPs separated by commas or spaces. Each may take :port for a port other than 38899, "
+                             "@n for its own brightness and #n for the zone it shows, counted from 0, "
+                             "e.g. 192.168.1.21@60#1 or 192.168.1.22:38900");
         ipLayout->addWidget(m_ipEdit);
         
         ipLayout->addWidget(new QLabel("Brightness:"));
@@ -428,6 +329,15 @@ public:
         m_brightnessSpinBox->setValue(m_brightness);
         ipLayout->addWidget(m_brightnessSpinBox);
         
+        ipLayout->addWidget(new QLabel("Max Rate:"));
+        m_rateLimitSpinBox = new QSpinBox;
+        m_rateLimitSpinBox->setRange(0, 100);
+        m_rateLimitSpinBox->setSuffix("/s");
+        m_rateLimitSpinBox->setSpecialValueText("Unlimited");
+        m_rateLimitSpinBox->setValue(m_rateLimit);
+        m_rateLimitSpinBox->setToolTip("Most updates per second sent to each bulb. Bulbs that are sent more than they can handle start lagging behind.");
+        ipLayout->addWidget(m_rateLimitSpinBox);
+        
         wizLayout->addLayout(ipLayout);
         
         // Colour correction controls
@@ -475,6 +385,27 @@ public:
         wbLayout->addWidget(m_blueFactorSpinBox);
         
         correctionLayout->addLayout(wbLayout);
+        
+        QHBoxLayout *smoothingLayout = new QHBoxLayout;
+        smoothingLayout->addWidget(new QLabel("Smoothing:"));
+        m_filterComboBox = new QComboBox;
+        m_filterComboBox->addItem("None", int(FilterSettings::None));
+        m_filterComboBox->addItem("Moving average", int(FilterSettings::Ema));
+        m_filterComboBox->addItem("Spring", int(FilterSettings::Spring));
+        m_filterComboBox->addItem("Kalman", int(FilterSettings::Kalman));
+        m_filterComboBox->setToolTip("Smooths flicker and fades between colours instead of stepping");
+        smoothingLayout->addWidget(m_filterComboBox);
+        
+        smoothingLayout->addWidget(new QLabel("Response:"));
+        m_responseSpinBox = new QSpinBox;
+        m_responseSpinBox->setRange(10, 2000);
+        m_responseSpinBox->setSingleStep(10);
+        m_responseSpinBox->setSuffix(" ms");
+        m_responseSpinBox->setValue(int(m_filter.responseMs));
+        m_responseSpinBox->setToolTip("Time to cover 90% of a change (moving average and spring)");
+        smoothingLayout->addWidget(m_responseSpinBox);
+        correctionLayout->addLayout(smoothingLayout);
+        
         correctionGroup->setLayout(correctionLayout);
         wizLayout->addWidget(correctionGroup);
         
@@ -484,6 +415,20 @@ public:
         m_fpsSpinBox->setRange(30, 200);
         m_fpsSpinBox->setValue(60);
         fpsLayout->addWidget(m_fpsSpinBox);
+
+        fpsLayout->addWidget(new QLabel("Idle:"));
+        m_idleFpsSpinBox = new QSpinBox;
+        m_idleFpsSpinBox->setRange(0, 30);
+        m_idleFpsSpinBox->setSpecialValueText("Off");
+        m_idleFpsSpinBox->setToolTip("Capture rate to fall to after a second or two without changes; the full rate comes back with the first change");
+        fpsLayout->addWidget(m_idleFpsSpinBox);
+        
+        fpsLayout->addWidget(new QLabel("Output:"));
+        m_outputRateSpinBox = new QSpinBox;
+        m_outputRateSpinBox->setRange(0, 200);
+        m_outputRateSpinBox->setSpecialValueText("Capture");
+        m_outputRateSpinBox->setToolTip("Colours sent per second; Capture sends as they are captured");
+        fpsLayout->addWidget(m_outputRateSpinBox);
         
         fpsLayout->addWidget(new QLabel("FPS:"));
         m_fpsLabel = new QLabel("0");
@@ -494,23 +439,36 @@ public:
         connect(applyButton, &QPushButton::clicked, this, &WizLedController::applyWizSettings);
         wizLayout->addWidget(applyButton);
         
+        QPushButton *latencyButton = new QPushButton("Save Latency Stats...");
+        latencyButton->setToolTip("Time spent in each stage from grabbing the screen to sending the colour");
+        connect(latencyButton, &QPushButton::clicked, this, &WizLedController::saveLatencyStats);
+        wizLayout->addWidget(latencyButton);
+        
         wizGroup->setLayout(wizLayout);
         mainLayout->addWidget(wizGroup);
         
         m_statusLabel = new QLabel("Ready");
         mainLayout->addWidget(m_statusLabel);
         
-        m_udpSender = new UdpSender();
+        // Captured colours go straight from the capture thread to the sender
+        // thread; the GUI only sees the sender's throttled preview
+        m_senderThread = new SenderThread(&m_settings, this);
+        m_senderThread->setLatencyStats(&m_latency);
+        connect(m_senderThread, &SenderThread::preview, this, &WizLedController::updateUIColours);
+        m_senderThread->startSending();
         
-        m_captureThread = new ScreenCaptureThread(this);
-        connect(m_captureThread, &ScreenCaptureThread::colourCaptured, 
-                this, &WizLedController::onColourCaptured);
+        m_captureThread = new ScreenCaptureThread(&m_settings, this);
+        m_captureThread->setLatencyStats(&m_latency);
+        connect(m_captureThread, &ScreenCaptureThread::coloursCaptured, 
+                m_senderThread, &SenderThread::push, Qt::DirectConnection);
         
         m_fpsTimer = new QTimer(this);
         connect(m_fpsTimer, &QTimer::timeout, this, &WizLedController::updateFPS);
         m_fpsTimer->start(1000);
         
-        m_frameCount = 0;
+        m_lastCapturedFrames = 0;
+        m_lastEmittedFrames = 0;
+        m_lastSentFrames = 0;
         m_lastFrameTime = QDateTime::currentMSecsSinceEpoch();
     }
     
@@ -518,53 +476,128 @@ public:
         if (m_captureActive) {
             m_captureThread->stopCapture();
         }
-        delete m_udpSender;
+        m_senderThread->stopSending();
+    }
+
+    // Captures from sources instead of every screen, sleeping on watcher
+    // between changes if there is one
+    void setFrameSources(FrameSources sources, std::unique_ptr<ScreenChangeWatcher> watcher) {
+        m_captureThread->setFrameSources(std::move(sources));
+        m_captureThread->setChangeWatcher(std::move(watcher));
     }
 
+    const LatencyStats &latencyStats() const { return m_latency; }
+
 private:
-    // Applies colour corrections including gamma, saturation and RGB balance
-    QColor processColour(const QColor &original) {
-        if (!original.isValid()) {
-            return QColor(0, 0, 0);
+    // Publishes the applied settings as a new snapshot for the pipeline
+    void publishSettings() {
+        PipelineSettings settings = m_settings.current();
+
+        const int half = m_captureSize / 2;
+        settings.zones = { CaptureZone{"centre", QRect(m_captureX - half, m_captureY - half,
+                                                       m_captureSize, m_captureSize), m_filter} };
+        settings.summedAreaScale = 0;
+        if (!m_edges.isEmpty()) {
+            settings.zones = edgeZones(m_edges, QGuiApplication::primaryScreen()->geometry(), m_filter);
+            settings.summedAreaScale = m_edges.scale;
         }
-        
-        if ((original.red() < 5 && original.green() < 5 && original.blue() < 5) || 
-            (original.red() > 250 && original.green() > 250 && original.blue() > 250)) {
-            return original;
+        settings.sampleBudget = m_sampleBudget;
+        settings.reducer = m_reducer;
+        settings.threshold = m_updateThreshold;
+        settings.changeMetric = m_changeMetric;
+        settings.deltaEThreshold = float(m_deltaEThreshold);
+        settings.fps = m_fpsLimit;
+        settings.idleFps = m_idleFps;
+        settings.outputRate = m_outputRate;
+        settings.correction.gamma = m_gamma;
+        settings.correction.saturation = m_saturation;
+        settings.correction.redFactor = m_redFactor;
+        settings.correction.greenFactor = m_greenFactor;
+        settings.correction.blueFactor = m_blueFactor;
+        settings.targets = UdpSender::parseTargets(m_wizIp, m_brightness, m_wizPort);
+        if (!m_edges.isEmpty()) {
+            assignEdgeZones(settings.targets, m_edges.segments());
         }
-        
-        float gamma = m_gammaSpinBox->value();
-        float r = pow(original.redF(), 1.0f / gamma) * m_redFactorSpinBox->value();
-        float g = pow(original.greenF(), 1.0f / gamma) * m_greenFactorSpinBox->value();
-        float b = pow(original.blueF(), 1.0f / gamma) * m_blueFactorSpinBox->value();
-        
-        r = qBound<float>(0.0f, r, 1.0f);
-        g = qBound<float>(0.0f, g, 1.0f);
-        b = qBound<float>(0.0f, b, 1.0f);
-        
-        QColor hsl = QColor::fromRgbF(r, g, b).toHsl();
-        
-        float saturation = m_saturationSpinBox->value();
-        float s = qBound<float>(0.0f, hsl.hslSaturationF() * saturation, 1.0f);
-        hsl.setHslF(hsl.hslHueF(), s, hsl.lightnessF());
-        
-        return hsl.toRgb();
+        settings.brightness = m_brightness;
+        settings.bulbRateLimit = m_rateLimit;
+
+        m_settings.publish(settings);
+        m_senderThread->settingsChanged();
     }
 
 private slots:
     void updateFPS() {
         qint64 now = QDateTime::currentMSecsSinceEpoch();
         qint64 elapsed = now - m_lastFrameTime;
+        quint64 captured = m_latency.captured();
+        quint64 emitted = m_latency.emitted();
+        quint64 sent = m_latency.sent();
+        FrameTiming timing = m_captureThread->frameTiming();
         
         if (elapsed > 0) {
-            double fps = m_frameCount * 1000.0 / elapsed;
-            m_fpsLabel->setText(QString::number(fps, 'f', 1));
+            // Emitted is below captured while the colour holds still, and sent
+            // can differ again with smoothing or an output rate
+            auto rate = [elapsed](quint64 count, quint64 last) {
+                return QString::number((count - last) * 1000.0 / elapsed, 'f', 1);
+            };
+            QString text = QString("Capture %1, emit %2, send %3")
+                           .arg(rate(captured, m_lastCapturedFrames))
+                           .arg(rate(emitted, m_lastEmittedFrames))
+                           .arg(rate(sent, m_lastSentFrames));
+            
+            FrameTiming::Stats capture = timing.since(m_lastFrameTiming);
+            if (capture.frames > 0) {
+                text += QString(" (jitter %1 ms, %2 skipped)")
+                        .arg(capture.jitterUs / 1000.0, 0, 'f', 2)
+                        .arg(capture.skipped);
+            }
+            const GovernorStats governor = m_captureThread->governorStats();
+            if (m_idleFps > 0 && governor.fps < m_fpsLimit) {
+                text += QString(", idling at %1").arg(governor.fps);
+            }
+            // Only bulbs that answer have round-trip times to show
+            double rttMs = 0;
+            quint64 acknowledged = 0;
+            quint64 lost = 0;
+            for (const BulbLinkStats &link : m_senderThread->linkStats()) {
+                rttMs = qMax(rttMs, link.rttMs);
+                acknowledged += link.acknowledged;
+                lost += link.lost;
+            }
+            if (acknowledged > 0) {
+                text += QString(", RTT %1 ms, %2% lost")
+                        .arg(rttMs, 0, 'f', 1)
+                        .arg(100.0 * lost / (acknowledged + lost), 0, 'f', 1);
+            }
+            if (m_changeMetric != ChangeMetric::Rgb) {
+                text += QString(", %1 sends saved vs RGB")
+                        .arg(qint64(m_captureThread->suppressedFrames()) - qint64(m_captureThread->addedFrames()));
+            }
+            m_fpsLabel->setText(text);
         }
         
-        m_frameCount = 0;
+        m_lastCapturedFrames = captured;
+        m_lastEmittedFrames = emitted;
+        m_lastSentFrames = sent;
+        m_lastFrameTiming = timing;
         m_lastFrameTime = now;
     }
     
+    void saveLatencyStats() {
+        QString path = QFileDialog::getSaveFileName(this, "Save Latency Stats", "latency.json",
+                                                    "JSON (*.json);;CSV (*.csv)");
+        if (path.isEmpty()) {
+            return;
+        }
+        
+        QString error;
+        if (m_latency.save(path, &error)) {
+            m_statusLabel->setText(QString("Latency stats saved to %1").arg(path));
+        } else {
+            m_statusLabel->setText(QString("Couldn't save latency stats: %1").arg(error));
+        }
+    }
+    
     void startEyedropperMode() {
         // Store current capture state
         bool wasActive = m_captureActive;
@@ -626,6 +659,17 @@ private slots:
         }
     }
     
+    // Lets the position reach every monitor, including those left of or
+    // above the primary one, whose coordinates are negative
+    void updatePositionRanges() {
+        QRect desktop;
+        for (QScreen *screen : QGuiApplication::screens()) {
+            desktop = desktop.united(screen->geometry());
+        }
+        m_xSpinBox->setRange(desktop.left(), desktop.right());
+        m_ySpinBox->setRange(desktop.top(), desktop.bottom());
+    }
+    
     void onCapturePositionChanged() {
         m_captureX = m_xSpinBox->value();
         m_captureY = m_ySpinBox->value();
@@ -639,51 +683,46 @@ private slots:
     
     void updateCaptureParameters() {
         m_captureSize = m_sizeSpinBox->value();
-        m_captureThread->setParameters(m_captureX, m_captureY, m_captureSize, m_updateThreshold);
+        publishSettings();
     }
     
     void applyWizSettings() {
         m_wizIp = m_ipEdit->text();
         m_brightness = m_brightnessSpinBox->value();
+        m_rateLimit = m_rateLimitSpinBox->value();
         m_gamma = m_gammaSpinBox->value();
         m_saturation = m_saturationSpinBox->value();
         m_redFactor = m_redFactorSpinBox->value();
         m_greenFactor = m_greenFactorSpinBox->value();
         m_blueFactor = m_blueFactorSpinBox->value();
-        
-        m_statusLabel->setText(QString("Settings updated: IP=%1, Brightness=%2").arg(m_wizIp).arg(m_brightness));
-        
-        if (m_lastSentColour.isValid()) {
-            QColor tempColour = m_lastSentColour;
-            m_lastSentColour = QColor();
-            sendColour(tempColour);
-        }
+        m_fpsLimit = m_fpsSpinBox->value();
+        m_idleFps = m_idleFpsSpinBox->value();
+        m_outputRate = m_outputRateSpinBox->value();
+        m_filter.type = FilterSettings::Type(m_filterComboBox->currentData().toInt());
+        m_filter.responseMs = m_responseSpinBox->value();
+        // The sender thread resends the last colours with the new settings
+        publishSettings();
+        
+        m_statusLabel->setText(QString("Settings updated: %1 bulb(s), Brightness=%2")
+                               .arg(m_settings.current().targets.size()).arg(m_brightness));
     }
     
-    void onColourCaptured(const QColor &newColour) {
-        QMetaObject::invokeMethod(this, "updateUIColour", Qt::QueuedConnection, 
-                                 Q_ARG(QColor, newColour));
+    // Shows the first zone of the frame the sender thread last sent
+    void updateUIColours(const QVector<QColor> &colours, const QVector<QColor> &processedColours) {
+        const QColor &colour = colours.first();
+        const QColor &processedColour = processedColours.first();
         
-        m_frameCount++;
-    }
-    
-    Q_INVOKABLE void updateUIColour(const QColor &colour) {
         QPalette pal = m_colourPreview->palette();
         pal.setColor(QPalette::Window, colour);
         m_colourPreview->setPalette(pal);
         
-        sendColour(colour);
-    }
-    
-    void sendColour(const QColor &colour) {
-        QColor processedColour = processColour(colour);
-        
         m_rgbLabel->setText(QString("Original: %1,%2,%3  LED: %4,%5,%6")
                            .arg(colour.red()).arg(colour.green()).arg(colour.blue())
                            .arg(processedColour.red()).arg(processedColour.green()).arg(processedColour.blue()));
-        
-        m_udpSender->sendColour(m_wizIp, m_wizPort, processedColour, m_brightness);
-        m_lastSentColour = colour;
+    }
+    
+    void sendColour(const QColor &colour) {
+        m_senderThread->sendColours(QVector<QColor>(1, colour));
     }
 
 private:
@@ -694,10 +733,20 @@ private:
     QSpinBox *m_xSpinBox;
     QSpinBox *m_ySpinBox;
     QSpinBox *m_sizeSpinBox;
+    QSpinBox *m_sampleSpinBox;
     QSpinBox *m_brightnessSpinBox;
+    QSpinBox *m_rateLimitSpinBox;
     QSpinBox *m_fpsSpinBox;
+    QSpinBox *m_idleFpsSpinBox;
+    QSpinBox *m_outputRateSpinBox;
+    QComboBox *m_filterComboBox;
+    QComboBox *m_reducerComboBox;
+    QComboBox *m_changeMetricComboBox;
+    QDoubleSpinBox *m_deltaESpinBox;
+    QSpinBox *m_responseSpinBox;
     QLabel *m_fpsLabel;
     QLineEdit *m_ipEdit;
+    QLineEdit *m_edgesEdit;
     QDoubleSpinBox *m_gammaSpinBox;
     QDoubleSpinBox *m_saturationSpinBox;
     QDoubleSpinBox *m_redFactorSpinBox;
@@ -708,27 +757,212 @@ private:
     int m_captureX;
     int m_captureY;
     int m_captureSize;
+    int m_sampleBudget;
+    ColourReducer m_reducer;
     QString m_wizIp;
     int m_wizPort;
     int m_brightness;
-    QColor m_lastSentColour;
+    int m_rateLimit;
     int m_updateThreshold;
-    int m_frameCount;
+    ChangeMetric m_changeMetric;
+    double m_deltaEThreshold;
+    int m_fpsLimit;
+    int m_idleFps;
+    int m_outputRate;
+    FilterSettings m_filter;
+    EdgeLayout m_edges;
+    quint64 m_lastCapturedFrames;
+    quint64 m_lastEmittedFrames;
+    quint64 m_lastSentFrames;
+    FrameTiming m_lastFrameTiming;
     qint64 m_lastFrameTime;
     float m_gamma;
     float m_saturation;
     float m_redFactor;
     float m_greenFactor;
     float m_blueFactor;
+
+    // Used by the capture and sender threads, which are stopped before these
+    // go away
+    SettingsStore m_settings;
+    LatencyStats m_latency;
     
     ScreenCaptureThread *m_captureThread;
-    UdpSender *m_udpSender;
+    SenderThread *m_senderThread;
     QTimer *m_fpsTimer;
 };
 
+// Benchmarks run without widgets, and only need a display connection when
+// they capture from the screen
+static QCoreApplication *createApplication(int &argc, char *argv[]) {
+    auto isScreenSource = [](const QByteArray &spec) {
+        return spec == "screen" || spec == "xshm" || spec == "qscreen";
+    };
+
+    bool benchmark = false;
+    bool screenSource = false;
+    for (int i = 1; i < argc; ++i) {
+        const QByteArray arg(argv[i]);
+        if (arg == "--benchmark") {
+            benchmark = true;
+        } else if (arg == "--source" && i + 1 < argc) {
+            screenSource = isScreenSource(argv[++i]);
+        } else if (arg.startsWith("--source=")) {
+            screenSource = isScreenSource(arg.mid(9));
+        }
+    }
+
+    if (!benchmark) {
+        return new QApplication(argc, argv);
+    }
+    if (screenSource) {
+        return new QGuiApplication(argc, argv);
+    }
+    return new QCoreApplication(argc, argv);
+}
+
+static void saveLatencyDump(const LatencyStats &latency, const QString &path) {
+    QString error;
+    if (!latency.save(path, &error)) {
+        qWarning("Couldn't write latency stats to %s: %s", qPrintable(path), qPrintable(error));
+    }
+}
+
 int main(int argc, char *argv[]) {
-    QApplication app(argc, argv);
-    
+    QScopedPointer<QCoreApplication> app(createApplication(argc, argv));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Mirrors a region of the screen onto WiZ LEDs");
+    parser.addHelpOption();
+    QCommandLineOption sourceOption("source",
+        "Frame source: screen, xshm, qscreen, synthetic[:gradient|flicker|noise[:WxH]] or raw:<path>:<WxH>.",
+        "spec");
+    QCommandLineOption benchmarkOption("benchmark",
+        "Run the capture pipeline without a window and print its throughput.");
+    QCommandLineOption durationOption("duration", "Benchmark duration in seconds.", "seconds", "10");
+    QCommandLineOption sizeOption("size", "Benchmark capture size in pixels.", "pixels", "10");
+    QCommandLineOption zonesOption("zones", "Benchmark a grid of zones covering the source, e.g. 8x4.", "grid");
+    QCommandLineOption edgesOption("edges",
+        "Benchmark segments along the source's edges, as 16x9 or top,right,bottom,left.", "segments");
+    QCommandLineOption edgeDepthOption("edge-depth",
+        "Benchmark edge strip thickness, percent of the shorter side.", "percent", "10");
+    QCommandLineOption edgeScaleOption("edge-scale",
+        "Benchmark summed-area table cell size for edges.", "pixels", "8");
+    QCommandLineOption ipOption("ip", "Benchmark target address.", "address", "127.0.0.1");
+    QCommandLineOption fpsOption("fps", "Benchmark capture rate, or 0 for unthrottled.", "fps", "0");
+    QCommandLineOption filterOption("filter",
+        "Benchmark smoothing: none, ema[:ms], spring[:ms] or kalman[:process[:measurement]].",
+        "spec", "none");
+    QCommandLineOption bulbRateOption("bulb-rate",
+        "Benchmark updates per second per bulb, or 0 for no limit.", "rate", "0");
+    QCommandLineOption reducerOption("reducer",
+        "Benchmark zone colour: mean, dominant or vivid.", "name", "mean");
+    QCommandLineOption sampleOption("sample-budget",
+        "Benchmark pixels read per zone and frame, or 0 for all.", "pixels", "0");
+    QCommandLineOption changeMetricOption("change-metric",
+        "Benchmark change gate: rgb (every frame), cie76 or ciede2000.", "name", "rgb");
+    QCommandLineOption deltaEOption("delta-e",
+        "Benchmark minimum ΔE worth sending, with a ΔE change gate.", "delta", "2.3");
+    QCommandLineOption latencyOption("latency-dump",
+        "Write per-stage latency histograms on exit, as CSV if the path ends in .csv or JSON otherwise.",
+        "path");
+    QCommandLineOption outputRateOption("output-rate",
+        "Benchmark colours sent per second, or 0 to follow capture.", "fps", "0");
+    parser.addOption(sourceOption);
+    parser.addOption(benchmarkOption);
+    parser.addOption(durationOption);
+    parser.addOption(sizeOption);
+    parser.addOption(zonesOption);
+    parser.addOption(edgesOption);
+    parser.addOption(edgeDepthOption);
+    parser.addOption(edgeScaleOption);
+    parser.addOption(ipOption);
+    parser.addOption(fpsOption);
+    parser.addOption(filterOption);
+    parser.addOption(outputRateOption);
+    parser.addOption(bulbRateOption);
+    parser.addOption(sampleOption);
+    parser.addOption(reducerOption);
+    parser.addOption(changeMetricOption);
+    parser.addOption(deltaEOption);
+    parser.addOption(latencyOption);
+    parser.process(*app);
+
+    // Benchmarks default to a synthetic source so they work headless
+    QString sourceSpec = parser.value(sourceOption);
+    if (sourceSpec.isEmpty() && parser.isSet(benchmarkOption)) {
+        sourceSpec = "synthetic";
+    }
+
+    FrameSources sources;
+    if (!sourceSpec.isEmpty()) {
+        QString error;
+        sources = createFrameSources(sourceSpec, &error);
+        if (sources.empty()) {
+            qCritical("%s", qPrintable(error));
+            return 1;
+        }
+    }
+
+    if (parser.isSet(benchmarkOption)) {
+        QSize zoneGrid;
+        const QStringList grid = parser.value(zonesOption).split('x');
+        if (grid.size() == 2) {
+            zoneGrid = QSize(qMax(1, grid[0].toInt()), qMax(1, grid[1].toInt()));
+        }
+
+        bool filterOk = false;
+        const FilterSettings filter = parseFilterSettings(parser.value(filterOption), &filterOk);
+        if (!filterOk) {
+            qCritical("Invalid filter: %s", qPrintable(parser.value(filterOption)));
+            return 1;
+        }
+
+        EdgeLayout edgeLayout;
+        edgeLayout.depth = qBound(1, parser.value(edgeDepthOption).toInt(), 50);
+        edgeLayout.scale = qMax(1, parser.value(edgeScaleOption).toInt());
+        bool edgesOk = false;
+        edgeLayout = parseEdgeLayout(parser.value(edgesOption), edgeLayout, &edgesOk);
+        if (!edgesOk) {
+            qCritical("Invalid edges: %s", qPrintable(parser.value(edgesOption)));
+            return 1;
+        }
+
+        // The benchmark captures one source, the primary screen's for screens
+        PipelineBenchmark benchmark(std::move(sources.front()), parser.value(ipOption), 38899,
+                                    qMax(1, parser.value(sizeOption).toInt()), zoneGrid);
+        if (!edgeLayout.isEmpty()) {
+            benchmark.setEdges(edgeLayout);
+        }
+        benchmark.setFrameRate(qMax(0, parser.value(fpsOption).toInt()));
+        benchmark.setSmoothing(filter, qMax(0, parser.value(outputRateOption).toInt()));
+        benchmark.setBulbRateLimit(qMax(0, parser.value(bulbRateOption).toInt()));
+        benchmark.setSampleBudget(qMax(0, parser.value(sampleOption).toInt()));
+
+        bool reducerOk = false;
+        benchmark.setReducer(parseColourReducer(parser.value(reducerOption), &reducerOk));
+        if (!reducerOk) {
+            qCritical("Invalid reducer: %s", qPrintable(parser.value(reducerOption)));
+            return 1;
+        }
+        bool metricOk = false;
+        const ChangeMetric metric = parseChangeMetric(parser.value(changeMetricOption), &metricOk);
+        if (!metricOk) {
+            qCritical("Invalid change metric: %s", qPrintable(parser.value(changeMetricOption)));
+            return 1;
+        }
+        if (metric != ChangeMetric::Rgb) {
+            benchmark.setChangeGate(metric, qMax(0.0f, parser.value(deltaEOption).toFloat()));
+        }
+        QObject::connect(&benchmark, &PipelineBenchmark::finished, app.data(), &QCoreApplication::quit);
+        benchmark.start(qMax(1, parser.value(durationOption).toInt()));
+        const int result = app->exec();
+        if (parser.isSet(latencyOption)) {
+            saveLatencyDump(benchmark.latencyStats(), parser.value(latencyOption));
+        }
+        return result;
+    }
+
     #ifdef Q_OS_WIN
     SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS);
     #endif
@@ -736,11 +970,18 @@ int main(int argc, char *argv[]) {
     QCoreApplication::setAttribute(Qt::AA_DisableHighDpiScaling);
     QGuiApplication::setHighDpiScaleFactorRoundingPolicy(Qt::HighDpiScaleFactorRoundingPolicy::PassThrough);
     
-    app.setAttribute(Qt::AA_DisableWindowContextHelpButton);
+    app->setAttribute(Qt::AA_DisableWindowContextHelpButton);
     
     WizLedController controller;
+    if (!sources.empty()) {
+        controller.setFrameSources(std::move(sources), createScreenChangeWatcher(sourceSpec));
+    }
     controller.show();
-    return app.exec();
+    const int result = app->exec();
+    if (parser.isSet(latencyOption)) {
+        saveLatencyDump(controller.latencyStats(), parser.value(latencyOption));
+    }
+    return result;
 }
 
 #include "main.moc"
\ No newline at end of file
@@ -0,0 +1,115 @@
+// The capture governor fed synthetic frame streams on a simulated clock
+
+#include <QtTest/QtTest>
+#include <algorithm>
+#include <random>
+
+#include "CaptureGovernor.h"
+#include "ColourDifference.h"
+#include "SampleData.h"
+#include "ScreenCaptureThread.h"
+
+class CaptureGovernorTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void governorIdlesAndWakes();
+    void jitterUnderThresholdIdles();
+};
+
+// Feeds the governor a minute of 60 FPS capture: still, a scene cut, and
+// changes every 0.9 s. It must reach the idle rate, come straight back on
+// the cut, and hold the full rate while changes keep coming.
+void CaptureGovernorTests::governorIdlesAndWakes() {
+    CaptureGovernor governor;
+    governor.setRates(60, 5);
+
+    qint64 now = 1000000000;
+    auto run = [&governor, &now](qint64 ns, qint64 changeEveryNs) {
+        qint64 sinceChange = 0;
+        while (ns > 0) {
+            const qint64 period = 1000000000 / governor.rate();
+            sinceChange += period;
+            const bool changed = changeEveryNs > 0 && sinceChange >= changeEveryNs;
+            if (changed) {
+                sinceChange = 0;
+            }
+            governor.frame(now, changed);
+            now += period;
+            ns -= period;
+        }
+    };
+
+    run(5000000000, 0);
+    QCOMPARE(governor.rate(), 5);
+    QCOMPARE(governor.stats().rampDowns, quint64(4));
+    QCOMPARE(governor.frame(now, true), 60);
+    run(20000000000, 900000000);
+    QCOMPARE(governor.rate(), 60);
+
+    const GovernorStats stats = governor.stats();
+    QCOMPARE(stats.rampDowns, quint64(4));
+    QCOMPARE(stats.wakeUps, quint64(1));
+    qInfo("Governor: %.1f s idle", stats.idleUs / 1e6);
+}
+
+// Still content with noise under the default thresholds: each channel of
+// each zone flickers between two neighbouring levels, like dither or
+// compression noise. Judged against the frame before the way the capture
+// thread judges it, under each change metric, the noise must neither keep
+// the governor from the idle rate nor wake it, while a real change must.
+void CaptureGovernorTests::jitterUnderThresholdIdles() {
+    const PipelineSettings defaults;
+    std::mt19937 random(5);
+    QVector<QColor> base = randomColours(16, random);
+    for (QColor &colour : base) {
+        colour.setRgb(std::min(colour.red(), 254), std::min(colour.green(), 254),
+                      std::min(colour.blue(), 254));
+    }
+
+    for (ChangeMetric metric : { ChangeMetric::Rgb, ChangeMetric::Cie76, ChangeMetric::Ciede2000 }) {
+        CaptureGovernor governor;
+        governor.setRates(60, 5);
+
+        QVector<QColor> previous = base;
+        QVector<QColor> colours;
+        QVector<LabColour> previousLab;
+        QVector<LabColour> lab;
+        toLab(previous, previousLab);
+        qint64 now = 1000000000;
+        auto frame = [&](const QVector<QColor> &next) {
+            bool moved;
+            if (metric == ChangeMetric::Rgb) {
+                moved = ScreenCaptureThread::coloursChanged(previous, next, defaults.threshold);
+            } else {
+                toLab(next, lab);
+                moved = coloursDiffer(previousLab, lab, metric, defaults.deltaEThreshold);
+                previousLab.swap(lab);
+            }
+            previous = next;
+            const int rate = governor.frame(now, moved);
+            now += 1000000000 / rate;
+            return rate;
+        };
+
+        for (int i = 0; i < 600; ++i) {
+            colours = base;
+            for (QColor &colour : colours) {
+                const quint32 bits = random();
+                colour.setRgb(colour.red() + (bits & 1), colour.green() + ((bits >> 1) & 1),
+                              colour.blue() + ((bits >> 2) & 1));
+            }
+            frame(colours);
+        }
+        QVERIFY2(governor.rate() == 5, changeMetricName(metric));
+        QCOMPARE(governor.stats().wakeUps, quint64(0));
+
+        colours[0].setRgb(colours[0].red() ^ 0x80, colours[0].green(), colours[0].blue());
+        QCOMPARE(frame(colours), 60);
+        QCOMPARE(governor.stats().wakeUps, quint64(1));
+    }
+}
+
+QTEST_GUILESS_MAIN(CaptureGovernorTests)
+
+#include "CaptureGovernorTests.moc"
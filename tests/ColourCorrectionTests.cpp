@@ -0,0 +1,89 @@
+// The table-driven colour corrector against the floating point reference
+// it replaces, over random colours and corners of the parameter ranges
+
+#include <QtTest/QtTest>
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "ColourCorrection.h"
+#include "SampleData.h"
+
+class ColourCorrectionTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void correctorMatchesReference();
+};
+
+// Random colours plus greys and the primaries and secondaries, through the
+// default settings, no correction and the ends of each setting's range in
+// the window. Every channel must be within one step of correctColour(), and
+// the batch path must match the single-colour one exactly.
+void ColourCorrectionTests::correctorMatchesReference() {
+    std::mt19937 random(6);
+    QVector<QColor> colours = randomColours(20000, random);
+    for (int level = 0; level < 256; ++level) {
+        colours.append(QColor(level, level, level));
+        for (int mask = 1; mask < 7; ++mask) {
+            colours.append(QColor(mask & 1 ? level : 0, mask & 2 ? level : 0, mask & 4 ? level : 0));
+        }
+    }
+
+    auto correction = [](float gamma, float saturation, float red, float green, float blue) {
+        ColourCorrection result;
+        result.gamma = gamma;
+        result.saturation = saturation;
+        result.redFactor = red;
+        result.greenFactor = green;
+        result.blueFactor = blue;
+        return result;
+    };
+    const ColourCorrection corrections[] = {
+        ColourCorrection(),
+        correction(1.0f, 1.0f, 1.0f, 1.0f, 1.0f),
+        correction(0.5f, 2.5f, 2.0f, 0.5f, 2.0f),
+        correction(3.0f, 0.5f, 0.5f, 2.0f, 0.5f),
+        correction(0.5f, 0.5f, 2.0f, 2.0f, 2.0f),
+        correction(3.0f, 2.5f, 0.5f, 0.5f, 0.5f),
+        correction(2.2f, 1.3f, 0.9f, 1.1f, 1.4f),
+    };
+
+    std::vector<quint8> red(size_t(colours.size()));
+    std::vector<quint8> green(red.size());
+    std::vector<quint8> blue(red.size());
+
+    for (const ColourCorrection &settings : corrections) {
+        ColourCorrector corrector;
+        corrector.setCorrection(settings);
+        for (int i = 0; i < colours.size(); ++i) {
+            red[size_t(i)] = quint8(colours[i].red());
+            green[size_t(i)] = quint8(colours[i].green());
+            blue[size_t(i)] = quint8(colours[i].blue());
+        }
+        corrector.correct(red.data(), green.data(), blue.data(), red.data(), green.data(), blue.data(),
+                          colours.size());
+
+        int worst = 0;
+        for (int i = 0; i < colours.size(); ++i) {
+            const QColor expected = correctColour(colours[i], settings);
+            const QColor actual = corrector.correct(colours[i]);
+            const int error = std::max({ std::abs(actual.red() - expected.red()),
+                                         std::abs(actual.green() - expected.green()),
+                                         std::abs(actual.blue() - expected.blue()) });
+            worst = std::max(worst, error);
+            QVERIFY2(error <= 1, qPrintable(QString("%1 became %2 instead of %3")
+                                            .arg(colours[i].name(), actual.name(), expected.name())));
+            QVERIFY(red[size_t(i)] == actual.red() && green[size_t(i)] == actual.green() &&
+                    blue[size_t(i)] == actual.blue());
+        }
+        qInfo("Gamma %.1f, saturation %.1f, balance %.1f/%.1f/%.1f: off by up to %d levels",
+              double(settings.gamma), double(settings.saturation), double(settings.redFactor),
+              double(settings.greenFactor), double(settings.blueFactor), worst);
+    }
+}
+
+QTEST_GUILESS_MAIN(ColourCorrectionTests)
+
+#include "ColourCorrectionTests.moc"
@@ -0,0 +1,81 @@
+// The table-driven Lab conversion and the colour difference formulas
+// against references computed straight from their definitions
+
+#include <QtTest/QtTest>
+#include <algorithm>
+#include <cmath>
+
+#include "ColourDifference.h"
+
+namespace {
+
+// Lab straight from the definition, in double precision
+LabColour referenceLab(const QColor &colour) {
+    auto linear = [](int level) {
+        const double value = level / 255.0;
+        return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+    };
+    auto curve = [](double t) {
+        return t > 216.0 / 24389.0 ? std::cbrt(t) : (24389.0 / 27.0 * t + 16) / 116;
+    };
+    const double r = linear(colour.red());
+    const double g = linear(colour.green());
+    const double b = linear(colour.blue());
+    const double fx = curve((0.4124564 * r + 0.3575761 * g + 0.1804375 * b) / 0.95047);
+    const double fy = curve(0.2126729 * r + 0.7151522 * g + 0.0721750 * b);
+    const double fz = curve((0.0193339 * r + 0.1191920 * g + 0.9503041 * b) / 1.08883);
+    return LabColour{ float(116 * fy - 16), float(500 * (fx - fy)), float(200 * (fy - fz)) };
+}
+
+} // namespace
+
+class ColourDifferenceTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void labTablesMatchReference();
+    void ciede2000MatchesTestPairs();
+};
+
+// The table-driven conversion against the reference over the whole RGB cube
+void ColourDifferenceTests::labTablesMatchReference() {
+    float worst = 0;
+    for (int r = 0; r < 256; ++r) {
+        for (int g = 0; g < 256; ++g) {
+            for (int b = 0; b < 256; ++b) {
+                const QColor colour(r, g, b);
+                worst = std::max(worst, deltaE76(toLab(colour), referenceLab(colour)));
+            }
+        }
+    }
+    qInfo("Lab tables: off by up to %.4f dE", double(worst));
+    QVERIFY(worst <= 0.002f);
+}
+
+// Pairs from Sharma, Wu and Dalal's CIEDE2000 test data, both ways round
+void ColourDifferenceTests::ciede2000MatchesTestPairs() {
+    struct Pair {
+        LabColour first;
+        LabColour second;
+        float expected;
+    };
+    const Pair pairs[] = {
+        { { 50.0f, 2.6772f, -79.7751f }, { 50.0f, 0.0f, -82.7485f }, 2.0425f },
+        { { 50.0f, -1.3802f, -84.2814f }, { 50.0f, 0.0f, -82.7485f }, 1.0000f },
+        { { 50.0f, 0.0f, 0.0f }, { 50.0f, -1.0f, 2.0f }, 2.3669f },
+        { { 50.0f, 2.5f, 0.0f }, { 73.0f, 25.0f, -18.0f }, 27.1492f },
+        { { 50.0f, 2.5f, 0.0f }, { 50.0f, 3.1736f, 0.5854f }, 1.0000f },
+        { { 60.2574f, -34.0099f, 36.2677f }, { 60.4626f, -34.1751f, 39.4387f }, 1.2644f },
+        { { 22.7233f, 20.0904f, -46.6940f }, { 23.0331f, 14.9730f, -42.5619f }, 2.0373f },
+        { { 90.8027f, -2.0831f, 1.4410f }, { 91.1528f, -1.6435f, 0.0447f }, 1.4441f },
+        { { 2.0776f, 0.0795f, -1.1350f }, { 0.9033f, -0.0636f, -0.5514f }, 0.9082f },
+    };
+    for (const Pair &pair : pairs) {
+        QVERIFY(std::abs(deltaE2000(pair.first, pair.second) - pair.expected) <= 0.001f);
+        QVERIFY(std::abs(deltaE2000(pair.second, pair.first) - pair.expected) <= 0.001f);
+    }
+}
+
+QTEST_GUILESS_MAIN(ColourDifferenceTests)
+
+#include "ColourDifferenceTests.moc"
@@ -0,0 +1,82 @@
+// Recordings written by ColourRecorder must replay frame for frame
+
+#include <QtCore/QTemporaryFile>
+#include <QtTest/QtTest>
+#include <random>
+
+#include "ColourRecording.h"
+#include "SampleData.h"
+
+class ColourRecordingTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void recordingReplaysExactly();
+};
+
+// Records a stream with changes in zone count, repeated frames and a clock
+// step backwards, then checks that every frame and offset replays exactly
+// and that a frame cut short at the end is dropped
+void ColourRecordingTests::recordingReplaysExactly() {
+    std::mt19937 random(3);
+    QVector<RecordedFrame> stream = colourStream(500, 16, random);
+    const QVector<RecordedFrame> narrow = colourStream(100, 9, random);
+    for (int i = 0; i < narrow.size(); ++i) {
+        stream[200 + i].colours = narrow[i].colours;
+    }
+    stream[300].colours = stream[299].colours;
+    stream[301].colours = stream[299].colours;
+    stream[400].timestampNs = stream[399].timestampNs - 5000000;
+    stream.last().colours = randomColours(64, random);
+
+    QTemporaryFile file;
+    if (!file.open()) {
+        QSKIP(qPrintable(file.errorString()));
+    }
+    file.close();
+
+    QString error;
+    ColourRecorder recorder;
+    QVERIFY2(recorder.open(file.fileName(), &error), qPrintable(error));
+    for (const RecordedFrame &frame : stream) {
+        QVERIFY(recorder.append(frame.colours, frame.timestampNs));
+    }
+    recorder.close();
+
+    ColourRecording recording;
+    QVERIFY2(recording.open(file.fileName(), &error), qPrintable(error));
+    QCOMPARE(recording.frameCount(), stream.size());
+    QCOMPARE(recording.maxZones(), 64);
+
+    QVector<QColor> colours;
+    qint64 offset = 0;
+    qint64 expectedUs = 0;
+    qint64 lastUs = stream.first().timestampNs / 1000;
+    for (int i = 0; i < stream.size(); ++i) {
+        const qint64 us = stream[i].timestampNs / 1000;
+        expectedUs += qMax<qint64>(0, us - lastUs);
+        lastUs = qMax(lastUs, us);
+        QVERIFY(recording.next(colours, &offset));
+        QVERIFY2(colours == stream[i].colours, qPrintable(QString("frame %1").arg(i)));
+        QCOMPARE(offset, expectedUs * 1000);
+    }
+    QVERIFY(!recording.next(colours, &offset));
+    recording.rewind();
+    QVERIFY(recording.next(colours, &offset));
+    QVERIFY(colours == stream.first().colours);
+    QCOMPARE(offset, qint64(0));
+    recording.close();
+
+    const quint64 bytes = recorder.bytes();
+    qInfo("Recording: %d frames in %llu bytes, %.1f per frame", stream.size(),
+          static_cast<unsigned long long>(bytes), double(bytes) / stream.size());
+
+    QFile truncated(file.fileName());
+    QVERIFY(truncated.resize(truncated.size() - 1));
+    QVERIFY2(recording.open(file.fileName(), &error), qPrintable(error));
+    QCOMPARE(recording.frameCount(), stream.size() - 1);
+}
+
+QTEST_GUILESS_MAIN(ColourRecordingTests)
+
+#include "ColourRecordingTests.moc"
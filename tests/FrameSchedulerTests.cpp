@@ -0,0 +1,85 @@
+// The frame scheduler on the real clock: deadlines on the grid, skipping
+// after an overrun, and the unthrottled rate
+
+#include <QtTest/QtTest>
+
+#include "FrameScheduler.h"
+#include "LatencyStats.h"
+
+class FrameSchedulerTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void framesKeepToGrid();
+    void unthrottledNeverWaits();
+};
+
+// Runs 100 FPS frames with one overrunning its deadline by 3.5 periods. No
+// frame may start before its deadline t0 + k * period, the overrun must
+// skip at least three deadlines and start on the last one passed rather
+// than bursting, and the skips the scheduler reports must add up to those
+// returned.
+void FrameSchedulerTests::framesKeepToGrid() {
+    const qint64 periodNs = 10000000;
+    const qint64 slackNs = 5000000;
+    FrameScheduler scheduler;
+    scheduler.setRate(100);
+
+    const qint64 t0 = monotonicNs();
+    QCOMPARE(scheduler.waitForNextFrame(), 0);
+
+    qint64 deadline = 0;       // Of the frame just started, in periods from t0
+    int calls = 1;
+    int skippedTotal = 0;
+    for (int frame = 1; frame <= 30; ++frame) {
+        if (frame == 15) {
+            // Work on until 3.5 periods past the next deadline
+            sleepUntilNs(t0 + (deadline + 1) * periodNs + periodNs * 7 / 2);
+        }
+
+        const int skipped = scheduler.waitForNextFrame();
+        const qint64 start = monotonicNs();
+        ++calls;
+        skippedTotal += skipped;
+        deadline += skipped + 1;
+
+        const qint64 due = t0 + deadline * periodNs;
+        QVERIFY2(start >= due, qPrintable(QString("frame %1 started %2 us early")
+                                          .arg(frame).arg((due - start) / 1000)));
+        if (frame == 15) {
+            QVERIFY2(skipped >= 3, qPrintable(QString::number(skipped)));
+            QVERIFY2(start - due < periodNs + slackNs,
+                     qPrintable(QString("%1 us late").arg((start - due) / 1000)));
+        } else {
+            QCOMPARE(skipped, 0);
+        }
+    }
+
+    const FrameTiming timing = scheduler.timing();
+    qInfo("Skipped %d deadlines, worst lateness %llu us", skippedTotal,
+          static_cast<unsigned long long>(timing.maxLatenessUs));
+    QCOMPARE(timing.frames, quint64(calls - 1));
+    QCOMPARE(timing.skipped, quint64(skippedTotal));
+}
+
+// At rate 0 every call returns at once without skipping
+void FrameSchedulerTests::unthrottledNeverWaits() {
+    FrameScheduler scheduler;
+    scheduler.setRate(0);
+    QCOMPARE(scheduler.rate(), 0);
+
+    const qint64 start = monotonicNs();
+    int skipped = 0;
+    for (int i = 0; i < 1000; ++i) {
+        skipped += scheduler.waitForNextFrame();
+    }
+    const qint64 elapsedNs = monotonicNs() - start;
+
+    QCOMPARE(skipped, 0);
+    QCOMPARE(scheduler.timing().frames, quint64(999));
+    QCOMPARE(scheduler.timing().skipped, quint64(0));
+    QVERIFY2(elapsedNs < 100000000, qPrintable(QString("%1 ms").arg(elapsedNs / 1000000)));
+}
+
+QTEST_GUILESS_MAIN(FrameSchedulerTests)
+#include "FrameSchedulerTests.moc"
@@ -0,0 +1,78 @@
+// The template encoder against formatting each command with snprintf
+
+#include <QtTest/QtTest>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "PilotEncoder.h"
+#include "UdpSender.h"
+
+class PilotEncoderTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void encoderMatchesSnprintf();
+};
+
+// Every command the encoder writes against snprintf, over each brightness,
+// every channel level and ids of every length
+void PilotEncoderTests::encoderMatchesSnprintf() {
+    std::vector<quint32> ids = { 0, 1, 9, 10, 99, 100, 65535, 4294967295u };
+    for (quint32 id = 1; id < 1000000000u; id *= 10) {
+        ids.push_back(id - 1);
+        ids.push_back(id);
+        ids.push_back(id * 10 - 1);
+    }
+    std::mt19937 random(2);
+    std::uniform_int_distribution<quint32> anyId;
+    for (int i = 0; i < 64; ++i) {
+        ids.push_back(anyId(random));
+    }
+
+    char expected[PilotEncoder::kMaxLength];
+    char actual[PilotEncoder::kMaxLength];
+    int mismatches = 0;
+    QByteArray firstMismatch;
+    auto compare = [&](int expectedLength, int actualLength) {
+        if (expectedLength != actualLength ||
+            std::memcmp(expected, actual, size_t(expectedLength)) != 0) {
+            if (mismatches++ == 0) {
+                firstMismatch = QByteArray(actual, actualLength) + " instead of " +
+                                QByteArray(expected, expectedLength);
+            }
+        }
+    };
+
+    for (int brightness = 1; brightness <= 100; ++brightness) {
+        const PilotEncoder encoder(brightness);
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const quint32 id = ids[i];
+            for (int level = 0; level < 256; ++level) {
+                const QColor colour(level, (level * 7 + int(i)) & 255, 255 - level);
+                compare(UdpSender::formatPilot(expected, int(sizeof(expected)), id, colour, brightness),
+                        encoder.colour(actual, id, colour.red(), colour.green(), colour.blue()));
+            }
+
+            const int kelvin = 1000 + int(id % 9001);
+            compare(snprintf(expected, sizeof(expected),
+                        "{\"id\":%u,\"method\":\"setPilot\",\"params\":{\"temp\":%d,\"dimming\":%d}}",
+                        id, kelvin, brightness),
+                    encoder.temperature(actual, id, kelvin));
+            compare(snprintf(expected, sizeof(expected),
+                        "{\"id\":%u,\"method\":\"setPilot\",\"params\":{\"dimming\":%d}}", id, brightness),
+                    encoder.dimming(actual, id));
+            for (bool on : { false, true }) {
+                compare(snprintf(expected, sizeof(expected),
+                            "{\"id\":%u,\"method\":\"setState\",\"params\":{\"state\":%s}}",
+                            id, on ? "true" : "false"),
+                        PilotEncoder::state(actual, id, on));
+            }
+        }
+    }
+    QVERIFY2(mismatches == 0, firstMismatch.constData());
+}
+
+QTEST_GUILESS_MAIN(PilotEncoderTests)
+
+#include "PilotEncoderTests.moc"
@@ -0,0 +1,130 @@
+// The settings store: versions, snapshot lifetimes, and a reader racing a
+// writer
+
+#include <QtTest/QtTest>
+#include <thread>
+
+#include "PipelineSettings.h"
+
+class PipelineSettingsTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void publishBumpsVersion();
+    void heldSnapshotOutlivesPublish();
+    void readerRacesWriter();
+};
+
+namespace {
+
+// Settings whose fields all follow from n, so a reader can tell a torn or
+// freed snapshot from a whole one
+PipelineSettings numberedSettings(int n) {
+    PipelineSettings settings;
+    settings.threshold = n;
+    settings.fps = n % 240;
+    CaptureZone zone;
+    zone.name = QString::number(n);
+    zone.rect = QRect(n % 1000, 0, 10, 10);
+    settings.zones = { zone };
+    return settings;
+}
+
+bool isNumbered(const PipelineSettings &settings, int n) {
+    return settings.threshold == n && settings.fps == n % 240 && settings.zones.size() == 1 &&
+           settings.zones[0].name == QString::number(n) &&
+           settings.zones[0].rect == QRect(n % 1000, 0, 10, 10);
+}
+
+}
+
+// Every publish bumps the version by one, a reader sees the latest snapshot,
+// and an unchanged store hands back the same snapshot
+void PipelineSettingsTests::publishBumpsVersion() {
+    SettingsStore store;
+    SettingsReader reader(&store);
+    QCOMPARE(store.version(), quint64(0));
+    QCOMPARE(reader.acquire().version, quint64(0));
+
+    for (int n = 1; n <= 3; ++n) {
+        store.publish(numberedSettings(n));
+        QCOMPARE(store.version(), quint64(n));
+        const PipelineSettings &settings = reader.acquire();
+        QCOMPARE(settings.version, quint64(n));
+        QVERIFY(isNumbered(settings, n));
+        QCOMPARE(&reader.acquire(), &settings);
+    }
+
+    QVERIFY(isNumbered(store.current(), 3));
+}
+
+// A snapshot a reader holds stays intact however many times the writer
+// publishes over it, until that reader acquires again
+void PipelineSettingsTests::heldSnapshotOutlivesPublish() {
+    SettingsStore store;
+    store.publish(numberedSettings(1));
+    SettingsReader slow(&store);
+    SettingsReader fast(&store);
+    const PipelineSettings &held = slow.acquire();
+
+    for (int n = 2; n <= 100; ++n) {
+        store.publish(numberedSettings(n));
+        QVERIFY(isNumbered(fast.acquire(), n));
+        QVERIFY(isNumbered(held, 1));
+        QCOMPARE(held.version, quint64(1));
+    }
+
+    QVERIFY(isNumbered(slow.acquire(), 100));
+}
+
+// A writer publishes 20000 snapshots, yielding between them, while a reader
+// on another thread keeps acquiring: every snapshot it gets must be whole,
+// and versions must never go backwards
+void PipelineSettingsTests::readerRacesWriter() {
+    const int count = 20000;
+    SettingsStore store;
+    store.publish(numberedSettings(0));
+
+    std::atomic<bool> started(false);
+    std::atomic<bool> done(false);
+    int broken = 0;
+    int backwards = 0;
+    int seen = 0;
+    std::thread readerThread([&store, &started, &done, &broken, &backwards, &seen] {
+        SettingsReader reader(&store);
+        quint64 lastVersion = 0;
+        started.store(true);
+        while (!done.load()) {
+            const PipelineSettings &settings = reader.acquire();
+            const int n = settings.threshold;
+            if (!isNumbered(settings, n) || settings.version != quint64(n) + 1) {
+                ++broken;
+            }
+            if (settings.version < lastVersion) {
+                ++backwards;
+            }
+            if (settings.version != lastVersion) {
+                ++seen;
+            }
+            lastVersion = settings.version;
+        }
+    });
+
+    while (!started.load()) {
+        std::this_thread::yield();
+    }
+    for (int n = 1; n < count; ++n) {
+        store.publish(numberedSettings(n));
+        std::this_thread::yield();
+    }
+    done.store(true);
+    readerThread.join();
+
+    qInfo("Reader saw %d of %d snapshots", seen, count);
+    QCOMPARE(broken, 0);
+    QCOMPARE(backwards, 0);
+    QCOMPARE(store.version(), quint64(count));
+}
+
+QTEST_GUILESS_MAIN(PipelineSettingsTests)
+#include "PipelineSettingsTests.moc"
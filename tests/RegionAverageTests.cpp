@@ -0,0 +1,194 @@
+// Region averaging against the straightforward code it replaces: the SIMD
+// kernels and summed-area table must give exactly the summed pixels,
+// sampling must stay within its error bound and the reducers must pick the
+// right cluster, or the benchmarks timing them mean nothing. Measured
+// errors are logged, so a run shows how much margin each path has.
+
+#include <QtTest/QtTest>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "EdgeLayout.h"
+#include "RegionAverage.h"
+#include "SampleData.h"
+
+namespace {
+
+int channelDistance(const QColor &first, const QColor &second) {
+    return std::max({ std::abs(first.red() - second.red()), std::abs(first.green() - second.green()),
+                      std::abs(first.blue() - second.blue()) });
+}
+
+} // namespace
+
+class RegionAverageTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void kernelsMatchScalar();
+    void samplingWithinBound();
+    void reducersPickDominantColour();
+    void histogramCoversLargeScreens();
+    void summedAreaMatchesSums();
+    void summedAreaCoversLargeScreens();
+
+private:
+    QImage m_noise;
+    QImage m_gradient;
+};
+
+void RegionAverageTests::initTestCase() {
+    // Fixed seed, so every run works on the same data
+    std::mt19937 random(1);
+    m_noise = noiseImage(QSize(1920, 1080), random);
+    m_gradient = gradientImage(QSize(1920, 1080));
+}
+
+// The SIMD kernels must give exactly the scalar sums
+void RegionAverageTests::kernelsMatchScalar() {
+    const QRect rects[] = {
+        m_noise.rect(), QRect(0, 0, 1, 1), QRect(3, 5, 7, 9), QRect(1, 1, 33, 17),
+        QRect(17, 3, 255, 31), QRect(101, 77, 640, 480)
+    };
+
+    for (AverageKernel kernel : { AverageKernel::Sse2, AverageKernel::Avx2 }) {
+        if (!averageKernelSupported(kernel)) {
+            qInfo("%s is not supported on this CPU", averageKernelName(kernel));
+            continue;
+        }
+        for (const QRect &rect : rects) {
+            const ChannelSums expected = sumImage(m_noise, rect, AverageKernel::Scalar);
+            const ChannelSums actual = sumImage(m_noise, rect, kernel);
+            QVERIFY2(actual.red == expected.red && actual.green == expected.green &&
+                     actual.blue == expected.blue && actual.count == expected.count,
+                     qPrintable(QString("%1 differs from scalar over %2x%3 at %4,%5")
+                                .arg(averageKernelName(kernel)).arg(rect.width()).arg(rect.height())
+                                .arg(rect.x()).arg(rect.y())));
+        }
+    }
+}
+
+// Largest difference between sampled and full averages over a few regions
+// of noise and of a smooth image, per budget, against samplingErrorBound()
+void RegionAverageTests::samplingWithinBound() {
+    const QRect rects[] = {
+        m_noise.rect(), QRect(100, 100, 1000, 1000), QRect(3, 7, 501, 37), QRect(960, 0, 200, 1080)
+    };
+
+    for (const QImage *image : { &m_noise, &m_gradient }) {
+        const char *imageName = image == &m_noise ? "noise" : "gradient";
+        for (int budget : { 1024, 4096, 16384 }) {
+            double worst = 0;
+            for (const QRect &rect : rects) {
+                const ChannelSums full = sumImage(*image, rect);
+                const ChannelSums sampled = sampleImage(*image, rect, budget);
+                const quint64 fullTotals[] = { full.red, full.green, full.blue };
+                const quint64 sampledTotals[] = { sampled.red, sampled.green, sampled.blue };
+                for (int channel = 0; channel < 3; ++channel) {
+                    const double error = std::abs(double(sampledTotals[channel]) / sampled.count -
+                                                  double(fullTotals[channel]) / full.count);
+                    worst = std::max(worst, error);
+                }
+            }
+
+            const double bound = samplingErrorBound(budget);
+            qInfo("Sampling %d px of %s: off by up to %.2f levels (bound %.2f)", budget, imageName,
+                  worst, bound);
+            QVERIFY(worst <= bound);
+        }
+    }
+}
+
+// A region mostly of one colour with the rest another: the mean blends
+// them, dominant picks the larger, and vivid picks a colourful minority
+// over a grey majority
+void RegionAverageTests::reducersPickDominantColour() {
+    const QColor red(200, 40, 40);
+    const QColor grey(128, 128, 128);
+    QImage image(400, 300, QImage::Format_RGB32);
+    std::mt19937 random(4);
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            // Slight noise, so each cluster spreads over neighbouring bins
+            const QColor &colour = x < 80 ? red : grey;
+            const int jitter = int(random() % 5) - 2;
+            line[x] = qRgb(colour.red() + jitter, colour.green() - jitter, colour.blue() + jitter);
+        }
+    }
+
+    ColourHistogram histogram;
+    const QColor mean = reduceColour(image, image.rect(), ColourReducer::Mean, 0, histogram);
+    const QColor dominant = reduceColour(image, image.rect(), ColourReducer::Dominant, 0, histogram);
+    const QColor vivid = reduceColour(image, image.rect(), ColourReducer::Vivid, 0, histogram);
+    const QColor sampled = reduceColour(image, image.rect(), ColourReducer::Vivid, 4096, histogram);
+
+    QVERIFY(channelDistance(mean, red) > 40 && channelDistance(mean, grey) > 10);
+    QVERIFY2(channelDistance(dominant, grey) <= 2, qPrintable(dominant.name()));
+    QVERIFY2(channelDistance(vivid, red) <= 2, qPrintable(vivid.name()));
+    QVERIFY2(channelDistance(sampled, red) <= 2, qPrintable(sampled.name()));
+}
+
+// A whole 8K screen holds more than 2^32 in each channel's total
+void RegionAverageTests::histogramCoversLargeScreens() {
+    QImage image(7680, 4320, QImage::Format_RGB32);
+    image.fill(qRgb(250, 200, 100));
+
+    ColourHistogram histogram;
+    for (ColourReducer reducer : { ColourReducer::Dominant, ColourReducer::Vivid }) {
+        QCOMPARE(reduceColour(image, image.rect(), reducer, 0, histogram), QColor(250, 200, 100));
+    }
+}
+
+// Table lookups against summing the pixels: exact for rects on cell edges,
+// those reaching the image's ragged edge included. Edge zones are rounded
+// to cells, so only how far they stray is logged.
+void RegionAverageTests::summedAreaMatchesSums() {
+    EdgeLayout layout;
+    layout.top = layout.bottom = 16;
+    layout.left = layout.right = 9;
+    const QVector<CaptureZone> zones = edgeZones(layout, m_gradient.rect(), FilterSettings());
+
+    SummedAreaTable table;
+    for (int scale : { 1, 8, 16 }) {
+        table.build(m_gradient, scale);
+        const QRect aligned[] = {
+            m_gradient.rect(), QRect(scale * 3, scale * 5, scale * 40, scale * 9),
+            QRect(scale * 7, 0, m_gradient.width() - scale * 7, scale * 2)
+        };
+        for (const QRect &rect : aligned) {
+            const ChannelSums expected = sumImage(m_gradient, rect);
+            const ChannelSums actual = table.sum(rect);
+            QCOMPARE(actual.red, expected.red);
+            QCOMPARE(actual.green, expected.green);
+            QCOMPARE(actual.blue, expected.blue);
+            QCOMPARE(actual.count, expected.count);
+        }
+
+        int worst = 0;
+        for (const CaptureZone &zone : zones) {
+            worst = std::max(worst, channelDistance(table.meanColour(zone.rect),
+                                                    averageColour(m_gradient, zone.rect)));
+        }
+        qInfo("Summed-area table, %d px cells: edge zones off by up to %d levels", scale, worst);
+    }
+}
+
+// A whole 8K screen holds more than 2^32 in each channel's total
+void RegionAverageTests::summedAreaCoversLargeScreens() {
+    QImage image(7680, 4320, QImage::Format_RGB32);
+    image.fill(qRgb(250, 200, 100));
+
+    SummedAreaTable table;
+    for (int scale : { 1, 8 }) {
+        table.build(image, scale);
+        QCOMPARE(table.meanColour(image.rect()), QColor(250, 200, 100));
+    }
+}
+
+QTEST_GUILESS_MAIN(RegionAverageTests)
+
+#include "RegionAverageTests.moc"
@@ -0,0 +1,117 @@
+// The single-producer single-consumer ring: full and empty handling, order
+// across wraps, and a producer and consumer on separate threads
+
+#include <QtTest/QtTest>
+#include <thread>
+
+#include "SpscRing.h"
+
+class SpscRingTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void fullAndEmpty();
+    void orderAcrossWraps();
+    void twoThreadsKeepOrder();
+};
+
+// A ring of four takes exactly four values, refuses a fifth until one is
+// read, and reads back empty once drained
+void SpscRingTests::fullAndEmpty() {
+    SpscRing<int, 4> ring;
+    QCOMPARE(ring.capacity(), 4);
+    QVERIFY(!ring.beginRead());
+
+    for (int i = 0; i < 4; ++i) {
+        int *slot = ring.beginWrite();
+        QVERIFY(slot);
+        *slot = i;
+        ring.commitWrite();
+    }
+    QVERIFY(!ring.beginWrite());
+
+    int *oldest = ring.beginRead();
+    QVERIFY(oldest);
+    QCOMPARE(*oldest, 0);
+    ring.commitRead();
+    QVERIFY(ring.beginWrite());
+
+    for (int i = 1; i < 4; ++i) {
+        int *slot = ring.beginRead();
+        QVERIFY(slot);
+        QCOMPARE(*slot, i);
+        ring.commitRead();
+    }
+    QVERIFY(!ring.beginRead());
+}
+
+// Pushes and pops in uneven batches so the indices wrap the slots many
+// times over, checking every value comes out once and in order
+void SpscRingTests::orderAcrossWraps() {
+    SpscRing<int, 8> ring;
+    int written = 0;
+    int read = 0;
+    for (int round = 0; round < 1000; ++round) {
+        const int pushes = 1 + round % 7;
+        for (int i = 0; i < pushes; ++i) {
+            int *slot = ring.beginWrite();
+            if (!slot) {
+                QVERIFY(written - read == 8);
+                break;
+            }
+            *slot = written++;
+            ring.commitWrite();
+        }
+        const int pops = 1 + (round * 3) % 8;
+        for (int i = 0; i < pops; ++i) {
+            int *slot = ring.beginRead();
+            if (!slot) {
+                QCOMPARE(read, written);
+                break;
+            }
+            QCOMPARE(*slot, read++);
+            ring.commitRead();
+        }
+    }
+    QVERIFY(written > 1000);
+}
+
+// A producer and consumer thread pass a million values through a small ring,
+// spinning when it is full or empty; the consumer must see them all in order
+void SpscRingTests::twoThreadsKeepOrder() {
+    const quint32 count = 1000000;
+    SpscRing<quint32, 16> ring;
+
+    std::thread producer([&ring, count] {
+        for (quint32 i = 0; i < count; ++i) {
+            quint32 *slot;
+            while (!(slot = ring.beginWrite())) {
+                std::this_thread::yield();
+            }
+            *slot = i;
+            ring.commitWrite();
+        }
+    });
+
+    quint32 expected = 0;
+    quint32 misordered = 0;
+    while (expected < count) {
+        quint32 *slot = ring.beginRead();
+        if (!slot) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (*slot != expected) {
+            ++misordered;
+        }
+        ++expected;
+        ring.commitRead();
+    }
+    producer.join();
+
+    QCOMPARE(misordered, quint32(0));
+    QVERIFY(!ring.beginRead());
+}
+
+QTEST_GUILESS_MAIN(SpscRingTests)
+#include "SpscRingTests.moc"
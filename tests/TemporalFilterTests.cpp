@@ -0,0 +1,106 @@
+// The per-zone temporal filters on a simulated clock: step responses of the
+// EMA and spring, and the Kalman filter settling on a noisy colour
+
+#include <QtTest/QtTest>
+#include <cmath>
+#include <random>
+
+#include "TemporalFilter.h"
+
+class TemporalFilterTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void stepResponse();
+    void kalmanConverges();
+};
+
+// A step from black to grey 200, sampled every millisecond: the output must
+// rise without overshooting, cover 90% of the step in the response time and
+// settle on it. A second filter sampled only at the response time must
+// agree, since the output doesn't depend on how often it is read.
+void TemporalFilterTests::stepResponse() {
+    for (FilterSettings::Type type : { FilterSettings::Ema, FilterSettings::Spring }) {
+        const char *name = type == FilterSettings::Ema ? "EMA" : "Spring";
+        FilterSettings settings;
+        settings.type = type;
+        settings.responseMs = 200;
+
+        ColourFilter filter;
+        ColourFilter sparse;
+        const qint64 start = 1000000000;
+        for (ColourFilter *each : { &filter, &sparse }) {
+            each->setSettings(settings);
+            each->measure(QColor(0, 0, 0), start);
+            each->measure(QColor(200, 200, 200), start);
+        }
+
+        int last = 0;
+        for (int ms = 1; ms <= 1000; ++ms) {
+            const int level = filter.sample(start + qint64(ms) * 1000000).red();
+            QVERIFY2(level >= last && level <= 200,
+                     qPrintable(QString("%1: %2 after %3 ms").arg(name).arg(level).arg(ms)));
+            if (ms == 200) {
+                qInfo("%s: %d after 200 ms", name, level);
+                QVERIFY2(std::abs(level - 180) <= 1, name);
+                QCOMPARE(sparse.sample(start + 200000000).red(), level);
+            }
+            last = level;
+        }
+        QVERIFY2(last == 200, name);
+        QVERIFY2(!filter.isSettling(), name);
+    }
+}
+
+// A grey 100 measured at 60 FPS with noise of the configured measurement
+// variance. Once settled, the output's mean must sit on the true level and
+// it must scatter less than the measurements; after a step to 160 it must
+// follow within a fifth of a second.
+void TemporalFilterTests::kalmanConverges() {
+    FilterSettings settings;
+    settings.type = FilterSettings::Kalman;
+    ColourFilter filter;
+    filter.setSettings(settings);
+
+    std::mt19937 random(7);
+    std::normal_distribution<double> noise(0, std::sqrt(double(settings.measurementNoise)));
+    const qint64 period = 1000000000 / 60;
+    qint64 now = 1000000000;
+
+    // Mean and standard deviation of the output and of the measurements
+    // over frames frames of level
+    auto run = [&](int level, int frames, int skip, double *outputMean, double *outputSpread,
+                   double *measuredSpread) {
+        double sum = 0, square = 0, measuredSquare = 0;
+        int count = 0;
+        for (int i = 0; i < frames; ++i) {
+            const int measured = qBound(0, level + int(std::lround(noise(random))), 255);
+            filter.measure(QColor(measured, measured, measured), now);
+            const int output = filter.sample(now).red();
+            now += period;
+            if (i >= skip) {
+                sum += output;
+                square += double(output) * output;
+                measuredSquare += double(measured - level) * (measured - level);
+                ++count;
+            }
+        }
+        *outputMean = sum / count;
+        *outputSpread = std::sqrt(square / count - *outputMean * *outputMean);
+        *measuredSpread = std::sqrt(measuredSquare / count);
+    };
+
+    double mean = 0, spread = 0, measuredSpread = 0;
+    run(100, 600, 60, &mean, &spread, &measuredSpread);
+    qInfo("Kalman: mean %.2f, spread %.2f against %.2f measured", mean, spread, measuredSpread);
+    QVERIFY(std::abs(mean - 100) <= 1.5);
+    QVERIFY(spread < 0.7 * measuredSpread);
+
+    run(160, 120, 12, &mean, &spread, &measuredSpread);
+    qInfo("Kalman: mean %.2f after the step", mean);
+    QVERIFY(std::abs(mean - 160) <= 2);
+}
+
+QTEST_GUILESS_MAIN(TemporalFilterTests)
+
+#include "TemporalFilterTests.moc"
@@ -0,0 +1,149 @@
+// The bulb sender against a stand-in bulb, a socket on the loopback
+// interface, so nothing leaves the machine
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QThread>
+#include <QtNetwork/QUdpSocket>
+#include <QtTest/QtTest>
+
+#include "UdpSender.h"
+
+class UdpSenderTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void repliesRetransmitNewest();
+    void rateLimitKeepsNewest();
+};
+
+// A stand-in bulb on loopback that answers or ignores each setPilot: replies
+// must be matched, and a missed acknowledgement must resend the newest
+// colour, never an older one
+void UdpSenderTests::repliesRetransmitNewest() {
+    QUdpSocket bulb;
+    if (!bulb.bind(QHostAddress::LocalHost, 0)) {
+        QSKIP(qPrintable(bulb.errorString()));
+    }
+
+    BulbTarget target;
+    target.ip = "127.0.0.1";
+    target.port = bulb.localPort();
+    UdpSender sender;
+    sender.setTargets({ target });
+
+    // Keeps the sender polling and retransmitting until the bulb gets a
+    // datagram, like the sender thread would
+    auto receive = [&sender, &bulb](QByteArray *payload, QHostAddress *from, quint16 *port) {
+        QElapsedTimer timer;
+        timer.start();
+        while (!bulb.hasPendingDatagrams()) {
+            if (timer.hasExpired(2000)) {
+                return false;
+            }
+            sender.pollResponses();
+            sender.flushPending();
+            QThread::usleep(500);
+        }
+        payload->resize(int(bulb.pendingDatagramSize()));
+        bulb.readDatagram(payload->data(), payload->size(), from, port);
+        return true;
+    };
+    auto answer = [&bulb](const QByteArray &payload, const QHostAddress &from, quint16 port) {
+        quint32 id = 0;
+        bool error = false;
+        UdpSender::parseReply(payload.constData(), payload.size(), &id, &error);
+        bulb.writeDatagram(QString("{\"method\":\"setPilot\",\"id\":%1,\"env\":\"pro\","
+                                   "\"result\":{\"success\":true}}").arg(id).toUtf8(), from, port);
+    };
+    auto settle = [&sender](quint64 acknowledged) {
+        QElapsedTimer timer;
+        timer.start();
+        while (sender.linkStats().first().acknowledged < acknowledged && !timer.hasExpired(1000)) {
+            sender.pollResponses();
+            QThread::usleep(500);
+        }
+    };
+
+    QByteArray payload;
+    QHostAddress from;
+    quint16 port = 0;
+
+    // Answered straight away
+    sender.sendColour(QColor(10, 20, 30));
+    QVERIFY(receive(&payload, &from, &port));
+    answer(payload, from, port);
+    settle(1);
+
+    // Two colours go unanswered; only the second may come back
+    sender.sendColour(QColor(40, 50, 60));
+    QVERIFY(receive(&payload, &from, &port));
+    sender.sendColour(QColor(70, 80, 90));
+    QVERIFY(receive(&payload, &from, &port));
+    QVERIFY(receive(&payload, &from, &port));
+    QVERIFY2(payload.contains("\"r\":70,\"g\":80,\"b\":90"), payload.constData());
+    answer(payload, from, port);
+    settle(2);
+
+    const BulbLinkStats stats = sender.linkStats().first();
+    QCOMPARE(stats.sent, quint64(4));
+    QCOMPARE(stats.acknowledged, quint64(2));
+    QCOMPARE(stats.retransmits, quint64(1));
+    QVERIFY(stats.rttMs > 0);
+    qInfo("Replies: RTT %.3f ms", stats.rttMs);
+}
+
+// A burst of six colours at a bulb limited to 5 updates a second, one at a
+// time: the first goes out at once and the rest are held back, each
+// replacing the one before, so once the bucket refills only the newest is
+// sent and nothing after it
+void UdpSenderTests::rateLimitKeepsNewest() {
+    QUdpSocket bulb;
+    if (!bulb.bind(QHostAddress::LocalHost, 0)) {
+        QSKIP(qPrintable(bulb.errorString()));
+    }
+
+    BulbTarget target;
+    target.ip = "127.0.0.1";
+    target.port = bulb.localPort();
+    UdpSender sender;
+    sender.setTargets({ target });
+    sender.setRateLimit(5, 1);
+
+    // Flushes until the bulb gets a datagram or waitMs pass
+    auto receive = [&sender, &bulb](int waitMs, QByteArray *payload) {
+        QElapsedTimer timer;
+        timer.start();
+        while (!bulb.hasPendingDatagrams()) {
+            if (timer.hasExpired(waitMs)) {
+                return false;
+            }
+            sender.flushPending();
+            QThread::usleep(500);
+        }
+        payload->resize(int(bulb.pendingDatagramSize()));
+        bulb.readDatagram(payload->data(), payload->size());
+        return true;
+    };
+
+    for (int i = 1; i <= 6; ++i) {
+        sender.sendColour(QColor(10 * i, 20, 30));
+    }
+    QCOMPARE(sender.coalescedUpdates(), quint64(4));
+    const int waitMs = sender.msUntilPending();
+    QVERIFY2(waitMs > 0 && waitMs <= 200, qPrintable(QString::number(waitMs)));
+
+    QByteArray payload;
+    QVERIFY(receive(100, &payload));
+    QVERIFY2(payload.contains("\"r\":10,\"g\":20,\"b\":30"), payload.constData());
+    QVERIFY2(!receive(waitMs / 2, &payload), payload.constData());
+
+    QVERIFY(receive(1000, &payload));
+    QVERIFY2(payload.contains("\"r\":60,\"g\":20,\"b\":30"), payload.constData());
+    QVERIFY2(!receive(400, &payload), payload.constData());
+    QCOMPARE(sender.msUntilPending(), -1);
+    QCOMPARE(sender.coalescedUpdates(), quint64(4));
+}
+
+QTEST_GUILESS_MAIN(UdpSenderTests)
+
+#include "UdpSenderTests.moc"
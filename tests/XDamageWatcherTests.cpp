@@ -0,0 +1,99 @@
+// The DAMAGE watcher against a real X server, such as Xvfb: draws into a
+// window of its own and checks which zones the watcher reports. Skipped
+// when there is no display.
+
+#include <QtTest/QtTest>
+
+#include "LatencyStats.h"
+#include "XDamageWatcher.h"
+
+// X11 headers come last, their macros (None, Bool, Status...) clash with Qt
+#include <X11/Xlib.h>
+
+class XDamageWatcherTests : public QObject {
+    Q_OBJECT
+
+private slots:
+    void reportsOverlappingZones();
+};
+
+// Maps a window at (100, 100) on the root, then fills parts of it. A fill
+// must mark only the zones it overlaps, a fill outside every zone must
+// report none, and with nothing drawn a wait must run to its timeout.
+void XDamageWatcherTests::reportsOverlappingZones() {
+    if (qEnvironmentVariableIsEmpty("DISPLAY")) {
+        QSKIP("DISPLAY is not set");
+    }
+    std::unique_ptr<XDamageWatcher> watcher = XDamageWatcher::create();
+    if (!watcher) {
+        QSKIP("No DAMAGE and XFIXES 2 on this display");
+    }
+
+    Display *display = XOpenDisplay(nullptr);
+    QVERIFY(display);
+    const int screen = DefaultScreen(display);
+
+    // Override-redirect, so no window manager moves or decorates it
+    XSetWindowAttributes attributes;
+    attributes.override_redirect = True;
+    attributes.background_pixel = BlackPixel(display, screen);
+    const Window window = XCreateWindow(display, RootWindow(display, screen), 100, 100, 200, 200, 0,
+                                        CopyFromParent, InputOutput, CopyFromParent,
+                                        CWOverrideRedirect | CWBackPixel, &attributes);
+    XSelectInput(display, window, StructureNotifyMask);
+    XMapWindow(display, window);
+    XEvent event;
+    do {
+        XNextEvent(display, &event);
+    } while (event.type != MapNotify);
+    const GC gc = XCreateGC(display, window, 0, nullptr);
+    XSync(display, False);
+
+    const QVector<QRect> zones = {
+        QRect(100, 100, 60, 60),    // Window's top left
+        QRect(240, 240, 60, 60),    // Window's bottom right
+        QRect(600, 400, 50, 50)     // Off the window
+    };
+    QVector<bool> changed;
+
+    // Takes whatever mapping the window damaged
+    while (watcher->waitForChanges({ QRect(0, 0, 32767, 32767) }, 200, changed)) {
+    }
+
+    auto fill = [display, window, gc, screen](int x, int y, int width, int height) {
+        static bool white = false;
+        white = !white;
+        XSetForeground(display, gc, white ? WhitePixel(display, screen) : BlackPixel(display, screen));
+        XFillRectangle(display, window, gc, x, y, width, height);
+        XSync(display, False);
+    };
+
+    // Window (10, 10) is root (110, 110), inside the first zone only
+    fill(10, 10, 20, 20);
+    QVERIFY(watcher->waitForChanges(zones, 1000, changed));
+    QCOMPARE(changed, QVector<bool>({ true, false, false }));
+
+    // Across the bottom right corner of the window, the second zone only
+    fill(150, 150, 50, 50);
+    QVERIFY(watcher->waitForChanges(zones, 1000, changed));
+    QCOMPARE(changed, QVector<bool>({ false, true, false }));
+
+    // Inside the window but between the zones
+    fill(80, 80, 40, 40);
+    QVERIFY(!watcher->waitForChanges(zones, 1000, changed));
+    QCOMPARE(changed, QVector<bool>({ false, false, false }));
+
+    // Nothing drawn: the wait runs its course
+    const qint64 start = monotonicNs();
+    QVERIFY(!watcher->waitForChanges(zones, 200, changed));
+    const qint64 waitedMs = (monotonicNs() - start) / 1000000;
+    QVERIFY2(waitedMs >= 190, qPrintable(QString("%1 ms").arg(waitedMs)));
+    QCOMPARE(changed, QVector<bool>({ false, false, false }));
+
+    XFreeGC(display, gc);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+}
+
+QTEST_GUILESS_MAIN(XDamageWatcherTests)
+#include "XDamageWatcherTests.moc"